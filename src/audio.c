@@ -26,8 +26,76 @@
 #include "ipnode.h"
 #include "audio.h"
 #include "demod.h"
+#include "ax25_link.h"
+#include "metrics.h"
+#include "ring.h"
+#include "rt.h"
+#include "port.h"
 
-#define roundup1k(n) (((n) + 0x3ff) & ~0x3ff)
+/*
+ * At least this much sound card input can wait for the
+ * demodulator before any is dropped
+ */
+#define CAPTURE_RING_MS 1000
+
+/*
+ * Sound card periods are tuned between these, in frames,
+ * with PERIODS_PER_BUFFER of them in the card's buffer
+ */
+#define PERIOD_MIN_FRAMES 32
+#define PERIOD_MAX_FRAMES 2048
+#define PERIOD_START_FRAMES 128
+#define PERIODS_PER_BUFFER 4
+
+/*
+ * A smaller period is tried after this long, and this many
+ * wakeups, at one size.  The wait doubles each time it has
+ * to grow again, up to the most.
+ */
+#define TUNE_SHRINK_SEC 60
+#define TUNE_SHRINK_MAX_SEC 3600
+#define TUNE_SHRINK_SAMPLES 1000
+
+/*
+ * Files and pipes are read and written this much at a time
+ */
+#define FILE_BUFFER_BYTES 4096
+
+struct pcm_tune_s
+{
+    char name[80];
+    char *inout;              // "input" or "output", for messages
+    bool mmap;                // buffers mapped, else read and written
+    bool fixed;               // PERIOD in the config file
+    snd_pcm_uframes_t period; // what the driver gave us
+    snd_pcm_uframes_t buffer;
+    snd_pcm_uframes_t want;   // period to change to when it's safe
+    snd_pcm_uframes_t floor;  // smallest not known to xrun
+    double steady_since;      // last change
+    double hold;              // seconds before trying smaller
+    long least_slack;         // frames, since then
+    long samples;
+};
+
+struct adev_s;
+
+/*
+ * One kind of audio device, picked by its name when the
+ * port is opened.  The opens return the buffer size in
+ * bytes or -1, and anything a backend has no need to do
+ * is left NULL.
+ */
+struct audio_ops_s
+{
+    int (*open_in)(struct adev_s *, char *);
+    int (*open_out)(struct adev_s *, char *);
+    int (*get)(struct adev_s *); // next input byte, -1 at the end
+    void (*put)(struct adev_s *, unsigned char);
+    void (*flush)(struct adev_s *);
+    void (*wait)(struct adev_s *); // until all that's been sent is out
+    void (*close_in)(struct adev_s *);
+    void (*close_out)(struct adev_s *);
+};
 
 /*
  * FYI snd_pcm_t is a typedef of struct _snd_pcm
@@ -36,11 +104,24 @@
  * https://github.com/alsa-project/alsa-lib/blob/master/src/pcm/pcm_local.h
  */
 
-static struct
+struct adev_s
 {
+    struct audio_s *pa;
+    int port; // number, for the metrics
+
+    const struct audio_ops_s *in;
+    const struct audio_ops_s *out;
+
     snd_pcm_t *audio_in_handle;
     snd_pcm_t *audio_out_handle;
 
+    int fd_in;  // file and pipe types
+    int fd_out;
+
+    double start_time;  // for pacing file input
+    long frames_in;
+    long bytes_out;     // for the WAV header
+
     unsigned char *inbuf_ptr;
     unsigned char *outbuf_ptr;
 
@@ -50,117 +131,181 @@ static struct
     int inbuf_len;
     int outbuf_len;
     int inbuf_next;
-} adev;
 
-static struct audio_s *save_audio_config_p;
+    struct pcm_tune_s tune_in;
+    struct pcm_tune_s tune_out;
+    bool out_primed; // output buffer has been full this burst
+
+    /*
+     * Sound card input is read by its own thread into the
+     * ring, so a slow decode can't make the card overrun
+     */
+    struct ring_s capture_ring;
+    pthread_t capture_tid;
+    volatile bool capture_run;
+    unsigned char *period_ptr;
+    int capture_quarter;
+    bool capture_dropping;
+};
+
 static int channels;
 static int bits_per_sample;
 
-static int set_alsa_params(snd_pcm_t *, struct audio_s *, char *, char *);
+static int set_alsa_params(struct adev_s *, snd_pcm_t *, struct pcm_tune_s *);
 
-int audio_open(struct audio_s *pa)
+/*
+ * Sound card period tuning
+ *
+ * Slack is how much the card could still take when the thread
+ * gets to it, free space for input or what's left to play for
+ * output.  An xrun, or a wakeup with less than a period of
+ * slack, doubles the period.  A long stretch where the latest
+ * wakeup would still leave two periods of slack at half the
+ * size halves it, but never back to a size that has had an
+ * xrun, and each grow doubles how long that stretch must be.
+ * So each board settles at the smallest period it can keep
+ * up with.
+ */
+static void tune_init(struct pcm_tune_s *t, struct audio_s *pa, char *name, char *inout)
 {
-    char audio_in_name[30];
-    char audio_out_name[30];
-
-    channels = 2; // I and Q Stereo
-    bits_per_sample = 16;
-
-    save_audio_config_p = pa;
-
-    memset(&adev, 0, sizeof(adev));
-
-    adev.audio_in_handle = NULL;
-    adev.audio_out_handle = NULL;
+    memset(t, 0, sizeof(struct pcm_tune_s));
+
+    strlcpy(t->name, name, sizeof(t->name));
+    t->inout = inout;
+    t->mmap = pa->mmap;
+    t->fixed = (pa->period != AUDIO_PERIOD_AUTO);
+    t->want = t->fixed ? pa->period * (int)FS / 1000 : PERIOD_START_FRAMES;
+    t->floor = PERIOD_MIN_FRAMES;
+    t->hold = TUNE_SHRINK_SEC;
+}
 
-    if (pa->defined == true)
+static void tune_grow(struct pcm_tune_s *t)
+{
+    if (t->fixed == false && t->period < PERIOD_MAX_FRAMES && t->want == t->period)
     {
-        /* If not specified, the device names should be "default". */
+        t->want = t->period * 2;
 
-        strlcpy(audio_in_name, pa->adevice_in, sizeof(audio_in_name));
-        strlcpy(audio_out_name, pa->adevice_out, sizeof(audio_out_name));
+        if (t->hold < TUNE_SHRINK_MAX_SEC)
+        {
+            t->hold *= 2;
+        }
+    }
+}
 
-        fprintf(stderr, "Audio device for both receive and transmit: %s\n", audio_in_name);
+static void tune_slack(struct pcm_tune_s *t, long slack)
+{
+    if (t->samples++ == 0 || slack < t->least_slack)
+    {
+        t->least_slack = slack;
+    }
 
-        int err = snd_pcm_open(&(adev.audio_in_handle), audio_in_name, SND_PCM_STREAM_CAPTURE, 0);
+    if (slack < (long)t->period)
+    {
+        tune_grow(t);
+    }
+}
 
-        if (err < 0)
-        {
-            return -1;
-        }
+static void tune_xrun(struct pcm_tune_s *t)
+{
+    if (t->floor <= t->period)
+    {
+        t->floor = t->period * 2;
+    }
 
-        adev.inbuf_size_in_bytes = set_alsa_params(adev.audio_in_handle, pa, audio_in_name, "input");
+    tune_grow(t);
+}
 
-        if (adev.inbuf_size_in_bytes <= 0)
-        {
-            return -1;
-        }
+/*
+ * True when the period should change
+ */
+static bool tune_due(struct pcm_tune_s *t)
+{
+    if (t->fixed == true)
+        return false;
 
-        err = snd_pcm_open(&(adev.audio_out_handle), audio_out_name, SND_PCM_STREAM_PLAYBACK, 0);
+    if (t->want == t->period && t->samples >= TUNE_SHRINK_SAMPLES && dtime_now() - t->steady_since > t->hold)
+    {
+        long half = t->period / 2;
+        long late = (long)(t->buffer - t->period) - t->least_slack;
 
-        if (err < 0)
+        if (half >= (long)t->floor && late < (long)(t->buffer / 2) - 3 * half)
         {
-            return -1;
+            t->want = half;
         }
-
-        adev.outbuf_size_in_bytes = set_alsa_params(adev.audio_out_handle, pa, audio_out_name, "output");
-
-        if (adev.outbuf_size_in_bytes <= 0)
+        else
         {
-            return -1;
+            t->steady_since = dtime_now();
+            t->samples = 0;
         }
+    }
 
-        adev.inbuf_ptr = (unsigned char *)calloc(adev.inbuf_size_in_bytes, sizeof(unsigned char));
+    return t->want != t->period;
+}
 
-        if (adev.inbuf_ptr == NULL)
-            return -1;
+/*
+ * Only between transfers, by the thread using the handle.
+ * Returns the new bytes per period like set_alsa_params().
+ */
+static int tune_apply(struct adev_s *A, snd_pcm_t *handle, struct pcm_tune_s *t)
+{
+    snd_pcm_uframes_t was = t->period;
 
-        adev.outbuf_ptr = (unsigned char *)calloc(adev.outbuf_size_in_bytes, sizeof(unsigned char));
+    snd_pcm_drop(handle);
 
-        if (adev.outbuf_ptr == NULL)
-            return -1;
+    int bytes = set_alsa_params(A, handle, t);
 
-        adev.inbuf_len = 0;
-        adev.outbuf_len = 0;
-        adev.inbuf_next = 0;
+    if (bytes > 0)
+    {
+        fprintf(stderr, "Audio %s period now %d frames, %.1f ms.\n", t->inout, (int)t->period, 1000.0 * t->period / FS);
+        return bytes;
+    }
 
-        audio_wait();
+    fprintf(stderr, "Audio %s could not change period, keeping %d frames.\n", t->inout, (int)was);
 
-        return 0;
-    }
+    t->want = was;
+    t->fixed = true;
 
-    return -1;
+    return set_alsa_params(A, handle, t);
 }
 
-static int set_alsa_params(snd_pcm_t *handle, struct audio_s *pa, char *devname, char *inout)
+/*
+ * Called by set_alsa_params(), which frees hw_params
+ */
+static int set_hw_params(struct adev_s *A, snd_pcm_t *handle, struct pcm_tune_s *t, snd_pcm_hw_params_t *hw_params)
 {
-    snd_pcm_hw_params_t *hw_params;
+    char *devname = t->name;
+    char *inout = t->inout;
 
-    int err = snd_pcm_hw_params_malloc(&hw_params);
+    int err = snd_pcm_hw_params_any(handle, hw_params);
 
     if (err < 0)
     {
-        fprintf(stderr, "Could not alloc hw param structure.\n%s\n", snd_strerror(err));
+        fprintf(stderr, "Could not init hw param structure.\n%s\n", snd_strerror(err));
         fprintf(stderr, "for %s %s.\n", devname, inout);
         return -1;
     }
 
-    err = snd_pcm_hw_params_any(handle, hw_params);
-
-    if (err < 0)
+    if (t->mmap == true)
     {
-        fprintf(stderr, "Could not init hw param structure.\n%s\n", snd_strerror(err));
-        fprintf(stderr, "for %s %s.\n", devname, inout);
-        return -1;
-    }
+        err = snd_pcm_hw_params_set_access(handle, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED);
 
-    err = snd_pcm_hw_params_set_access(handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
+        if (err < 0)
+        {
+            fprintf(stderr, "Could not map the buffers for %s %s, reading and writing them instead.\n", devname, inout);
+            t->mmap = false;
+        }
+    }
 
-    if (err < 0)
+    if (t->mmap == false)
     {
-        fprintf(stderr, "Could not set interleaved mode.\n%s\n", snd_strerror(err));
-        fprintf(stderr, "for %s %s.\n", devname, inout);
-        return -1;
+        err = snd_pcm_hw_params_set_access(handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
+
+        if (err < 0)
+        {
+            fprintf(stderr, "Could not set interleaved mode.\n%s\n", snd_strerror(err));
+            fprintf(stderr, "for %s %s.\n", devname, inout);
+            return -1;
+        }
     }
 
     err = snd_pcm_hw_params_set_format(handle, hw_params, SND_PCM_FORMAT_S16_LE);
@@ -203,22 +348,7 @@ static int set_alsa_params(snd_pcm_t *handle, struct audio_s *pa, char *devname,
         return -1;
     }
 
-    int buf_size_in_bytes = roundup1k((val * (channels * bits_per_sample / 8) * ONE_BUF_TIME) / 1000);
-
-#if __arm__
-    /*
-     * RPi hack
-     *
-     * Reducing buffer size is fine for input
-     * but not so good for output
-     */
-    if (*inout == 'o')
-    {
-        buf_size_in_bytes = buf_size_in_bytes * 4;
-    }
-#endif
-
-    snd_pcm_uframes_t fpp = buf_size_in_bytes / (channels * bits_per_sample / 8); // stereo
+    snd_pcm_uframes_t fpp = t->want;
 
     dir = 0;
 
@@ -231,6 +361,17 @@ static int set_alsa_params(snd_pcm_t *handle, struct audio_s *pa, char *devname,
         return -1;
     }
 
+    snd_pcm_uframes_t frames = fpp * PERIODS_PER_BUFFER;
+
+    err = snd_pcm_hw_params_set_buffer_size_near(handle, hw_params, &frames);
+
+    if (err < 0)
+    {
+        fprintf(stderr, "Could not set buffer size\n%s\n", snd_strerror(err));
+        fprintf(stderr, "for %s %s.\n", devname, inout);
+        return -1;
+    }
+
     err = snd_pcm_hw_params(handle, hw_params);
 
     if (err < 0)
@@ -246,6 +387,11 @@ static int set_alsa_params(snd_pcm_t *handle, struct audio_s *pa, char *devname,
      */
     err = snd_pcm_hw_params_get_period_size(hw_params, &fpp, NULL);
 
+    if (err >= 0)
+    {
+        err = snd_pcm_hw_params_get_buffer_size(hw_params, &frames);
+    }
+
     if (err < 0)
     {
         fprintf(stderr, "Could not get audio period size.\n%s\n", snd_strerror(err));
@@ -253,222 +399,1071 @@ static int set_alsa_params(snd_pcm_t *handle, struct audio_s *pa, char *devname,
         return -1;
     }
 
-    snd_pcm_hw_params_free(hw_params);
+    t->period = t->want = fpp;
+    t->buffer = frames;
+    t->steady_since = dtime_now();
+    t->samples = 0;
+
+    metrics_gauge(A->port, (*inout == 'i') ? GAUGE_CAPTURE_PERIOD : GAUGE_PLAYBACK_PERIOD, fpp);
 
     /*
      * A "frame" is one sample for all channels
      *
      * The read and write use units of frames, not bytes
      */
-    adev.bytes_per_frame = snd_pcm_frames_to_bytes(handle, 1);
-
-    buf_size_in_bytes = fpp * adev.bytes_per_frame;
+    A->bytes_per_frame = snd_pcm_frames_to_bytes(handle, 1);
 
-    if (buf_size_in_bytes < 256 || buf_size_in_bytes > 32768)
+    if (fpp > PERIOD_MAX_FRAMES)
     {
-        buf_size_in_bytes = 2048;
+        fpp = PERIOD_MAX_FRAMES;
     }
 
-    return buf_size_in_bytes;
+    return fpp * A->bytes_per_frame;
 }
 
 /*
- * Called by demod
+ * Returns the bytes in one period, at most PERIOD_MAX_FRAMES
  */
-int audio_get()
+static int set_alsa_params(struct adev_s *A, snd_pcm_t *handle, struct pcm_tune_s *t)
 {
-    int err;
+    snd_pcm_hw_params_t *hw_params;
 
-    int retries = 0;
+    int err = snd_pcm_hw_params_malloc(&hw_params);
 
-    while (adev.inbuf_next >= adev.inbuf_len)
+    if (err < 0)
     {
-        err = snd_pcm_readi(adev.audio_in_handle, adev.inbuf_ptr, adev.inbuf_size_in_bytes / adev.bytes_per_frame);
-
-        if (err > 0)
-        {
-            adev.inbuf_len = err * adev.bytes_per_frame; /* convert to number of bytes */
-            adev.inbuf_next = 0;
-        }
-        else if (err == 0)
-        {
-            /*
-             * Didn't expect this, but it's not a problem
-             * Wait a little while and try again
-             */
-            fprintf(stderr, "Audio input got zero bytes: %s\n", snd_strerror(err));
-            SLEEP_MS(10);
-
-            adev.inbuf_len = 0;
-            adev.inbuf_next = 0;
-        }
-        else
-        {
-            fprintf(stderr, "Audio input device error code %d: %s\n", err, snd_strerror(err));
-
-            if (err == (-EPIPE))
-            {
-                fprintf(stderr, "Most likely a slow CPU unable to keep up with the audio stream.\n");
-            }
-
-            /*
-             * Try to recover a few times and eventually give up
-             */
-            if (++retries > 10)
-            {
-                adev.inbuf_len = 0;
-                adev.inbuf_next = 0;
+        fprintf(stderr, "Could not alloc hw param structure.\n%s\n", snd_strerror(err));
+        fprintf(stderr, "for %s %s.\n", t->name, t->inout);
+        return -1;
+    }
 
-                return -1;
-            }
+    int bytes = set_hw_params(A, handle, t, hw_params);
 
-            if (err == -EPIPE)
-            {
-                /*
-                 * EPIPE means overrun
-                 */
-                snd_pcm_recover(adev.audio_in_handle, err, 1);
-            }
-            else
-            {
-                SLEEP_MS(250);
-                snd_pcm_recover(adev.audio_in_handle, err, 1);
-            }
-        }
-    }
+    snd_pcm_hw_params_free(hw_params);
 
-    if (adev.inbuf_next < adev.inbuf_len)
-        return adev.inbuf_ptr[adev.inbuf_next++];
-    else
-        return 0;
+    return bytes;
 }
 
 /*
- * Called externally by tx.c
- * but also internally
+ * WAV files must be PCM, stereo I and Q, S16 at our sample rate.
+ * Leaves the file positioned at the start of the samples.
  */
-void audio_flush()
+static int wav_read_header(int fd)
 {
-    snd_pcm_status_t *status;
-
-    snd_pcm_status_alloca(&status);
-
-    int k = snd_pcm_status(adev.audio_out_handle, status);
-
-    if (k != 0)
-    {
-        fprintf(stderr, "Audio output get status error.\n%s\n", snd_strerror(k));
-    }
+    unsigned char hdr[12];
+    unsigned char chunk[8];
+    bool have_fmt = false;
 
-    if ((k = snd_pcm_status_get_state(status)) != SND_PCM_STATE_RUNNING)
+    if (read(fd, hdr, 12) != 12 || memcmp(hdr, "RIFF", 4) != 0 || memcmp(hdr + 8, "WAVE", 4) != 0)
     {
-        k = snd_pcm_prepare(adev.audio_out_handle);
-
-        if (k != 0)
-        {
-            fprintf(stderr, "Audio output start error.\n%s\n", snd_strerror(k));
-        }
+        fprintf(stderr, "Audio input is not a WAV file ");
+        return -1;
     }
 
-    unsigned char *psound = adev.outbuf_ptr;
-    int retries = 10;
-
-    while (retries-- > 0)
+    while (read(fd, chunk, 8) == 8)
     {
-        k = snd_pcm_writei(adev.audio_out_handle, psound, adev.outbuf_len / adev.bytes_per_frame);
+        unsigned int size = chunk[4] | (chunk[5] << 8) | (chunk[6] << 16) | ((unsigned int)chunk[7] << 24);
 
-        if (k == -EPIPE)
-        {
-            fprintf(stderr, "Audio output data underrun.\n");
-            snd_pcm_recover(adev.audio_out_handle, k, 1);
-        }
-        else if (k == -ESTRPIPE)
-        {
-            fprintf(stderr, "Driver suspended, recovering\n");
-            snd_pcm_recover(adev.audio_out_handle, k, 1);
-        }
-        else if (k == -EBADFD)
+        if (memcmp(chunk, "data", 4) == 0)
         {
-            k = snd_pcm_prepare(adev.audio_out_handle);
-
-            if (k < 0)
+            if (have_fmt == false)
             {
-                fprintf(stderr, "Error preparing after bad state: %s\n", snd_strerror(k));
+                fprintf(stderr, "WAV data chunk before fmt chunk ");
+                return -1;
             }
+
+            return 0;
         }
-        else if (k < 0)
+
+        if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16)
         {
-            fprintf(stderr, "Audio write error: %s\n", snd_strerror(k));
+            unsigned char fmt[16];
 
-            k = snd_pcm_prepare(adev.audio_out_handle);
+            if (read(fd, fmt, 16) != 16)
+                break;
 
-            if (k < 0)
+            int format = fmt[0] | (fmt[1] << 8);
+            int nchan = fmt[2] | (fmt[3] << 8);
+            int rate = fmt[4] | (fmt[5] << 8) | (fmt[6] << 16) | (fmt[7] << 24);
+            int bits = fmt[14] | (fmt[15] << 8);
+
+            if (format != 1 || nchan != channels || rate != (int)FS || bits != bits_per_sample)
             {
-                fprintf(stderr, "Error preparing after error: %s\n", snd_strerror(k));
+                fprintf(stderr, "WAV must be PCM, %d channels, %d bits, %d samples/sec, not %d, %d, %d, %d ",
+                        channels, bits_per_sample, (int)FS, format, nchan, bits, rate);
+                return -1;
             }
+
+            have_fmt = true;
+            size -= 16;
         }
-        else if (k != adev.outbuf_len / adev.bytes_per_frame)
-        {
-            fprintf(stderr, "Audio write took %d frames rather than %d.\n", k, adev.outbuf_len / adev.bytes_per_frame);
 
-            // Go around again with the rest of it
+        lseek(fd, size + (size & 1), SEEK_CUR); // chunks are padded to even length
+    }
 
-            psound += k * adev.bytes_per_frame;
-            adev.outbuf_len -= k * adev.bytes_per_frame;
-        }
-        else
-        {
-            // Success!
-            adev.outbuf_len = 0;
-            return;
-        }
+    fprintf(stderr, "No data found in WAV file ");
+    return -1;
+}
+
+static void put_le(unsigned char *p, unsigned int val, int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        p[i] = (val >> (i * 8)) & 0xff;
     }
+}
 
-    fprintf(stderr, "Audio write error retry count exceeded.\n");
+static void wav_write_header(struct adev_s *A, int fd, long data_bytes)
+{
+    unsigned char hdr[44];
+
+    memcpy(hdr, "RIFF", 4);
+    put_le(hdr + 4, 36 + data_bytes, 4);
+    memcpy(hdr + 8, "WAVEfmt ", 8);
+    put_le(hdr + 16, 16, 4);
+    put_le(hdr + 20, 1, 2); // PCM
+    put_le(hdr + 22, channels, 2);
+    put_le(hdr + 24, (int)FS, 4);
+    put_le(hdr + 28, (int)FS * A->bytes_per_frame, 4);
+    put_le(hdr + 32, A->bytes_per_frame, 2);
+    put_le(hdr + 34, bits_per_sample, 2);
+    memcpy(hdr + 36, "data", 4);
+    put_le(hdr + 40, data_bytes, 4);
+
+    if (pwrite(fd, hdr, sizeof(hdr), 0) != sizeof(hdr))
+    {
+        fprintf(stderr, "Could not write WAV header: %s\n", strerror(errno));
+    }
 
-    adev.outbuf_len = 0;
+    lseek(fd, 0, SEEK_END);
 }
 
 /*
- * Called by modulate
+ * Raw and WAV files, and stdin and stdout
  */
-void audio_put(unsigned char c)
+static int file_open_in(struct adev_s *A, char *name)
 {
-    adev.outbuf_ptr[adev.outbuf_len++] = c;
+    A->fd_in = open(name, O_RDONLY);
 
-    if (adev.outbuf_len == adev.outbuf_size_in_bytes)
+    if (A->fd_in < 0)
     {
-        audio_flush();
+        fprintf(stderr, "Could not open audio input file %s: %s\n", name, strerror(errno));
+        return -1;
     }
+
+    return FILE_BUFFER_BYTES;
 }
 
-void audio_wait()
+static int wav_open_in(struct adev_s *A, char *name)
 {
-    audio_flush();
-    snd_pcm_drain(adev.audio_out_handle);
+    if (file_open_in(A, name) < 0)
+        return -1;
+
+    if (wav_read_header(A->fd_in) < 0)
+    {
+        fprintf(stderr, "for %s input.\n", name);
+        return -1;
+    }
+
+    return FILE_BUFFER_BYTES;
 }
 
-void audio_close()
+static int pipe_open_in(struct adev_s *A, char *name)
 {
-    if (adev.audio_in_handle != NULL && adev.audio_out_handle != NULL)
-    {
-        audio_wait();
+    A->fd_in = STDIN_FILENO;
 
-        snd_pcm_close(adev.audio_in_handle);
-        snd_pcm_close(adev.audio_out_handle);
+    return FILE_BUFFER_BYTES;
+}
 
-        adev.audio_in_handle = adev.audio_out_handle = NULL;
+/*
+ * File and pipe input
+ *
+ * Paced to the sample rate, unless running fast,
+ * so the rest of the node sees real time go by.
+ */
+static int file_get(struct adev_s *A)
+{
+    while (A->inbuf_next >= A->inbuf_len)
+    {
+        int n = read(A->fd_in, A->inbuf_ptr, A->inbuf_size_in_bytes);
+
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (n <= 0)
+        {
+            if (n < 0)
+            {
+                fprintf(stderr, "Audio input read error: %s\n", strerror(errno));
+            }
+
+            return -1; // end of input
+        }
+
+        A->inbuf_len = n;
+        A->inbuf_next = 0;
+        A->frames_in += n / A->bytes_per_frame;
+
+        if (A->pa->fast == false)
+        {
+            double ahead = ((double)A->frames_in / FS) - (dtime_now() - A->start_time);
+
+            if (ahead > 0.0)
+            {
+                SLEEP_MS((int)(ahead * 1000.0));
+            }
+        }
+    }
+
+    return A->inbuf_ptr[A->inbuf_next++];
+}
+
+static void file_close_in(struct adev_s *A)
+{
+    close(A->fd_in);
+    A->fd_in = -1;
+}
+
+static int file_open_out(struct adev_s *A, char *name)
+{
+    A->fd_out = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (A->fd_out < 0)
+    {
+        fprintf(stderr, "Could not open audio output file %s: %s\n", name, strerror(errno));
+        return -1;
+    }
+
+    return FILE_BUFFER_BYTES;
+}
+
+static int wav_open_out(struct adev_s *A, char *name)
+{
+    if (file_open_out(A, name) < 0)
+        return -1;
+
+    wav_write_header(A, A->fd_out, 0); // sizes are filled in at close
+
+    return FILE_BUFFER_BYTES;
+}
+
+static int pipe_open_out(struct adev_s *A, char *name)
+{
+    /*
+     * Keep our own copy of stdout and send anything else
+     * printed there to stderr, so it can't corrupt the samples.
+     */
+    A->fd_out = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+
+    return FILE_BUFFER_BYTES;
+}
+
+/*
+ * Output is gathered into whole buffers for the flush
+ */
+static void buffer_put(struct adev_s *A, unsigned char c)
+{
+    A->outbuf_ptr[A->outbuf_len++] = c;
+
+    if (A->outbuf_len == A->outbuf_size_in_bytes)
+    {
+        A->out->flush(A);
+    }
+}
+
+static void file_flush(struct adev_s *A)
+{
+    unsigned char *psound = A->outbuf_ptr;
+
+    while (A->outbuf_len > 0)
+    {
+        int k = write(A->fd_out, psound, A->outbuf_len);
+
+        if (k < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (k <= 0)
+        {
+            fprintf(stderr, "Audio output write error: %s\n", strerror(errno));
+            break;
+        }
+
+        psound += k;
+        A->outbuf_len -= k;
+        A->bytes_out += k;
+    }
+
+    A->outbuf_len = 0;
+}
+
+static void file_close_out(struct adev_s *A)
+{
+    close(A->fd_out);
+    A->fd_out = -1;
+}
+
+static void wav_close_out(struct adev_s *A)
+{
+    wav_write_header(A, A->fd_out, A->bytes_out);
+    file_close_out(A);
+}
+
+static const struct audio_ops_s file_ops = {
+    .open_in = file_open_in,
+    .open_out = file_open_out,
+    .get = file_get,
+    .put = buffer_put,
+    .flush = file_flush,
+    .close_in = file_close_in,
+    .close_out = file_close_out,
+};
+
+static const struct audio_ops_s wav_ops = {
+    .open_in = wav_open_in,
+    .open_out = wav_open_out,
+    .get = file_get,
+    .put = buffer_put,
+    .flush = file_flush,
+    .close_in = file_close_in,
+    .close_out = wav_close_out,
+};
+
+/*
+ * stdin is left open for whoever else has it
+ */
+static const struct audio_ops_s pipe_ops = {
+    .open_in = pipe_open_in,
+    .open_out = pipe_open_out,
+    .get = file_get,
+    .put = buffer_put,
+    .flush = file_flush,
+    .close_out = file_close_out,
+};
+
+/*
+ * Output that goes nowhere, there's no null input
+ */
+static int null_open_out(struct adev_s *A, char *name)
+{
+    return FILE_BUFFER_BYTES;
+}
+
+static void null_put(struct adev_s *A, unsigned char c)
+{
+}
+
+static const struct audio_ops_s null_ops = {
+    .open_out = null_open_out,
+    .put = null_put,
+};
+
+/*
+ * Hands one transfer to the ring, and keeps an eye on it
+ */
+static void capture_put(struct adev_s *A, unsigned char *data, int len)
+{
+    int ring_size = (int)(A->capture_ring.mask + 1);
+    int n = ring_write(&A->capture_ring, data, len);
+
+    if (n < len)
+    {
+        if (A->capture_dropping == false)
+        {
+            fprintf(stderr, "Audio capture ring full, the demodulator is not keeping up.\n");
+        }
+
+        metrics_add(METRIC_CAPTURE_DROPPED, len - n);
+    }
+
+    A->capture_dropping = (n < len);
+
+    int high_water = atomic_load_explicit(&A->capture_ring.high_water, memory_order_relaxed);
+
+    metrics_gauge(A->port, GAUGE_CAPTURE_FILL, ring_fill(&A->capture_ring));
+    metrics_gauge(A->port, GAUGE_CAPTURE_HIGH_WATER, high_water);
+
+    /*
+     * Say so each time the high water mark
+     * gets into another quarter of the ring
+     */
+    if (high_water * 4 / ring_size > A->capture_quarter)
+    {
+        A->capture_quarter = high_water * 4 / ring_size;
+
+        fprintf(stderr, "Audio capture ring high water %d ms\n",
+                (int)(1000.0 * high_water / (A->bytes_per_frame * FS)));
+    }
+}
+
+/*
+ * One period through our own buffer, returns
+ * frames or a negative error
+ */
+static int capture_rw(struct adev_s *A)
+{
+    struct pcm_tune_s *t = &A->tune_in;
+    int frames = (t->period < PERIOD_MAX_FRAMES) ? (int)t->period : PERIOD_MAX_FRAMES;
+
+    int err = snd_pcm_readi(A->audio_in_handle, A->period_ptr, frames);
+
+    if (err > 0)
+    {
+        snd_pcm_sframes_t left = snd_pcm_avail_update(A->audio_in_handle);
+
+        if (left >= 0)
+        {
+            tune_slack(t, (long)(t->buffer - t->period) - left);
+        }
+
+        capture_put(A, A->period_ptr, err * A->bytes_per_frame);
+    }
+
+    return err;
+}
+
+/*
+ * Everything waiting, straight from the card's buffer
+ * into the ring
+ */
+static int capture_mmap(struct adev_s *A)
+{
+    struct pcm_tune_s *t = &A->tune_in;
+    snd_pcm_t *handle = A->audio_in_handle;
+    int done = 0;
+
+    if (snd_pcm_state(handle) == SND_PCM_STATE_PREPARED)
+    {
+        int err = snd_pcm_start(handle);
+
+        if (err < 0)
+            return err;
+    }
+
+    int err = snd_pcm_wait(handle, 1000);
+
+    if (err < 0)
+        return err;
+
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(handle);
+
+    if (avail < 0)
+        return (int)avail;
+
+    tune_slack(t, (long)t->buffer - avail);
+
+    while (avail > 0)
+    {
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t frames = avail;
+
+        err = snd_pcm_mmap_begin(handle, &areas, &offset, &frames);
+
+        if (err < 0)
+            return err;
+
+        capture_put(A, (unsigned char *)areas[0].addr + areas[0].first / 8 + offset * A->bytes_per_frame,
+                    frames * A->bytes_per_frame);
+
+        snd_pcm_sframes_t k = snd_pcm_mmap_commit(handle, offset, frames);
+
+        if (k < 0)
+            return (int)k;
+
+        avail -= frames;
+        done += frames;
+    }
+
+    return done;
+}
+
+/*
+ * Capture thread
+ *
+ * Only moves periods from the sound card to the ring,
+ * gets the card going again after an overrun, and
+ * changes the period when the tuning asks for it.
+ */
+static void *capture_thread(void *arg)
+{
+    struct adev_s *A = (struct adev_s *)arg;
+    int retries = 0;
+
+    rt_thread_start(RT_THREAD_CAPTURE, A->pa->cpu);
+
+    while (A->capture_run == true)
+    {
+        if (tune_due(&A->tune_in) && tune_apply(A, A->audio_in_handle, &A->tune_in) < 0)
+        {
+            break;
+        }
+
+        int err = A->tune_in.mmap ? capture_mmap(A) : capture_rw(A);
+
+        if (err > 0)
+        {
+            retries = 0;
+        }
+        else if (err == 0)
+        {
+            /*
+             * Didn't expect this, but it's not a problem
+             * Wait a little while and try again
+             */
+            fprintf(stderr, "Audio input got zero bytes: %s\n", snd_strerror(err));
+            SLEEP_MS(10);
+        }
+        else
+        {
+            fprintf(stderr, "Audio input device error code %d: %s\n", err, snd_strerror(err));
+
+            if (err == (-EPIPE))
+            {
+                fprintf(stderr, "Most likely a slow CPU unable to keep up with the audio stream.\n");
+            }
+
+            /*
+             * Try to recover a few times and eventually give up
+             */
+            if (++retries > 10)
+            {
+                break;
+            }
+
+            if (err == -EPIPE)
+            {
+                /*
+                 * EPIPE means overrun
+                 */
+                metrics_add(METRIC_AUDIO_OVERRUNS, 1);
+                tune_xrun(&A->tune_in);
+                snd_pcm_recover(A->audio_in_handle, err, 1);
+            }
+            else
+            {
+                SLEEP_MS(250);
+                snd_pcm_recover(A->audio_in_handle, err, 1);
+            }
+        }
+    }
+
+    ring_close(&A->capture_ring);
+
+    return NULL;
+}
+
+static int capture_start(struct adev_s *A)
+{
+    pthread_attr_t attr;
+
+    A->period_ptr = (unsigned char *)calloc(PERIOD_MAX_FRAMES * A->bytes_per_frame, sizeof(unsigned char));
+
+    if (A->period_ptr == NULL)
+        return -1;
+
+    if (ring_init(&A->capture_ring, (int)(A->bytes_per_frame * FS * CAPTURE_RING_MS / 1000)) < 0)
+        return -1;
+
+    A->capture_run = true;
+
+    rt_thread_attr(&attr);
+
+    int e = pthread_create(&A->capture_tid, &attr, capture_thread, (void *)A);
+
+    if (e != 0)
+    {
+        fprintf(stderr, "Fatal: Could not create audio capture thread\n");
+        A->capture_run = false;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Takes what the capture thread has put in the ring
+ */
+static int alsa_get(struct adev_s *A)
+{
+    if (A->inbuf_next >= A->inbuf_len)
+    {
+        int n = ring_read(&A->capture_ring, A->inbuf_ptr, A->inbuf_size_in_bytes);
+
+        A->inbuf_len = n;
+        A->inbuf_next = 0;
+
+        if (n <= 0)
+        {
+            A->inbuf_len = 0;
+
+            return -1; // capture gave up
+        }
+    }
+
+    return A->inbuf_ptr[A->inbuf_next++];
+}
+
+static int alsa_open_in(struct adev_s *A, char *name)
+{
+    if (snd_pcm_open(&(A->audio_in_handle), name, SND_PCM_STREAM_CAPTURE, 0) < 0)
+    {
+        return -1;
+    }
+
+    tune_init(&A->tune_in, A->pa, name, "input");
+
+    int bytes = set_alsa_params(A, A->audio_in_handle, &A->tune_in);
+
+    if (bytes <= 0 || capture_start(A) < 0)
+    {
+        return -1;
+    }
+
+    return bytes;
+}
+
+static void alsa_close_in(struct adev_s *A)
+{
+    if (A->capture_run == true)
+    {
+        A->capture_run = false;
+        pthread_join(A->capture_tid, NULL);
+
+        ring_free(&A->capture_ring);
+        free(A->period_ptr);
+        A->period_ptr = NULL;
+    }
+
+    snd_pcm_close(A->audio_in_handle);
+    A->audio_in_handle = NULL;
+}
+
+/*
+ * Output slack, once the buffer has been full this burst
+ */
+static void playback_slack(struct adev_s *A, snd_pcm_sframes_t avail)
+{
+    struct pcm_tune_s *t = &A->tune_out;
+
+    if (avail < (snd_pcm_sframes_t)t->period)
+    {
+        A->out_primed = true;
+    }
+
+    if (A->out_primed == true && snd_pcm_state(A->audio_out_handle) == SND_PCM_STATE_RUNNING)
+    {
+        tune_slack(t, (long)t->buffer - avail);
+    }
+}
+
+/*
+ * Returns frames written or a negative error,
+ * like snd_pcm_writei()
+ */
+static int playback_write(struct adev_s *A, unsigned char *psound, int frames)
+{
+    snd_pcm_t *handle = A->audio_out_handle;
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(handle);
+
+    if (avail < 0)
+        return (int)avail;
+
+    playback_slack(A, avail);
+
+    if (A->tune_out.mmap == false)
+    {
+        return snd_pcm_writei(handle, psound, frames);
+    }
+
+    int done = 0;
+
+    while (done < frames)
+    {
+        if (avail == 0)
+        {
+            if (snd_pcm_state(handle) == SND_PCM_STATE_PREPARED)
+            {
+                int err = snd_pcm_start(handle);
+
+                if (err < 0)
+                    return err;
+            }
+
+            int err = snd_pcm_wait(handle, 1000);
+
+            if (err < 0)
+                return err;
+
+            avail = snd_pcm_avail_update(handle);
+
+            if (avail < 0)
+                return (int)avail;
+
+            playback_slack(A, avail);
+            continue;
+        }
+
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t n = (avail < frames - done) ? avail : frames - done;
+
+        int err = snd_pcm_mmap_begin(handle, &areas, &offset, &n);
+
+        if (err < 0)
+            return err;
+
+        memcpy((unsigned char *)areas[0].addr + areas[0].first / 8 + offset * A->bytes_per_frame,
+               psound + done * A->bytes_per_frame, n * A->bytes_per_frame);
+
+        snd_pcm_sframes_t k = snd_pcm_mmap_commit(handle, offset, n);
+
+        if (k < 0)
+            return (int)k;
+
+        avail -= n;
+        done += n;
+    }
+
+    return done;
+}
+
+static void alsa_flush(struct adev_s *A)
+{
+    snd_pcm_status_t *status;
+
+    snd_pcm_status_alloca(&status);
+
+    int k = snd_pcm_status(A->audio_out_handle, status);
+
+    if (k != 0)
+    {
+        fprintf(stderr, "Audio output get status error.\n%s\n", snd_strerror(k));
+    }
+
+    if ((k = snd_pcm_status_get_state(status)) != SND_PCM_STATE_RUNNING)
+    {
+        k = snd_pcm_prepare(A->audio_out_handle);
+
+        if (k != 0)
+        {
+            fprintf(stderr, "Audio output start error.\n%s\n", snd_strerror(k));
+        }
+
+        A->out_primed = false;
+    }
+
+    unsigned char *psound = A->outbuf_ptr;
+    int retries = 10;
+
+    while (retries-- > 0)
+    {
+        k = playback_write(A, psound, A->outbuf_len / A->bytes_per_frame);
+
+        if (k == -EPIPE)
+        {
+            fprintf(stderr, "Audio output data underrun.\n");
+            metrics_add(METRIC_AUDIO_UNDERRUNS, 1);
+            tune_xrun(&A->tune_out);
+            snd_pcm_recover(A->audio_out_handle, k, 1);
+        }
+        else if (k == -ESTRPIPE)
+        {
+            fprintf(stderr, "Driver suspended, recovering\n");
+            snd_pcm_recover(A->audio_out_handle, k, 1);
+        }
+        else if (k == -EBADFD)
+        {
+            k = snd_pcm_prepare(A->audio_out_handle);
+
+            if (k < 0)
+            {
+                fprintf(stderr, "Error preparing after bad state: %s\n", snd_strerror(k));
+            }
+        }
+        else if (k < 0)
+        {
+            fprintf(stderr, "Audio write error: %s\n", snd_strerror(k));
+
+            k = snd_pcm_prepare(A->audio_out_handle);
+
+            if (k < 0)
+            {
+                fprintf(stderr, "Error preparing after error: %s\n", snd_strerror(k));
+            }
+        }
+        else if (k != A->outbuf_len / A->bytes_per_frame)
+        {
+            fprintf(stderr, "Audio write took %d frames rather than %d.\n", k, A->outbuf_len / A->bytes_per_frame);
+
+            // Go around again with the rest of it
+
+            psound += k * A->bytes_per_frame;
+            A->outbuf_len -= k * A->bytes_per_frame;
+        }
+        else
+        {
+            // Success!
+            A->outbuf_len = 0;
+            return;
+        }
+    }
+
+    fprintf(stderr, "Audio write error retry count exceeded.\n");
+
+    A->outbuf_len = 0;
+}
+
+static int alsa_open_out(struct adev_s *A, char *name)
+{
+    if (snd_pcm_open(&(A->audio_out_handle), name, SND_PCM_STREAM_PLAYBACK, 0) < 0)
+    {
+        return -1;
+    }
+
+    tune_init(&A->tune_out, A->pa, name, "output");
+
+    return set_alsa_params(A, A->audio_out_handle, &A->tune_out);
+}
+
+static void alsa_wait(struct adev_s *A)
+{
+    snd_pcm_drain(A->audio_out_handle);
+
+    /*
+     * Between bursts is the only safe time to
+     * change the output period
+     */
+    if (tune_due(&A->tune_out))
+    {
+        int bytes = tune_apply(A, A->audio_out_handle, &A->tune_out);
+
+        if (bytes > 0)
+        {
+            A->outbuf_size_in_bytes = bytes;
+        }
+    }
+}
+
+static void alsa_close_out(struct adev_s *A)
+{
+    snd_pcm_close(A->audio_out_handle);
+    A->audio_out_handle = NULL;
+}
+
+static const struct audio_ops_s alsa_ops = {
+    .open_in = alsa_open_in,
+    .open_out = alsa_open_out,
+    .get = alsa_get,
+    .put = buffer_put,
+    .flush = alsa_flush,
+    .wait = alsa_wait,
+    .close_in = alsa_close_in,
+    .close_out = alsa_close_out,
+};
+
+/*
+ * The device name picks the audio backend:
+ *
+ *    -  stdin or stdout         raw S16 I/Q pipe
+ *    null                       discard output
+ *    name.wav                   WAV file, stereo S16 at 9600
+ *    name.raw, name.iq, /path   raw S16 I/Q file
+ *    anything else              ALSA device name
+ */
+static const struct audio_ops_s *audio_backend(char *name, bool output)
+{
+    int len = strlen(name);
+
+    if (strcmp(name, "-") == 0 || strcasecmp(name, output ? "stdout" : "stdin") == 0)
+        return &pipe_ops;
+
+    if (output && strcasecmp(name, "null") == 0)
+        return &null_ops;
+
+    if (len > 4 && strcasecmp(name + len - 4, ".wav") == 0)
+        return &wav_ops;
+
+    if ((len > 4 && strcasecmp(name + len - 4, ".raw") == 0) ||
+        (len > 3 && strcasecmp(name + len - 3, ".iq") == 0) ||
+        name[0] == '/' || name[0] == '.')
+        return &file_ops;
+
+    return &alsa_ops;
+}
+
+/*
+ * Opens the port's sound card or files
+ */
+int audio_open(struct port_s *P)
+{
+    struct audio_s *pa = P->audio;
+    char audio_in_name[80];
+    char audio_out_name[80];
+
+    channels = 2; // I and Q Stereo
+    bits_per_sample = 16;
+
+    struct adev_s *A = (struct adev_s *)calloc(1, sizeof(struct adev_s));
+
+    if (A == NULL)
+        return -1;
+
+    P->adev = A;
+
+    A->pa = pa;
+    A->port = P->number;
+
+    A->audio_in_handle = NULL;
+    A->audio_out_handle = NULL;
+    A->fd_in = -1;
+    A->fd_out = -1;
+    A->bytes_per_frame = channels * bits_per_sample / 8;
+
+    if (pa->defined == true)
+    {
+        /* If not specified, the device names should be "default". */
+
+        strlcpy(audio_in_name, pa->adevice_in, sizeof(audio_in_name));
+        strlcpy(audio_out_name, pa->adevice_out, sizeof(audio_out_name));
+
+        if (strcmp(audio_in_name, audio_out_name) == 0)
+        {
+            fprintf(stderr, "Audio device for both receive and transmit: %s\n", audio_in_name);
+        }
+        else
+        {
+            fprintf(stderr, "Audio input device for receive: %s\n", audio_in_name);
+            fprintf(stderr, "Audio output device for transmit: %s\n", audio_out_name);
+        }
+
+        A->in = audio_backend(audio_in_name, false);
+        A->out = audio_backend(audio_out_name, true);
+
+        A->inbuf_size_in_bytes = A->in->open_in(A, audio_in_name);
+
+        if (A->inbuf_size_in_bytes <= 0)
+        {
+            return -1;
+        }
+
+        A->outbuf_size_in_bytes = A->out->open_out(A, audio_out_name);
+
+        if (A->outbuf_size_in_bytes <= 0)
+        {
+            return -1;
+        }
+
+        A->inbuf_ptr = (unsigned char *)calloc(A->inbuf_size_in_bytes, sizeof(unsigned char));
+
+        if (A->inbuf_ptr == NULL)
+            return -1;
+
+        /*
+         * Room for the largest period a sound card can be tuned to
+         */
+        int outbuf_alloc = A->outbuf_size_in_bytes;
+
+        if (outbuf_alloc < PERIOD_MAX_FRAMES * A->bytes_per_frame)
+            outbuf_alloc = PERIOD_MAX_FRAMES * A->bytes_per_frame;
+
+        A->outbuf_ptr = (unsigned char *)calloc(outbuf_alloc, sizeof(unsigned char));
+
+        if (A->outbuf_ptr == NULL)
+            return -1;
+
+        A->inbuf_len = 0;
+        A->outbuf_len = 0;
+        A->inbuf_next = 0;
+
+        A->start_time = dtime_now();
+
+        audio_wait(P);
+
+        return 0;
+    }
+
+    return -1;
+}
+
+/*
+ * Called by demod
+ */
+int audio_get(struct port_s *P)
+{
+    struct adev_s *A = P->adev;
+
+    return A->in->get(A);
+}
+
+/*
+ * Called by modulate
+ */
+void audio_put(struct port_s *P, unsigned char c)
+{
+    struct adev_s *A = P->adev;
+
+    A->out->put(A, c);
+}
+
+/*
+ * Called externally by tx.c
+ * but also internally
+ */
+void audio_flush(struct port_s *P)
+{
+    struct adev_s *A = P->adev;
+
+    if (A->out->flush != NULL)
+    {
+        A->out->flush(A);
+    }
+}
+
+void audio_wait(struct port_s *P)
+{
+    struct adev_s *A = P->adev;
+
+    audio_flush(P);
+
+    if (A->out->wait != NULL)
+    {
+        A->out->wait(A);
+    }
+}
+
+void audio_close(struct port_s *P)
+{
+    struct adev_s *A = P->adev;
+
+    if (A != NULL && A->inbuf_ptr != NULL && A->outbuf_ptr != NULL)
+    {
+        audio_wait(P);
+
+        if (A->in->close_in != NULL)
+        {
+            A->in->close_in(A);
+        }
+
+        if (A->out->close_out != NULL)
+        {
+            A->out->close_out(A);
+        }
 
-        free(adev.inbuf_ptr);
-        free(adev.outbuf_ptr);
+        free(A->inbuf_ptr);
+        free(A->outbuf_ptr);
 
-        adev.inbuf_size_in_bytes = 0;
-        adev.inbuf_ptr = NULL;
-        adev.inbuf_len = 0;
-        adev.inbuf_next = 0;
+        A->inbuf_size_in_bytes = 0;
+        A->inbuf_ptr = NULL;
+        A->inbuf_len = 0;
+        A->inbuf_next = 0;
 
-        adev.outbuf_size_in_bytes = 0;
-        adev.outbuf_ptr = NULL;
-        adev.outbuf_len = 0;
+        A->outbuf_size_in_bytes = 0;
+        A->outbuf_ptr = NULL;
+        A->outbuf_len = 0;
     }
 }
@@ -31,7 +31,11 @@ extern "C"
 
 #define ICTYPE_TXINH 0 // Transmit Inhibit
 #define MAX_GPIO_NAME_LEN 20
-#define ONE_BUF_TIME 10
+
+/*
+ * Radios in one process, PORT in the config file
+ */
+#define MAX_PORTS 4
 
     struct ictrl_s
     {
@@ -56,6 +60,15 @@ extern "C"
         int txdelay;
         int txtail;
         bool fulldup;
+        bool aggregate;
+        bool dqpsk; // frames sent and received as DQPSK
+        int eq_taps; // receive equalizer, 0 is off
+        bool adaptive; // payload modulation chosen per peer
+        bool interleave; // payload blocks interleaved against bursts
+        bool fast; // read input files as fast as possible
+        bool mmap; // sound card buffers mapped rather than read and written
+        int period; // sound card period in ms, AUDIO_PERIOD_AUTO to tune it
+        int cpu;    // for the port's capture, rx and tx threads, -1 for any
         struct octrl_s octrl[NUM_OCTYPES];
         struct ictrl_s ictrl[NUM_ICTYPES];
         char adevice_in[80];
@@ -68,16 +81,29 @@ extern "C"
 #define DEFAULT_DWAIT 0
 #define DEFAULT_SLOTTIME 10
 #define DEFAULT_PERSIST 63
-#define DEFAULT_TXDELAY 10
+#define DEFAULT_TXDELAY 3
 #define DEFAULT_TXTAIL 10
 #define DEFAULT_FULLDUP 0
+#define DEFAULT_AGGREGATE 0
+#define DEFAULT_DQPSK 0
+#define DEFAULT_EQ_TAPS 0
+#define DEFAULT_ADAPTIVE 0
+#define DEFAULT_INTERLEAVE 0
+#define DEFAULT_MMAP 1
+#define DEFAULT_PERIOD AUDIO_PERIOD_AUTO
+#define DEFAULT_CPU -1
+
+#define AUDIO_PERIOD_AUTO 0
+
+    struct port_s;
+    struct adev_s; // the open device, private to audio.c
 
-    int audio_open(struct audio_s *);
-    int audio_get(void);
-    void audio_put(unsigned char);
-    void audio_flush(void);
-    void audio_wait(void);
-    void audio_close(void);
+    int audio_open(struct port_s *);
+    int audio_get(struct port_s *);
+    void audio_put(struct port_s *, unsigned char);
+    void audio_flush(struct port_s *);
+    void audio_wait(struct port_s *);
+    void audio_close(struct port_s *);
 
 #ifdef __cplusplus
 }
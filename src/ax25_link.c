@@ -23,6 +23,9 @@
 #include "dlq.h"
 #include "tq.h"
 #include "ptt.h"
+#include "tx.h"
+#include "metrics.h"
+#include "port.h"
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
@@ -50,6 +53,7 @@ typedef struct ax25_dlsm_s
 
     int stream_id;
     int client;
+    struct port_s *port; // radio the link is on
     char addrs[AX25_ADDRS][AX25_MAX_ADDR_LEN];
 
 #define OWNCALL AX25_SOURCE
@@ -70,13 +74,27 @@ typedef struct ax25_dlsm_s
     int own_receiver_busy;
     int acknowledge_pending;
     float srt;
+    float rttvar;
+    int rtt_valid;
     float t1v;
+    float peer_airtime;
+    float rx_airtime;
 
 #define INIT_T1V_SRT                 \
     S->t1v = g_misc_config_p->frack; \
-    S->srt = S->t1v / 2.0;
+    S->srt = S->t1v / 2.0;           \
+    S->rttvar = S->srt / 2.0;        \
+    S->rtt_valid = 0;                \
+    S->peer_airtime = tx_airtime(S->port, 0);
+
+/*
+ * RFC 6298 clock granularity and upper T1 limit, seconds
+ */
+#define T1V_CLOCK_G 0.1
+#define T1V_MAX 30.0
 
     int radio_channel_busy;
+    double t1_start;
     double t1_exp;
     double t1_paused_at;
     float t1_remaining_when_last_stopped;
@@ -86,6 +104,10 @@ typedef struct ax25_dlsm_s
 #define T3_DEFAULT 300.0
 
     int count_recv_frame_type[frame_not_AX25 + 1];
+    int count_i_frames_sent;
+    int count_i_frames_resent;
+    int count_t1_expiries;
+    struct link_metrics_s *metrics;
     int peak_rc_value;
     cdata_t *i_frame_queue;
     cdata_t *txdata_by_ns[128];
@@ -113,8 +135,15 @@ typedef struct reg_callsign_s
 } reg_callsign_t;
 
 static reg_callsign_t *reg_callsign_list = NULL;
-static int dcd_status;
-static int ptt_status;
+static const dl_client_t *client_p = NULL;
+
+/*
+ * Radio state of each port, indexed by port number
+ */
+static int dcd_status[MAX_PORTS];
+static int ptt_status[MAX_PORTS];
+static int ptt_paused_burst[MAX_PORTS];
+static int tx_burst_active[MAX_PORTS];
 
 #define SET_VS(n)    \
     {                \
@@ -152,6 +181,8 @@ static int ptt_status;
 #define STOP_T3 stop_t3(S)
 
 static void dl_data_indication(ax25_dlsm_t *, int, char *, int);
+static void link_established(ax25_dlsm_t *);
+static void link_terminated(ax25_dlsm_t *);
 static void i_frame(ax25_dlsm_t *S, cmdres_t, int, int, int, int, char *, int);
 static void i_frame_continued(ax25_dlsm_t *, int, int, int, char *, int);
 static int is_ns_in_window(ax25_dlsm_t *, int);
@@ -244,7 +275,9 @@ static void i_frame_pop_off_queue(ax25_dlsm_t *S)
 
             packet_t pp = ax25_i_frame(S->addrs, cr, nr, ns, p, txdata->pid, (unsigned char *)(txdata->data), txdata->len);
 
-            lm_data_request(TQ_PRIO_1_LO, pp);
+            lm_data_request(S->port, TQ_PRIO_1_LO, pp);
+            S->count_i_frames_sent++;
+            metrics_link_add(S->metrics, LINK_METRIC_I_FRAMES_SENT, 1);
 
             // Stash in sent array in case it gets lost and needs to be sent again.
 
@@ -284,7 +317,10 @@ static void discard_i_queue(ax25_dlsm_t *S)
 
 static int next_stream_id = 0;
 
-static ax25_dlsm_t *get_link_handle(char addrs[AX25_ADDRS][AX25_MAX_ADDR_LEN], int client, int create)
+/*
+ * The same pair of calls on another port is another link
+ */
+static ax25_dlsm_t *get_link_handle(struct port_s *port, char addrs[][AX25_MAX_ADDR_LEN], int client, int create)
 {
     ax25_dlsm_t *p;
 
@@ -295,7 +331,8 @@ static ax25_dlsm_t *get_link_handle(char addrs[AX25_ADDRS][AX25_MAX_ADDR_LEN], i
         // address order is reversed for compare.
         for (p = list_head; p != NULL; p = p->next)
         {
-            if (strcmp(addrs[AX25_DESTINATION], p->addrs[OWNCALL]) == 0 &&
+            if (p->port == port &&
+                strcmp(addrs[AX25_DESTINATION], p->addrs[OWNCALL]) == 0 &&
                 strcmp(addrs[AX25_SOURCE], p->addrs[PEERCALL]) == 0)
             {
 
@@ -307,7 +344,7 @@ static ax25_dlsm_t *get_link_handle(char addrs[AX25_ADDRS][AX25_MAX_ADDR_LEN], i
     {
         for (p = list_head; p != NULL; p = p->next)
         {
-            if (p->client == client &&
+            if (p->client == client && p->port == port &&
                 strcmp(addrs[AX25_SOURCE], p->addrs[OWNCALL]) == 0 &&
                 strcmp(addrs[AX25_DESTINATION], p->addrs[PEERCALL]) == 0)
             {
@@ -362,6 +399,7 @@ static ax25_dlsm_t *get_link_handle(char addrs[AX25_ADDRS][AX25_MAX_ADDR_LEN], i
     p->magic1 = MAGIC1;
     p->start_time = dtime_now();
     p->stream_id = next_stream_id++;
+    p->port = port;
 
     // If it came in over the radio, we need to swap source/destination
 
@@ -380,6 +418,7 @@ static ax25_dlsm_t *get_link_handle(char addrs[AX25_ADDRS][AX25_MAX_ADDR_LEN], i
 
     p->state = state_0_disconnected;
     p->t1_remaining_when_last_stopped = -999; // Invalid, don't use.
+    p->metrics = metrics_link(p->addrs[OWNCALL], p->addrs[PEERCALL]);
 
     p->magic2 = MAGIC2;
     p->magic3 = MAGIC3;
@@ -391,6 +430,196 @@ static ax25_dlsm_t *get_link_handle(char addrs[AX25_ADDRS][AX25_MAX_ADDR_LEN], i
     return p;
 }
 
+void ax25_link_set_client(const dl_client_t *client)
+{
+    client_p = client;
+}
+
+static void link_established(ax25_dlsm_t *S)
+{
+    if (client_p != NULL && client_p->link_established != NULL)
+    {
+        client_p->link_established(S->client, S->addrs[PEERCALL]);
+    }
+}
+
+static void link_terminated(ax25_dlsm_t *S)
+{
+    if (client_p != NULL && client_p->link_terminated != NULL)
+    {
+        client_p->link_terminated(S->client, S->addrs[PEERCALL]);
+    }
+}
+
+/*
+ * Called from rx upon DLQ_REGISTER_CALLSIGN
+ */
+void dl_register_callsign(dlq_item_t *E)
+{
+    reg_callsign_t *r = calloc(1, sizeof(reg_callsign_t));
+
+    if (r == NULL)
+    {
+        fprintf(stderr, "FATAL ERROR: Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    strlcpy(r->callsign, E->addrs[AX25_SOURCE], sizeof(r->callsign));
+    r->client = E->client;
+    r->next = reg_callsign_list;
+    reg_callsign_list = r;
+}
+
+/*
+ * Called from rx upon DLQ_CONNECT_REQUEST
+ */
+void dl_connect_request(dlq_item_t *E)
+{
+    ax25_dlsm_t *S = get_link_handle(E->port, E->addrs, E->client, 1);
+
+    switch (S->state)
+    {
+    case state_0_disconnected:
+        set_version_2_0(S);
+        INIT_T1V_SRT;
+
+        establish_data_link(S);
+        S->layer_3_initiated = 1;
+        enter_new_state(S, state_1_awaiting_connection);
+        break;
+
+    case state_1_awaiting_connection:
+        discard_i_queue(S);
+        S->layer_3_initiated = 1;
+        // Keep current state.
+        break;
+
+    case state_2_awaiting_release:
+        // Ignore it until the release is over.
+        break;
+
+    case state_3_connected:
+    case state_4_timer_recovery:
+        discard_i_queue(S);
+        establish_data_link(S);
+        S->layer_3_initiated = 1;
+        enter_new_state(S, state_1_awaiting_connection);
+        break;
+    }
+}
+
+/*
+ * Called from rx upon DLQ_DISCONNECT_REQUEST
+ */
+void dl_disconnect_request(dlq_item_t *E)
+{
+    ax25_dlsm_t *S = get_link_handle(E->port, E->addrs, E->client, 0);
+
+    if (S == NULL)
+    {
+        return;
+    }
+
+    switch (S->state)
+    {
+    case state_0_disconnected:
+    case state_2_awaiting_release:
+        break;
+
+    case state_1_awaiting_connection:
+        discard_i_queue(S);
+        STOP_T1;
+        enter_new_state(S, state_0_disconnected);
+        link_terminated(S);
+        break;
+
+    case state_3_connected:
+    case state_4_timer_recovery:
+    {
+        discard_i_queue(S);
+
+        S->rc = 0;
+
+        packet_t pp = ax25_u_frame(S->addrs, cr_cmd, frame_type_U_DISC, 1, 0, NULL, 0);
+        lm_data_request(S->port, TQ_PRIO_1_LO, pp);
+
+        STOP_T3;
+        START_T1;
+        enter_new_state(S, state_2_awaiting_release);
+    }
+    break;
+    }
+}
+
+/*
+ * Called from rx upon DLQ_XMIT_DATA_REQUEST
+ *
+ * The data is queued until the link is connected and there is
+ * room in the window.  No segmenter, so it must fit in PACLEN.
+ */
+void dl_data_request(dlq_item_t *E)
+{
+    ax25_dlsm_t *S = get_link_handle(E->port, E->addrs, E->client, 1);
+
+    if (E->txdata->len > g_misc_config_p->paclen)
+    {
+        fprintf(stderr, "Stream %d: Data length %d is more than PACLEN %d\n",
+                S->stream_id, E->txdata->len, g_misc_config_p->paclen);
+        return;
+    }
+
+    cdata_t **pnext = &S->i_frame_queue;
+
+    while (*pnext != NULL)
+    {
+        pnext = &(*pnext)->next;
+    }
+
+    *pnext = E->txdata;
+    E->txdata = NULL; // the link owns it now
+
+    if ((S->state == state_3_connected || S->state == state_4_timer_recovery) &&
+        (!S->peer_receiver_busy) && WITHIN_WINDOW_SIZE(S))
+    {
+        lm_seize_request(S->port);
+    }
+}
+
+/*
+ * Called from rx upon DLQ_LINK_STATS_REQUEST
+ */
+void dl_link_stats_request(dlq_item_t *E)
+{
+    struct dl_link_stats_s stats;
+
+    if (client_p == NULL || client_p->link_stats == NULL)
+    {
+        return;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+
+    ax25_dlsm_t *S = get_link_handle(E->port, E->addrs, E->client, 0);
+
+    if (S != NULL)
+    {
+        stats.connected = (S->state == state_3_connected || S->state == state_4_timer_recovery);
+        stats.outstanding = AX25MODULO(S->vs - S->va);
+
+        for (cdata_t *t = S->i_frame_queue; t != NULL; t = t->next)
+        {
+            stats.outstanding++;
+        }
+
+        stats.i_frames_sent = S->count_i_frames_sent;
+        stats.i_frames_resent = S->count_i_frames_resent;
+        stats.t1_expiries = S->count_t1_expiries;
+        stats.t1v = S->t1v;
+    }
+
+    client_p->link_stats(E->client, E->addrs[PEERCALL], &stats);
+}
+
 static void dl_data_indication(ax25_dlsm_t *S, int pid, char *data, int len)
 {
     if (S->ra_buff == NULL)
@@ -398,6 +627,10 @@ static void dl_data_indication(ax25_dlsm_t *S, int pid, char *data, int len)
         // Ready state.
         if (pid != AX25_PID_SEGMENTATION_FRAGMENT)
         {
+            if (client_p != NULL && client_p->rec_conn_data != NULL)
+            {
+                client_p->rec_conn_data(S->client, S->addrs[PEERCALL], pid, data, len);
+            }
             return;
         }
         else if (data[0] & 0x80)
@@ -459,6 +692,11 @@ static void dl_data_indication(ax25_dlsm_t *S, int pid, char *data, int len)
             if (S->ra_following == 0)
             {
                 // Last one.
+                if (client_p != NULL && client_p->rec_conn_data != NULL)
+                {
+                    client_p->rec_conn_data(S->client, S->addrs[PEERCALL], S->ra_buff->pid, S->ra_buff->data, S->ra_buff->len);
+                }
+
                 cdata_delete(S->ra_buff);
                 S->ra_buff = NULL;
             }
@@ -468,21 +706,28 @@ static void dl_data_indication(ax25_dlsm_t *S, int pid, char *data, int len)
 
 void lm_channel_busy(dlq_item_t *E)
 {
+    int n = E->port->number;
+
     switch (E->activity)
     {
     case OCTYPE_DCD:
-        dcd_status = E->status;
+        dcd_status[n] = E->status;
         break;
 
     case OCTYPE_PTT:
-        ptt_status = E->status;
+        ptt_status[n] = E->status;
+
+        if (ptt_status[n])
+        {
+            ptt_paused_burst[n] = 1;
+        }
         break;
 
     default:
         break;
     }
 
-    int busy = dcd_status | ptt_status;
+    int busy = dcd_status[n] | ptt_status[n];
 
     /*
      * We know if the given radio channel is busy or not.
@@ -493,6 +738,9 @@ void lm_channel_busy(dlq_item_t *E)
 
     for (S = list_head; S != NULL; S = S->next)
     {
+        if (S->port != E->port)
+            continue;
+
         if (busy && !S->radio_channel_busy)
         {
             S->radio_channel_busy = 1;
@@ -510,8 +758,17 @@ void lm_seize_confirm(dlq_item_t *E)
 {
     ax25_dlsm_t *S;
 
+    /*
+     * The transmitter is keyed.  Hold off T1 expiry until
+     * lm_tx_airtime() tells us how long we were on the air.
+     */
+    tx_burst_active[E->port->number] = 1;
+
     for (S = list_head; S != NULL; S = S->next)
     {
+        if (S->port != E->port)
+            continue;
+
         switch (S->state)
         {
         case state_0_disconnected:
@@ -537,6 +794,43 @@ void lm_seize_confirm(dlq_item_t *E)
     }
 }
 
+/*
+ * Called from rx upon DLQ_TX_AIRTIME
+ *
+ * Our own transmission can take several seconds at 2400 bit/s,
+ * and no acknowledgement can arrive while it is on the air.
+ * Push out any running T1 by the part of the burst it overlapped.
+ */
+void lm_tx_airtime(dlq_item_t *E)
+{
+    double now = dtime_now();
+    ax25_dlsm_t *S;
+
+    tx_burst_active[E->port->number] = 0;
+
+    /*
+     * If the PTT was reported, T1 was already paused for the burst.
+     */
+    if (ptt_paused_burst[E->port->number])
+    {
+        ptt_paused_burst[E->port->number] = 0;
+        return;
+    }
+
+    for (S = list_head; S != NULL; S = S->next)
+    {
+        if (S->port == E->port && S->t1_exp != 0.0 && S->t1_paused_at == 0.0)
+        {
+            double credit = MIN(E->airtime, now - S->t1_start);
+
+            if (credit > 0.0)
+            {
+                S->t1_exp += credit;
+            }
+        }
+    }
+}
+
 /*
  * Called from rx upon DLQ_REC_FRAME
  */
@@ -557,6 +851,8 @@ void lm_data_indication(dlq_item_t *E)
         return;
     }
 
+    E->pp->trace[TRACE_RX_LINK] = dtime_now();
+
     // Copy addresses from frame into event structure.
 
     for (n = 0; n < 2; n++)
@@ -566,7 +862,7 @@ void lm_data_indication(dlq_item_t *E)
 
     ftype = ax25_frame_type(E->pp, &cr, &pf, &nr, &ns);
 
-    S = get_link_handle(E->addrs, client_not_applicable,
+    S = get_link_handle(E->port, E->addrs, client_not_applicable,
                         (ftype == frame_type_U_SABM) | (ftype == frame_type_U_SABME));
 
     if (S == NULL)
@@ -587,6 +883,16 @@ void lm_data_indication(dlq_item_t *E)
         S->count_recv_frame_type[ftype]++;
     }
 
+    /*
+     * Air time of the peer burst that carried this frame.  It is part of
+     * any round trip it acknowledges, and our guess for the next response.
+     */
+    {
+        unsigned char *info_ptr;
+
+        S->rx_airtime = tx_airtime(S->port, ax25_get_info(E->pp, &info_ptr));
+    }
+
     switch (ftype)
     {
     case frame_type_I:
@@ -710,8 +1016,10 @@ void lm_data_indication(dlq_item_t *E)
     {
 
         // S->acknowledge_pending = 1;
-        lm_seize_request();
+        lm_seize_request(S->port);
     }
+
+    S->peer_airtime = 7. / 8. * S->peer_airtime + 1. / 8. * S->rx_airtime;
 }
 
 static void i_frame(ax25_dlsm_t *S, cmdres_t cr, int p, int nr, int ns, int pid, char *info_ptr, int info_len)
@@ -729,7 +1037,7 @@ static void i_frame(ax25_dlsm_t *S, cmdres_t cr, int p, int nr, int ns, int pid,
             int nopid = 0; // PID applies only for I and UI frames.
 
             packet_t pp = ax25_u_frame(S->addrs, r, frame_type_U_DM, f, nopid, NULL, 0);
-            lm_data_request(TQ_PRIO_1_LO, pp);
+            lm_data_request(S->port, TQ_PRIO_1_LO, pp);
         }
         break;
 
@@ -748,7 +1056,7 @@ static void i_frame(ax25_dlsm_t *S, cmdres_t cr, int p, int nr, int ns, int pid,
             int nopid = 0; // PID applies only for I and UI frames.
 
             packet_t pp = ax25_u_frame(S->addrs, r, frame_type_U_DM, f, nopid, NULL, 0);
-            lm_data_request(TQ_PRIO_1_LO, pp);
+            lm_data_request(S->port, TQ_PRIO_1_LO, pp);
         }
         break;
 
@@ -782,7 +1090,7 @@ static void i_frame(ax25_dlsm_t *S, cmdres_t cr, int p, int nr, int ns, int pid,
 
                         pp = ax25_s_frame(S->addrs, cr, frame_type_S_RNR, nr, f, NULL, 0);
 
-                        lm_data_request(TQ_PRIO_1_LO, pp);
+                        lm_data_request(S->port, TQ_PRIO_1_LO, pp);
 
                         S->acknowledge_pending = 0;
                     }
@@ -846,7 +1154,7 @@ static void i_frame_continued(ax25_dlsm_t *S, int p, int ns, int pid, char *info
             packet_t pp;
 
             pp = ax25_s_frame(S->addrs, cr, frame_type_S_RR, nr, f, NULL, 0);
-            lm_data_request(TQ_PRIO_1_LO, pp);
+            lm_data_request(S->port, TQ_PRIO_1_LO, pp);
             S->acknowledge_pending = 0;
         }
         else if (!S->acknowledge_pending)
@@ -854,7 +1162,7 @@ static void i_frame_continued(ax25_dlsm_t *S, int p, int ns, int pid, char *info
 
             S->acknowledge_pending = 1;
 
-            lm_seize_request();
+            lm_seize_request(S->port);
         }
     }
     else if (S->reject_exception)
@@ -867,7 +1175,7 @@ static void i_frame_continued(ax25_dlsm_t *S, int p, int ns, int pid, char *info
             packet_t pp;
 
             pp = ax25_s_frame(S->addrs, cr, frame_type_S_RR, nr, f, NULL, 0);
-            lm_data_request(TQ_PRIO_1_LO, pp);
+            lm_data_request(S->port, TQ_PRIO_1_LO, pp);
             S->acknowledge_pending = 0;
         }
     }
@@ -898,7 +1206,7 @@ static void i_frame_continued(ax25_dlsm_t *S, int p, int ns, int pid, char *info
                 packet_t pp;
 
                 pp = ax25_s_frame(S->addrs, cr, frame_type_S_RNR, nr, f, NULL, 0);
-                lm_data_request(TQ_PRIO_1_LO, pp);
+                lm_data_request(S->port, TQ_PRIO_1_LO, pp);
             }
             else if (S->rxdata_by_ns[AX25MODULO(ns - 1)] == NULL)
             {
@@ -1006,7 +1314,7 @@ static void send_srej_frames(ax25_dlsm_t *S, int *resend, int count, int allow_f
 
         packet_t pp = ax25_s_frame(S->addrs, cr_res, frame_type_S_SREJ, nr, f, NULL, 0);// SREJ is always response. (p.s. cr_res is an enum)
         
-        lm_data_request(TQ_PRIO_1_LO, pp);
+        lm_data_request(S->port, TQ_PRIO_1_LO, pp);
     }
 }
 
@@ -1023,7 +1331,7 @@ static void rr_rnr_frame(ax25_dlsm_t *S, int ready, cmdres_t cr, int pf, int nr)
             int f = pf;
             int nopid = 0; // PID only for I and UI frames.
             packet_t pp = ax25_u_frame(S->addrs, r, frame_type_U_DM, f, nopid, NULL, 0);
-            lm_data_request(TQ_PRIO_1_LO, pp);
+            lm_data_request(S->port, TQ_PRIO_1_LO, pp);
         }
         break;
 
@@ -1043,7 +1351,7 @@ static void rr_rnr_frame(ax25_dlsm_t *S, int ready, cmdres_t cr, int pf, int nr)
             int nopid = 0; // PID applies only for I and UI frames.
 
             packet_t pp = ax25_u_frame(S->addrs, r, frame_type_U_DM, f, nopid, NULL, 0);
-            lm_data_request(TQ_PRIO_1_LO, pp);
+            lm_data_request(S->port, TQ_PRIO_1_LO, pp);
         }
 
         break;
@@ -1158,7 +1466,7 @@ static void rej_frame(ax25_dlsm_t *S, cmdres_t cr, int pf, int nr)
             int nopid = 0; // PID is only for I and UI.
 
             packet_t pp = ax25_u_frame(S->addrs, r, frame_type_U_DM, f, nopid, NULL, 0);
-            lm_data_request(TQ_PRIO_1_LO, pp);
+            lm_data_request(S->port, TQ_PRIO_1_LO, pp);
         }
         break;
 
@@ -1175,7 +1483,7 @@ static void rej_frame(ax25_dlsm_t *S, cmdres_t cr, int pf, int nr)
             int nopid = 0;
 
             packet_t pp = ax25_u_frame(S->addrs, r, frame_type_U_DM, f, nopid, NULL, 0);
-            lm_data_request(TQ_PRIO_1_LO, pp);
+            lm_data_request(S->port, TQ_PRIO_1_LO, pp);
         }
         break;
 
@@ -1368,7 +1676,7 @@ static int resend_for_srej(ax25_dlsm_t *S, int nr, unsigned char *info, int info
     {
         packet_t pp = ax25_i_frame(S->addrs, cr, i_frame_nr, i_frame_ns, p, txdata->pid, (unsigned char *)(txdata->data), txdata->len);
 
-        lm_data_request(TQ_PRIO_1_LO, pp);
+        lm_data_request(S->port, TQ_PRIO_1_LO, pp);
         num_resent++;
     }
     else
@@ -1387,7 +1695,7 @@ static int resend_for_srej(ax25_dlsm_t *S, int nr, unsigned char *info, int info
         if (txdata != NULL)
         {
             packet_t pp = ax25_i_frame(S->addrs, cr, i_frame_nr, i_frame_ns, p, txdata->pid, (unsigned char *)(txdata->data), txdata->len);
-            lm_data_request(TQ_PRIO_1_LO, pp);
+            lm_data_request(S->port, TQ_PRIO_1_LO, pp);
             num_resent++;
         }
         else
@@ -1396,6 +1704,9 @@ static int resend_for_srej(ax25_dlsm_t *S, int nr, unsigned char *info, int info
         }
     }
 
+    S->count_i_frames_resent += num_resent;
+    metrics_link_add(S->metrics, LINK_METRIC_I_FRAMES_RESENT, num_resent);
+
     return num_resent;
 }
 
@@ -1418,7 +1729,7 @@ static void sabm_frame(ax25_dlsm_t *S, int p)
         nopid = 0; // PID is only for I and UI.
 
         pp = ax25_u_frame(S->addrs, res, frame_type_U_UA, f, nopid, NULL, 0);
-        lm_data_request(TQ_PRIO_1_LO, pp);
+        lm_data_request(S->port, TQ_PRIO_1_LO, pp);
 
         clear_exception_conditions(S);
 
@@ -1427,6 +1738,7 @@ static void sabm_frame(ax25_dlsm_t *S, int p)
         SET_VR(0);
 
         fprintf(stderr, "Stream %d: Connected to %s (v2.0)\n", S->stream_id, S->addrs[PEERCALL]);
+        link_established(S);
 
         INIT_T1V_SRT;
         START_T3;
@@ -1443,7 +1755,7 @@ static void sabm_frame(ax25_dlsm_t *S, int p)
         nopid = 0;
 
         pp = ax25_u_frame(S->addrs, res, frame_type_U_UA, f, nopid, NULL, 0);
-        lm_data_request(TQ_PRIO_1_LO, pp); // stay in state 1.
+        lm_data_request(S->port, TQ_PRIO_1_LO, pp); // stay in state 1.
         break;
 
     case state_2_awaiting_release:
@@ -1452,7 +1764,7 @@ static void sabm_frame(ax25_dlsm_t *S, int p)
         nopid = 0;
 
         pp = ax25_u_frame(S->addrs, res, frame_type_U_DM, f, nopid, NULL, 0);
-        lm_data_request(TQ_PRIO_0_HI, pp); // expedited stay in state 2.
+        lm_data_request(S->port, TQ_PRIO_0_HI, pp); // expedited stay in state 2.
         break;
 
     case state_3_connected:
@@ -1462,7 +1774,7 @@ static void sabm_frame(ax25_dlsm_t *S, int p)
         nopid = 0;
 
         pp = ax25_u_frame(S->addrs, res, frame_type_U_UA, f, nopid, NULL, 0);
-        lm_data_request(TQ_PRIO_1_LO, pp);
+        lm_data_request(S->port, TQ_PRIO_1_LO, pp);
 
         if (S->state == state_4_timer_recovery)
         {
@@ -1500,7 +1812,7 @@ static void disc_frame(ax25_dlsm_t *S, int p)
         int nopid = 0;
 
         packet_t pp = ax25_u_frame(S->addrs, res, frame_type_U_DM, f, nopid, NULL, 0);
-        lm_data_request(TQ_PRIO_1_LO, pp);
+        lm_data_request(S->port, TQ_PRIO_1_LO, pp);
     }
     // keep current state, 0, 1, or 5.
     break;
@@ -1513,7 +1825,7 @@ static void disc_frame(ax25_dlsm_t *S, int p)
         int nopid = 0;
 
         packet_t pp = ax25_u_frame(S->addrs, res, frame_type_U_UA, f, nopid, NULL, 0);
-        lm_data_request(TQ_PRIO_0_HI, pp); // expedited
+        lm_data_request(S->port, TQ_PRIO_0_HI, pp); // expedited
     }
     // keep current state, 2.
     break;
@@ -1529,9 +1841,10 @@ static void disc_frame(ax25_dlsm_t *S, int p)
         int nopid = 0;
 
         packet_t pp = ax25_u_frame(S->addrs, res, frame_type_U_UA, f, nopid, NULL, 0);
-        lm_data_request(TQ_PRIO_1_LO, pp);
+        lm_data_request(S->port, TQ_PRIO_1_LO, pp);
 
         fprintf(stderr, "Stream %d: Disconnected from %s.\n", S->stream_id, S->addrs[PEERCALL]);
+        link_terminated(S);
 
         STOP_T1;
         STOP_T3;
@@ -1556,6 +1869,7 @@ static void dm_frame(ax25_dlsm_t *S, int f)
         {
             discard_i_queue(S);
             fprintf(stderr, "Stream %d: Disconnected from %s.\n", S->stream_id, S->addrs[PEERCALL]);
+            link_terminated(S);
             STOP_T1;
             enter_new_state(S, state_0_disconnected);
         }
@@ -1566,6 +1880,7 @@ static void dm_frame(ax25_dlsm_t *S, int f)
         if (f == 1)
         {
             fprintf(stderr, "Stream %d: Disconnected from %s.\n", S->stream_id, S->addrs[PEERCALL]);
+            link_terminated(S);
             STOP_T1;
             enter_new_state(S, state_0_disconnected);
         }
@@ -1574,6 +1889,7 @@ static void dm_frame(ax25_dlsm_t *S, int f)
     case state_3_connected:
     case state_4_timer_recovery:
         fprintf(stderr, "Stream %d: Disconnected from %s.\n", S->stream_id, S->addrs[PEERCALL]);
+        link_terminated(S);
         discard_i_queue(S);
         STOP_T1;
         STOP_T3;
@@ -1616,6 +1932,7 @@ static void ua_frame(ax25_dlsm_t *S, int f)
             select_t1_value(S);
             S->rc = 0;
             enter_new_state(S, state_3_connected);
+            link_established(S);
         }
         break;
 
@@ -1623,6 +1940,7 @@ static void ua_frame(ax25_dlsm_t *S, int f)
         if (f == 1)
         {
             fprintf(stderr, "Stream %d: Disconnected from %s.\n", S->stream_id, S->addrs[PEERCALL]);
+            link_terminated(S);
             STOP_T1;
             enter_new_state(S, state_0_disconnected);
         }
@@ -1678,7 +1996,7 @@ static void ui_frame(ax25_dlsm_t *S, cmdres_t cr, int pf)
             int nopid = 0;       // PID applies only for I and UI frames.
 
             packet_t pp = ax25_u_frame(S->addrs, r, frame_type_U_DM, pf, nopid, NULL, 0);
-            lm_data_request(TQ_PRIO_1_LO, pp);
+            lm_data_request(S->port, TQ_PRIO_1_LO, pp);
         }
         break;
 
@@ -1698,11 +2016,16 @@ void dl_timer_expiry()
 
     for (p = list_head; p != NULL; p = p->next)
     {
+        if (tx_burst_active[p->port->number])
+            continue;
+
         if (p->t1_exp != 0 && p->t1_paused_at == 0 && p->t1_exp <= now)
         {
             p->t1_exp = 0;
             p->t1_paused_at = 0;
             p->t1_had_expired = 1;
+            p->count_t1_expiries++;
+            metrics_link_add(p->metrics, LINK_METRIC_T1_EXPIRIES, 1);
             t1_expiry(p);
         }
     }
@@ -1735,6 +2058,7 @@ static void t1_expiry(ax25_dlsm_t *S)
             discard_i_queue(S);
 
             fprintf(stderr, "Failed to connect to %s after %d tries.\n", S->addrs[PEERCALL], S->n2_retry);
+            link_terminated(S);
             enter_new_state(S, state_0_disconnected);
         }
         else
@@ -1751,7 +2075,7 @@ static void t1_expiry(ax25_dlsm_t *S)
                 S->peak_rc_value = S->rc; // Keep statistics.
 
             pp = ax25_u_frame(S->addrs, cmd, frame_type_U_SABM, p, nopid, NULL, 0);
-            lm_data_request(TQ_PRIO_1_LO, pp);
+            lm_data_request(S->port, TQ_PRIO_1_LO, pp);
             select_t1_value(S);
             START_T1;
             // Keep same state.
@@ -1763,6 +2087,7 @@ static void t1_expiry(ax25_dlsm_t *S)
         if (S->rc == S->n2_retry)
         {
             fprintf(stderr, "Stream %d: Disconnected from %s.\n", S->stream_id, S->addrs[PEERCALL]);
+            link_terminated(S);
             enter_new_state(S, state_0_disconnected);
         }
         else
@@ -1779,7 +2104,7 @@ static void t1_expiry(ax25_dlsm_t *S)
                 S->peak_rc_value = S->rc;
 
             pp = ax25_u_frame(S->addrs, cmd, frame_type_U_DISC, p, nopid, NULL, 0);
-            lm_data_request(TQ_PRIO_1_LO, pp);
+            lm_data_request(S->port, TQ_PRIO_1_LO, pp);
             select_t1_value(S);
             START_T1;
             // stay in same state
@@ -1798,6 +2123,7 @@ static void t1_expiry(ax25_dlsm_t *S)
         if (S->rc == S->n2_retry)
         {
             fprintf(stderr, "Stream %d: Disconnected from %s due to timeouts.\n", S->stream_id, S->addrs[PEERCALL]);
+            link_terminated(S);
 
             discard_i_queue(S);
 
@@ -1806,7 +2132,7 @@ static void t1_expiry(ax25_dlsm_t *S)
             int nopid = 0;
 
             packet_t pp = ax25_u_frame(S->addrs, cr, frame_type_U_DM, f, nopid, NULL, 0);
-            lm_data_request(TQ_PRIO_1_LO, pp);
+            lm_data_request(S->port, TQ_PRIO_1_LO, pp);
 
             enter_new_state(S, state_0_disconnected);
         }
@@ -1861,7 +2187,7 @@ static void establish_data_link(ax25_dlsm_t *S)
 
     S->rc = 1;
     pp = ax25_u_frame(S->addrs, cmd, frame_type_U_SABM, p, nopid, NULL, 0);
-    lm_data_request(TQ_PRIO_1_LO, pp);
+    lm_data_request(S->port, TQ_PRIO_1_LO, pp);
     STOP_T3;
     START_T1;
 }
@@ -1891,7 +2217,7 @@ static void transmit_enquiry(ax25_dlsm_t *S)
 
     packet_t pp = ax25_s_frame(S->addrs, cmd, S->own_receiver_busy ? frame_type_S_RNR : frame_type_S_RR, nr, p, NULL, 0);
 
-    lm_data_request(TQ_PRIO_1_LO, pp);
+    lm_data_request(S->port, TQ_PRIO_1_LO, pp);
 
     S->acknowledge_pending = 0;
     START_T1;
@@ -1912,14 +2238,14 @@ static void enquiry_response(ax25_dlsm_t *S, ax25_frame_type_t frame_type, int f
             // I'm busy.
 
             pp = ax25_s_frame(S->addrs, cr, frame_type_S_RNR, nr, f, NULL, 0);
-            lm_data_request(TQ_PRIO_1_LO, pp);
+            lm_data_request(S->port, TQ_PRIO_1_LO, pp);
 
             S->acknowledge_pending = 0; // because we sent N(R) from V(R).
         }
         else
         {
             pp = ax25_s_frame(S->addrs, cr, frame_type_S_RR, nr, f, NULL, 0);
-            lm_data_request(TQ_PRIO_1_LO, pp);
+            lm_data_request(S->port, TQ_PRIO_1_LO, pp);
 
             S->acknowledge_pending = 0;
         }
@@ -1930,7 +2256,7 @@ static void enquiry_response(ax25_dlsm_t *S, ax25_frame_type_t frame_type, int f
         // For cases other than (RR, RNR, I) command, P=1.
 
         pp = ax25_s_frame(S->addrs, cr, S->own_receiver_busy ? frame_type_S_RNR : frame_type_S_RR, nr, f, NULL, 0);
-        lm_data_request(TQ_PRIO_1_LO, pp);
+        lm_data_request(S->port, TQ_PRIO_1_LO, pp);
 
         S->acknowledge_pending = 0;
     }
@@ -1963,10 +2289,12 @@ static void invoke_retransmission(ax25_dlsm_t *S, int nr_input)
             packet_t pp = ax25_i_frame(S->addrs, cr, nr, ns, p,
                                        S->txdata_by_ns[ns]->pid, (unsigned char *)(S->txdata_by_ns[ns]->data), S->txdata_by_ns[ns]->len);
 
-            lm_data_request(TQ_PRIO_1_LO, pp);
+            lm_data_request(S->port, TQ_PRIO_1_LO, pp);
             // Keep it around in case we need to send again.
 
             sent_count++;
+            S->count_i_frames_resent++;
+            metrics_link_add(S->metrics, LINK_METRIC_I_FRAMES_RESENT, 1);
         }
         else
         {
@@ -2026,26 +2354,58 @@ static void select_t1_value(ax25_dlsm_t *S)
 
         if (S->t1_remaining_when_last_stopped >= 0)
         { // Negative means invalid, don't use it.
-            S->srt = 7. / 8. * S->srt + 1. / 8. * (S->t1v - S->t1_remaining_when_last_stopped);
+
+            /*
+             * Round trip sample, less the air time of the peer burst
+             * carrying the acknowledgement.  Our own air time was
+             * already taken off the T1 clock by lm_tx_airtime().
+             */
+            float r = S->t1v - S->t1_remaining_when_last_stopped - S->rx_airtime;
+
+            if (r < 0)
+            {
+                r = 0;
+            }
+
+            // RFC 6298 estimator
+
+            if (S->rtt_valid == 0)
+            {
+                S->srt = r;
+                S->rttvar = r / 2.;
+                S->rtt_valid = 1;
+            }
+            else
+            {
+                S->rttvar = 3. / 4. * S->rttvar + 1. / 4. * fabsf(S->srt - r);
+                S->srt = 7. / 8. * S->srt + 1. / 8. * r;
+            }
         }
 
-        if (S->srt < 1)
+        // Allow for the expected peer response air time on top.
+
+        S->t1v = S->srt + MAX(T1V_CLOCK_G, 4. * S->rttvar) + S->peer_airtime;
+
+        if (S->t1v < AX25_T1V_FRACK_MIN)
         {
-            S->srt = 1;
+            S->t1v = AX25_T1V_FRACK_MIN;
+        }
+        else if (S->t1v > T1V_MAX)
+        {
+            S->t1v = T1V_MAX;
         }
-
-        S->t1v = S->srt * 2;
     }
     else
     {
 
         if (S->t1_had_expired)
         {
-            S->t1v = S->rc * 0.25 + S->srt * 2;
+            // Back off the timer
+            S->t1v = MIN(S->t1v * 2, T1V_MAX);
         }
     }
 
-    if (S->t1v < 0.99 || S->t1v > 30)
+    if (S->t1v < 0.99 || S->t1v > T1V_MAX)
     {
         fprintf(stderr, "INTERNAL ERROR?  Stream %d: select_t1_value, rc = %d, t1 remaining = %.3f, old srt = %.3f, new srt = %.3f, Extreme new t1v = %.3f\n",
                 S->stream_id, S->rc, S->t1_remaining_when_last_stopped, old_srt, S->srt, S->t1v);
@@ -2083,13 +2443,13 @@ static void enter_new_state(ax25_dlsm_t *S, enum dlsm_state_e new_state)
         S->state != state_3_connected && S->state != state_4_timer_recovery)
     {
 
-        ptt_set(OCTYPE_CON, 1); // Turn on connected indicator if configured.
+        ptt_set(S->port, OCTYPE_CON, 1); // Turn on connected indicator if configured.
     }
     else if ((new_state != state_3_connected && new_state != state_4_timer_recovery) &&
              (S->state == state_3_connected || S->state == state_4_timer_recovery))
     {
 
-        ptt_set(OCTYPE_CON, 0);
+        ptt_set(S->port, OCTYPE_CON, 0);
     }
 
     S->state = new_state;
@@ -2099,6 +2459,7 @@ static void start_t1(ax25_dlsm_t *S)
 {
     double now = dtime_now();
 
+    S->t1_start = now;
     S->t1_exp = now + S->t1v;
 
     if (S->radio_channel_busy)
@@ -2194,9 +2555,9 @@ double ax25_link_get_next_timer_expiry()
     for (p = list_head; p != NULL; p = p->next)
     {
 
-        // Consider if running and not paused.
+        // Consider if running and not paused, and we are not on the air.
 
-        if (p->t1_exp != 0.0 && p->t1_paused_at == 0.0)
+        if (p->t1_exp != 0.0 && p->t1_paused_at == 0.0 && tx_burst_active[p->port->number] == 0)
         {
             if (tnext == 0.0)
             {
@@ -36,12 +36,44 @@ extern "C"
 #define AX25_K_MAXFRAME_DEFAULT 4
 #define AX25_K_MAXFRAME_MAX 7
 
+    /*
+     * Link counters for a connected mode client
+     */
+    struct dl_link_stats_s
+    {
+        int connected;
+        int outstanding;      // queued plus sent but not acknowledged
+        int i_frames_sent;
+        int i_frames_resent;
+        int t1_expiries;
+        float t1v;
+    };
+
+    /*
+     * A connected mode client is told about its links with these.
+     * Any can be NULL.  They are called from the rx_process() thread.
+     */
+    typedef struct dl_client_s
+    {
+        void (*link_established)(int client, char *peer);
+        void (*link_terminated)(int client, char *peer);
+        void (*rec_conn_data)(int client, char *peer, int pid, char *data, int len);
+        void (*link_stats)(int client, char *peer, struct dl_link_stats_s *stats);
+    } dl_client_t;
+
     double dtime_now(void);
+    void ax25_link_set_client(const dl_client_t *);
+    void dl_register_callsign(dlq_item_t *);
+    void dl_connect_request(dlq_item_t *);
+    void dl_disconnect_request(dlq_item_t *);
+    void dl_data_request(dlq_item_t *);
+    void dl_link_stats_request(dlq_item_t *);
     double ax25_link_get_next_timer_expiry(void);
     void ax25_link_init(struct misc_config_s *);
     void lm_data_indication(dlq_item_t *);
     void lm_seize_confirm(dlq_item_t *);
     void lm_channel_busy(dlq_item_t *);
+    void lm_tx_airtime(dlq_item_t *);
     void dl_timer_expiry(void);
 
 #ifdef __cplusplus
@@ -82,6 +82,26 @@ packet_t ax25_from_frame(unsigned char *fbuf, int flen)
     return this_p;
 }
 
+/*
+ * For a frame that was written directly into
+ * the buffer from ax25_get_frame_data_ptr()
+ *
+ * Returns 1 if the length is acceptable, else 0.
+ */
+int ax25_set_frame_len(packet_t this_p, int flen)
+{
+    if (flen < AX25_MIN_PACKET_LEN || flen > AX25_MAX_PACKET_LEN)
+    {
+        fprintf(stderr, "Frame length %d not in allowable range of %d to %d.\n", flen, AX25_MIN_PACKET_LEN, AX25_MAX_PACKET_LEN);
+        return 0;
+    }
+
+    this_p->frame_data[flen] = 0;
+    this_p->frame_len = flen;
+
+    return 1;
+}
+
 static const char *position_name[1 + AX25_ADDRS] = {"Destination", "Source"};
 
 int ax25_parse_addr(int position, char *in_addr, char *out_addr, int *out_ssid)
@@ -328,8 +348,8 @@ ax25_frame_type_t ax25_frame_type(packet_t this_p, cmdres_t *cr, int *pf, int *n
         return frame_not_AX25;
     }
 
-    int dst_c = this_p->frame_data[AX25_DESTINATION];
-    int src_c = this_p->frame_data[AX25_SOURCE];
+    int dst_c = this_p->frame_data[AX25_DESTINATION * 7 + 6] & SSID_H_MASK;
+    int src_c = this_p->frame_data[AX25_SOURCE * 7 + 6] & SSID_H_MASK;
 
     if (dst_c)
     {
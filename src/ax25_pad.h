@@ -16,6 +16,8 @@ extern "C"
 {
 #endif
 
+#include "metrics.h" // TRACE_COUNT
+
 #define AX25_DESTINATION 0
 #define AX25_SOURCE 1
 #define AX25_ADDRS 2
@@ -32,6 +34,9 @@ extern "C"
 #define AX25_PID_SEGMENTATION_FRAGMENT 0x08
 #define AX25_PID_ESCAPE_CHARACTER 0xff
 
+#define SSID_H_MASK 0x80
+#define SSID_H_SHIFT 7
+
 #define SSID_RR_MASK 0x60
 #define SSID_RR_SHIFT 5
 
@@ -47,6 +52,7 @@ extern "C"
         int frame_len;
         int modulo;
         double release_time;
+        double trace[TRACE_COUNT]; // dtime_now() at each point, 0 if not reached
         unsigned char frame_data[AX25_MAX_PACKET_LEN + 1];
     } *packet_t;
 
@@ -80,6 +86,7 @@ extern "C"
 
     packet_t ax25_new(void);
     packet_t ax25_from_frame(unsigned char *, int);
+    int ax25_set_frame_len(packet_t, int);
     void ax25_delete(packet_t);
     int ax25_parse_addr(int, char *, char *, int *);
     void ax25_get_addr_with_ssid(packet_t, int, char *);
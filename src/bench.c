@@ -0,0 +1,527 @@
+/*
+ * bench.c
+ *
+ * IP Node Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Micro-benchmarks of the DSP and FEC kernels.
+ *
+ * make bench
+ *
+ * Usage: bench [-t seconds] [name ...]
+ *
+ * Each benchmark is run until it takes -t seconds, default 0.2,
+ * five times over, and the fastest run is reported.  Names select
+ * the benchmarks that start with them.  One line per benchmark:
+ *
+ *    name ns_per_op mb_per_s ops
+ *
+ * The bytes behind MB/s are the input of one op: complex float
+ * samples for the DSP kernels, and data bytes for the codecs.
+ * It is - where there is no input to speak of.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <complex.h>
+#include <bsd/bsd.h>
+
+#include "ipnode.h"
+#include "audio.h"
+#include "ax25_pad.h"
+#include "ax25_link.h"
+#include "constellation.h"
+#include "costas_loop.h"
+#include "demod.h"
+#include "dlq.h"
+#include "equalizer.h"
+#include "fec.h"
+#include "fft.h"
+#include "il2p.h"
+#include "kiss_frame.h"
+#include "port.h"
+#include "rrc_fir.h"
+#include "timing_error_detector.h"
+
+#define RUNS 5
+
+bool node_shutdown;
+
+static double min_seconds = 0.2;
+static char **names;
+static int name_count;
+
+/*
+ * Results go here so the compiler can't drop the work
+ */
+static volatile int sink;
+
+static struct port_s *port;
+
+/*
+ * The modulator and demodulator want an audio device
+ */
+void audio_put(struct port_s *P, unsigned char c)
+{
+}
+
+void audio_flush(struct port_s *P)
+{
+}
+
+void audio_wait(struct port_s *P)
+{
+}
+
+int audio_get(struct port_s *P)
+{
+    return -1;
+}
+
+double dtime_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return ((double)(ts.tv_sec) + (double)(ts.tv_nsec) * 0.000000001);
+}
+
+void app_process_rec_packet(struct port_s *P, packet_t pp)
+{
+}
+
+static double monotonic()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((double)(ts.tv_sec) + (double)(ts.tv_nsec) * 0.000000001);
+}
+
+static bool selected(const char *name)
+{
+    if (name_count == 0)
+    {
+        return true;
+    }
+
+    for (int i = 0; i < name_count; i++)
+    {
+        if (strncmp(name, names[i], strlen(names[i])) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * fn does its op n times
+ */
+static void run(const char *name, int bytes, void (*fn)(long n))
+{
+    double best = 0.0;
+    long n = 1;
+
+    if (selected(name) == false)
+    {
+        return;
+    }
+
+    /*
+     * Find an op count that takes long enough to time
+     */
+    while (1)
+    {
+        double start = monotonic();
+
+        fn(n);
+
+        double elapsed = monotonic() - start;
+
+        if (elapsed >= min_seconds)
+        {
+            break;
+        }
+
+        n = (elapsed > min_seconds / 100.0) ? (long)(n * min_seconds * 1.1 / elapsed) : n * 10;
+    }
+
+    for (int r = 0; r < RUNS; r++)
+    {
+        double start = monotonic();
+
+        fn(n);
+
+        double elapsed = monotonic() - start;
+
+        if (r == 0 || elapsed < best)
+        {
+            best = elapsed;
+        }
+    }
+
+    double ns = best * 1.0e9 / n;
+
+    if (bytes > 0)
+    {
+        printf("%s %.1f %.2f %ld\n", name, ns, (bytes / ns) * 1.0e3, n);
+    }
+    else
+    {
+        printf("%s %.1f - %ld\n", name, ns, n);
+    }
+
+    fflush(stdout);
+}
+
+/*
+ * DSP
+ */
+
+static complex float samples[4096];
+static complex float spectrum[4096];
+static complex float rrc_memory[NTAPS];
+static fft_cfg fft_plan;
+static int fft_size;
+
+static void fill_samples(unsigned int seed)
+{
+    for (int i = 0; i < 4096; i++)
+    {
+        samples[i] = CMPLXF((float)rand_r(&seed) / RAND_MAX - 0.5f, (float)rand_r(&seed) / RAND_MAX - 0.5f);
+    }
+}
+
+static void bench_rrc_fir(long n)
+{
+    complex float block[CYCLES];
+
+    for (long i = 0; i < n; i++)
+    {
+        memcpy(block, &samples[(i * CYCLES) & 4095], sizeof(block));
+        rrc_fir(rrc_memory, block, CYCLES);
+    }
+
+    sink = (int)crealf(rrc_memory[0]);
+}
+
+static void bench_process_symbols(long n)
+{
+    complex float block[CYCLES];
+
+    for (long i = 0; i < n; i++)
+    {
+        memcpy(block, &samples[(i * CYCLES) & 4095], sizeof(block));
+        processSymbols(port, block);
+    }
+}
+
+static void bench_advance_loop(long n)
+{
+    struct costas_s *C = &port->demod.costas;
+
+    for (long i = 0; i < n; i++)
+    {
+        advance_loop(C, phase_detector(samples[i & 4095]));
+        phase_wrap(C);
+        frequency_limit(C);
+    }
+
+    sink = (int)get_phase(C);
+}
+
+static void bench_ted_input(long n)
+{
+    struct ted_s *T = &port->demod.ted;
+
+    for (long i = 0; i < n; i++)
+    {
+        ted_input(T, &samples[i & 4095]);
+    }
+
+    sink = (int)get_error(T);
+}
+
+/*
+ * One symbol: two inputs, the output and the update
+ */
+static void bench_equalizer(long n)
+{
+    struct eq_s *E = &port->demod.eq;
+
+    for (long i = 0; i < n; i++)
+    {
+        equalizer_input(E, samples[(i * 2) & 4095]);
+        equalizer_input(E, samples[((i * 2) + 1) & 4095]);
+
+        complex float y = equalizer_output(E);
+
+        equalizer_update(E, CMPLXF(copysignf(M_SQRT1_2, crealf(y)), copysignf(M_SQRT1_2, cimagf(y))));
+    }
+
+    sink = (int)crealf(equalizer_output(E));
+}
+
+static void bench_fft(long n)
+{
+    for (long i = 0; i < n; i++)
+    {
+        fft(fft_plan, samples, spectrum);
+    }
+
+    sink = (int)crealf(spectrum[1]);
+}
+
+/*
+ * FEC
+ */
+
+static unsigned char block_in[IL2P_MAX_PACKET_SIZE];
+static unsigned char block_out[IL2P_MAX_PACKET_SIZE];
+static unsigned char rs_block[FEC_BLOCK_SIZE];
+static int rs_errors;
+static packet_t frame;
+static int frame_info_len;
+
+static void bench_scramble(long n)
+{
+    for (long i = 0; i < n; i++)
+    {
+        il2p_scramble_block(block_in, block_out, IL2P_MAX_PAYLOAD_SIZE);
+    }
+
+    sink = block_out[0];
+}
+
+static void bench_descramble(long n)
+{
+    for (long i = 0; i < n; i++)
+    {
+        il2p_descramble_block(block_in, block_out, IL2P_MAX_PAYLOAD_SIZE);
+    }
+
+    sink = block_out[0];
+}
+
+static void bench_encode_rs(long n)
+{
+    struct rs *rs = il2p_find_rs(16);
+
+    for (long i = 0; i < n; i++)
+    {
+        encode_rs_char(rs, block_in, FEC_BLOCK_SIZE - 16, block_out);
+    }
+
+    sink = block_out[0];
+}
+
+/*
+ * The copy of the block is part of the op, so the
+ * decoder sees the same errors every time
+ */
+static void bench_decode_rs(long n)
+{
+    struct rs *rs = il2p_find_rs(16);
+    unsigned char data[FEC_BLOCK_SIZE];
+    int derrlocs[FEC_MAX_CHECK];
+
+    for (long i = 0; i < n; i++)
+    {
+        memcpy(data, rs_block, FEC_BLOCK_SIZE);
+        sink = decode_rs_char(rs, data, derrlocs, 0);
+    }
+}
+
+static void bench_encode_frame(long n)
+{
+    for (long i = 0; i < n; i++)
+    {
+        sink = il2p_encode_frame(frame, 0, block_out, NULL);
+    }
+}
+
+static void bench_decode_frame(long n)
+{
+    for (long i = 0; i < n; i++)
+    {
+        packet_t pp = il2p_decode_frame(block_in);
+
+        if (pp != NULL)
+        {
+            ax25_delete(pp);
+        }
+    }
+}
+
+static void bench_kiss_encapsulate(long n)
+{
+    for (long i = 0; i < n; i++)
+    {
+        sink = kiss_encapsulate(block_in, AX25_N1_PACLEN_DEFAULT, block_out);
+    }
+}
+
+static void make_rs_block(int errors)
+{
+    struct rs *rs = il2p_find_rs(16);
+    unsigned int seed = 7;
+
+    for (int i = 0; i < FEC_BLOCK_SIZE - 16; i++)
+    {
+        rs_block[i] = rand_r(&seed) & 0xff;
+    }
+
+    encode_rs_char(rs, rs_block, FEC_BLOCK_SIZE - 16, rs_block + FEC_BLOCK_SIZE - 16);
+
+    for (int i = 0; i < errors; i++)
+    {
+        rs_block[(i * 31 + 5) % FEC_BLOCK_SIZE] ^= 0x5a;
+    }
+
+    rs_errors = errors;
+}
+
+static void make_frame(int info_len)
+{
+    char addrs[AX25_ADDRS][AX25_MAX_ADDR_LEN];
+    unsigned char info[IL2P_MAX_PAYLOAD_SIZE];
+    unsigned int seed = 3;
+
+    memset(addrs, 0, sizeof(addrs));
+    strlcpy(addrs[AX25_DESTINATION], "BENCH-1", AX25_MAX_ADDR_LEN);
+    strlcpy(addrs[AX25_SOURCE], "BENCH-2", AX25_MAX_ADDR_LEN);
+
+    for (int i = 0; i < info_len; i++)
+    {
+        info[i] = rand_r(&seed) & 0xff;
+    }
+
+    if (frame != NULL)
+    {
+        ax25_delete(frame);
+    }
+
+    frame = ax25_u_frame(addrs, cr_cmd, frame_type_U_UI, 0, AX25_PID_NO_LAYER_3, info, info_len);
+    frame_info_len = info_len;
+
+    // the decoder input
+    il2p_encode_frame(frame, 0, block_in, NULL);
+}
+
+int main(int argc, char *argv[])
+{
+    struct audio_s audio_config;
+    char name[64];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            min_seconds = atof(optarg);
+            break;
+
+        default:
+            fprintf(stderr, "Usage: %s [-t seconds] [name ...]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    names = argv + optind;
+    name_count = argc - optind;
+
+    memset(&audio_config, 0, sizeof(audio_config));
+
+    createQPSKConstellation();
+    rrc_make(FS, RS, .35f);
+    dlq_init();
+    il2p_init();
+    il2p_adapt_init();
+
+    port = port_new(0, &audio_config);
+    demod_init(port);
+
+    fill_samples(1);
+
+    printf("# name ns_per_op mb_per_s ops\n");
+
+    /*
+     * DSP, per symbol of CYCLES samples where it applies
+     */
+    run("rrc_fir", CYCLES * sizeof(complex float), bench_rrc_fir);
+    run("processSymbols", CYCLES * sizeof(complex float), bench_process_symbols);
+    run("advance_loop", 0, bench_advance_loop);
+    run("ted_input", sizeof(complex float), bench_ted_input);
+
+    create_equalizer(&port->demod.eq, EQ_MAX_TAPS);
+    set_equalizer_cma(&port->demod.eq, false);
+    run("equalizer", 2 * sizeof(complex float), bench_equalizer);
+
+    static const int fft_sizes[] = {64, 256, 1024, 4096};
+
+    for (int i = 0; i < (int)(sizeof(fft_sizes) / sizeof(int)); i++)
+    {
+        fft_size = fft_sizes[i];
+        fft_plan = fft_alloc(fft_size, 0, NULL, NULL);
+
+        snprintf(name, sizeof(name), "fft/%d", fft_size);
+        run(name, fft_size * sizeof(complex float), bench_fft);
+
+        free(fft_plan);
+    }
+
+    /*
+     * FEC and framing
+     */
+    for (int i = 0; i < IL2P_MAX_PACKET_SIZE; i++)
+    {
+        block_in[i] = (i * 37 + 11) & 0xff;
+    }
+
+    run("il2p_scramble_block", IL2P_MAX_PAYLOAD_SIZE, bench_scramble);
+    run("il2p_descramble_block", IL2P_MAX_PAYLOAD_SIZE, bench_descramble);
+    run("encode_rs_char", FEC_BLOCK_SIZE - 16, bench_encode_rs);
+
+    static const int rs_error_counts[] = {0, 4, 8};
+
+    for (int i = 0; i < (int)(sizeof(rs_error_counts) / sizeof(int)); i++)
+    {
+        make_rs_block(rs_error_counts[i]);
+
+        snprintf(name, sizeof(name), "decode_rs_char/%d", rs_errors);
+        run(name, FEC_BLOCK_SIZE - 16, bench_decode_rs);
+    }
+
+    static const int info_lens[] = {0, 64, 256, 512, 1023};
+
+    for (int i = 0; i < (int)(sizeof(info_lens) / sizeof(int)); i++)
+    {
+        make_frame(info_lens[i]);
+
+        snprintf(name, sizeof(name), "il2p_encode_frame/%d", frame_info_len);
+        run(name, frame_info_len, bench_encode_frame);
+
+        snprintf(name, sizeof(name), "il2p_decode_frame/%d", frame_info_len);
+        run(name, frame_info_len, bench_decode_frame);
+    }
+
+    for (int i = 0; i < AX25_N1_PACLEN_DEFAULT; i++)
+    {
+        block_in[i] = i & 0xff; // includes one FEND and one FESC
+    }
+
+    run("kiss_encapsulate", AX25_N1_PACLEN_DEFAULT, bench_kiss_encapsulate);
+
+    return 0;
+}
@@ -0,0 +1,477 @@
+/*
+ * channel-sweep.c
+ *
+ * IP Node Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Sends IL2P frames from the modulator in tx.c through the simulated
+ * channel into the demodulator, over a range of Eb/N0, and prints
+ * BER, FER and goodput as one line per point.
+ *
+ * make channel-sweep
+ *
+ * BER and the header SNR are over the frames whose sync word
+ * was found, FER and goodput over all frames sent.  Eb/N0 is per
+ * bit of the payload modulation, and per QPSK bit with -m auto.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <math.h>
+#include <complex.h>
+#include <sys/time.h>
+#include <bsd/bsd.h>
+
+#include "ipnode.h"
+#include "audio.h"
+#include "ax25_pad.h"
+#include "channel.h"
+#include "constellation.h"
+#include "costas_loop.h"
+#include "demod.h"
+#include "dlq.h"
+#include "il2p.h"
+#include "port.h"
+#include "rrc_fir.h"
+#include "timing_error_detector.h"
+#include "tx.h"
+
+#define GAP_MS 50  // silence between bursts
+
+bool node_shutdown;
+
+static struct audio_s audio_config;
+static struct port_s *port;
+
+/*
+ * Modulator output is captured here, the
+ * demodulator reads the channel output from rx
+ */
+static unsigned char *tx_pcm;
+static int tx_len;
+static int tx_size;
+
+static unsigned char *rx_pcm;
+static int rx_len;
+static int rx_next;
+
+static unsigned char *rx_bits;
+static int rx_bit_count;
+static int rx_bit_size;
+
+void audio_put(struct port_s *P, unsigned char c)
+{
+    if (tx_len == tx_size)
+    {
+        tx_size = (tx_size == 0) ? 65536 : tx_size * 2;
+        tx_pcm = (unsigned char *)realloc(tx_pcm, tx_size);
+    }
+
+    tx_pcm[tx_len++] = c;
+}
+
+void audio_flush(struct port_s *P)
+{
+}
+
+void audio_wait(struct port_s *P)
+{
+}
+
+int audio_get(struct port_s *P)
+{
+    if (rx_next >= rx_len)
+    {
+        return -1;
+    }
+
+    return rx_pcm[rx_next++];
+}
+
+double dtime_now()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+void app_process_rec_packet(struct port_s *P, packet_t pp)
+{
+}
+
+static void bit_tap(int bit)
+{
+    if (rx_bit_count == rx_bit_size)
+    {
+        rx_bit_size = (rx_bit_size == 0) ? 65536 : rx_bit_size * 2;
+        rx_bits = (unsigned char *)realloc(rx_bits, rx_bit_size);
+    }
+
+    rx_bits[rx_bit_count++] = bit;
+}
+
+/*
+ * Run the captured burst through the channel and append
+ * it to the demodulator input, as S16 with clipping
+ */
+static void send_through_channel(struct channel_s *ch)
+{
+    int n = tx_len / 4;
+    complex float *in = (complex float *)malloc(n * sizeof(complex float));
+    complex float *out = (complex float *)malloc((n + n / 1000 + 16) * sizeof(complex float));
+
+    for (int i = 0; i < n; i++)
+    {
+        short pcm_I = tx_pcm[i * 4] | (tx_pcm[i * 4 + 1] << 8);
+        short pcm_Q = tx_pcm[i * 4 + 2] | (tx_pcm[i * 4 + 3] << 8);
+
+        in[i] = CMPLXF((float)pcm_I, (float)pcm_Q) / 32768.0f;
+    }
+
+    if (ch->signal_power == 0.0f)
+    {
+        ch->signal_power = channel_signal_power(in, n);
+    }
+
+    int count = channel_process(ch, in, n, out);
+
+    /*
+     * Keep what the demodulator has not read yet
+     */
+    memmove(rx_pcm, rx_pcm + rx_next, rx_len - rx_next);
+    rx_len -= rx_next;
+    rx_next = 0;
+
+    rx_pcm = (unsigned char *)realloc(rx_pcm, rx_len + count * 4);
+
+    for (int i = 0; i < count; i++)
+    {
+        float re = fmaxf(-1.0f, fminf(crealf(out[i]), 32767.0f / 32768.0f)) * 32768.0f;
+        float im = fmaxf(-1.0f, fminf(cimagf(out[i]), 32767.0f / 32768.0f)) * 32768.0f;
+        short pcm_I = (short)re;
+        short pcm_Q = (short)im;
+
+        rx_pcm[rx_len++] = pcm_I & 0xff;
+        rx_pcm[rx_len++] = (pcm_I >> 8) & 0xff;
+        rx_pcm[rx_len++] = pcm_Q & 0xff;
+        rx_pcm[rx_len++] = (pcm_Q >> 8) & 0xff;
+    }
+
+    free(in);
+    free(out);
+}
+
+/*
+ * Count bit errors against the encoded frame after the
+ * best sync word match.  Returns -1 if no sync was found.
+ */
+static int count_bit_errors(unsigned char *encoded, int elen)
+{
+    unsigned int acc = 0;
+    int nbits = (elen - IL2P_SYNC_WORD_SIZE) * 8;
+
+    for (int i = 0; i + nbits <= rx_bit_count; i++)
+    {
+        acc = ((acc << 1) | rx_bits[i]) & 0x00ffffff;
+
+        if (i >= 23 && __builtin_popcount(acc ^ IL2P_SYNC_WORD) <= 1)
+        {
+            int errors = 0;
+
+            for (int k = 0; k < nbits; k++)
+            {
+                int bit = (encoded[IL2P_SYNC_WORD_SIZE + (k / 8)] >> (7 - (k % 8))) & 1;
+
+                errors += (rx_bits[i + 1 + k] != bit);
+            }
+
+            return errors;
+        }
+    }
+
+    return -1;
+}
+
+static packet_t make_frame(int len, unsigned int *seed)
+{
+    char addrs[AX25_ADDRS][AX25_MAX_ADDR_LEN];
+    unsigned char info[IL2P_MAX_PAYLOAD_SIZE];
+
+    memset(addrs, 0, sizeof(addrs));
+    strlcpy(addrs[AX25_DESTINATION], "TEST-1", AX25_MAX_ADDR_LEN);
+    strlcpy(addrs[AX25_SOURCE], "SWEEP-2", AX25_MAX_ADDR_LEN);
+
+    for (int i = 0; i < len; i++)
+    {
+        info[i] = rand_r(seed) & 0xff;
+    }
+
+    return ax25_u_frame(addrs, cr_cmd, frame_type_U_UI, 0, 0xf0, info, len);
+}
+
+static void usage(char *name)
+{
+    fprintf(stderr, "Usage: %s [options]\n", name);
+    fprintf(stderr, "  -n frames     Frames per point, default 100\n");
+    fprintf(stderr, "  -l bytes      Information length, default 128\n");
+    fprintf(stderr, "  -a dB -b dB   First and last Eb/N0, default 0 and 12\n");
+    fprintf(stderr, "  -s dB         Eb/N0 step, default 1\n");
+    fprintf(stderr, "  -o Hz         Carrier offset\n");
+    fprintf(stderr, "  -P degrees    Carrier phase\n");
+    fprintf(stderr, "  -p ppm        Receiver sample clock error\n");
+    fprintf(stderr, "  -d ms         Second path delay, max %d\n", CHANNEL_MAX_DELAY_MS);
+    fprintf(stderr, "  -g dB         Second path level, default 0\n");
+    fprintf(stderr, "  -D Hz         Fading Doppler spread\n");
+    fprintf(stderr, "  -i rate       Impulses per second\n");
+    fprintf(stderr, "  -I dB         Impulse level over the signal, default 20\n");
+    fprintf(stderr, "  -t ms         TXDELAY preamble, default 100\n");
+    fprintf(stderr, "  -q            DQPSK rather than QPSK, payloads too\n");
+    fprintf(stderr, "  -e taps       Receive equalizer, default 0 (off)\n");
+    fprintf(stderr, "  -m mode       Payload bpsk, qpsk, 8psk, or auto from the SNR\n");
+    fprintf(stderr, "  -f parity     RS parity per block, 4, 6, 8 or 16, default 16\n");
+    fprintf(stderr, "  -L            Interleave the payload blocks\n");
+    fprintf(stderr, "  -r seed       Random seed\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    struct channel_s settings;
+    int frames = 100;
+    int len = 128;
+    float first = 0.0f;
+    float last = 12.0f;
+    float step = 1.0f;
+    int txdelay = 10;
+    bool dqpsk = false;
+    int eq_taps = 0;
+    int mode = Mode_QPSK;
+    int parity = IL2P_MAX_PARITY_SYMBOLS;
+    bool adaptive = false;
+    bool interleave = false;
+    unsigned int seed = 1;
+    int opt;
+
+    channel_init(&settings, seed);
+
+    while ((opt = getopt(argc, argv, "n:l:a:b:s:o:P:p:d:g:D:i:I:t:qe:m:f:Lr:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': frames = atoi(optarg); break;
+        case 'l': len = atoi(optarg); break;
+        case 'a': first = atof(optarg); break;
+        case 'b': last = atof(optarg); break;
+        case 's': step = atof(optarg); break;
+        case 'o': settings.offset_hz = atof(optarg); break;
+        case 'P': settings.phase_deg = atof(optarg); break;
+        case 'p': settings.ppm = atof(optarg); break;
+        case 'd': settings.delay_ms = atof(optarg); break;
+        case 'g': settings.path2_db = atof(optarg); break;
+        case 'D': settings.doppler_hz = atof(optarg); break;
+        case 'i': settings.impulse_rate = atof(optarg); break;
+        case 'I': settings.impulse_db = atof(optarg); break;
+        case 't': txdelay = atoi(optarg) / 10; break;
+        case 'q': dqpsk = true; break;
+        case 'e': eq_taps = atoi(optarg); break;
+        case 'm':
+            if (strcasecmp(optarg, "bpsk") == 0)
+                mode = Mode_BPSK;
+            else if (strcasecmp(optarg, "qpsk") == 0)
+                mode = Mode_QPSK;
+            else if (strcasecmp(optarg, "8psk") == 0)
+                mode = Mode_8PSK;
+            else if (strcasecmp(optarg, "auto") == 0)
+                adaptive = true;
+            else
+                usage(argv[0]);
+            break;
+        case 'f':
+            parity = atoi(optarg);
+            if (il2p_parity_ext(parity) == 0 && parity != IL2P_MAX_PARITY_SYMBOLS)
+                usage(argv[0]);
+            break;
+        case 'L': interleave = true; break;
+        case 'r': seed = strtoul(optarg, NULL, 0); break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if (frames < 1 || len < 0 || len > IL2P_MAX_PAYLOAD_SIZE || step <= 0.0f)
+    {
+        usage(argv[0]);
+    }
+
+    /*
+     * A DQPSK port keeps its payloads in DQPSK
+     */
+    if (dqpsk == true && mode != Mode_QPSK)
+    {
+        usage(argv[0]);
+    }
+
+    /*
+     * Eb is per payload bit.  Auto changes the modulation
+     * from frame to frame, so there it is per QPSK bit.
+     */
+    int bits_per_symbol = 2;
+
+    if (adaptive == false && mode == Mode_BPSK)
+        bits_per_symbol = 1;
+    else if (adaptive == false && mode == Mode_8PSK)
+        bits_per_symbol = 3;
+
+    memset(&audio_config, 0, sizeof(audio_config));
+    audio_config.defined = true;
+    audio_config.txdelay = txdelay;
+    audio_config.txtail = 1;
+    audio_config.fulldup = true;
+    audio_config.dqpsk = dqpsk;
+    audio_config.eq_taps = eq_taps;
+    audio_config.adaptive = adaptive;
+
+    createQPSKConstellation();
+    rrc_make(FS, RS, .35f);
+    dlq_init();
+    il2p_init();
+    il2p_adapt_init();
+
+    port = port_new(0, &audio_config);
+    tx_init(port);
+    demod_init(port);
+    demod_set_bit_tap(port, bit_tap);
+
+    /*
+     * The other station reads extensions
+     */
+    il2p_adapt_extends(port, "SWEEP-2");
+
+    printf("# ebn0_db frames frames_ok fer bits bit_errors ber goodput_bps snr_db\n");
+
+    for (float ebn0 = first; ebn0 <= last + 0.001f; ebn0 += step)
+    {
+        struct channel_s ch;
+        unsigned int frame_seed = seed;
+        long bits = 0;
+        long bit_errors = 0;
+        long air_samples = 0;
+        double snr = 0.0;
+        int synced = 0;
+        int ok = 0;
+
+        channel_init(&ch, seed);
+
+        ch.ebn0_db = ebn0;
+        ch.bits_per_symbol = bits_per_symbol;
+        ch.offset_hz = settings.offset_hz;
+        ch.phase_deg = settings.phase_deg;
+        ch.ppm = settings.ppm;
+        ch.delay_ms = settings.delay_ms;
+        ch.path2_db = settings.path2_db;
+        ch.doppler_hz = settings.doppler_hz;
+        ch.impulse_rate = settings.impulse_rate;
+        ch.impulse_db = settings.impulse_db;
+        ch.signal_power = 0.0f; // measured from the first burst
+
+        for (int f = 0; f < frames; f++)
+        {
+            unsigned char encoded[IL2P_MAX_PACKET_SIZE];
+            packet_t pp = make_frame(len, &frame_seed);
+
+            encoded[0] = (IL2P_SYNC_WORD >> 16) & 0xff;
+            encoded[1] = (IL2P_SYNC_WORD >> 8) & 0xff;
+            encoded[2] = (IL2P_SYNC_WORD)&0xff;
+
+            /*
+             * Auto picks the payload modulation as a reply
+             * to the station heard, which is the sender
+             */
+            int ext = (adaptive == true) ? il2p_adapt_ext(port, "SWEEP-2") : (il2p_mode_ext(mode) | il2p_parity_ext(parity));
+
+            if (interleave == true)
+                ext |= IL2P_EXT_INTERLEAVE;
+
+            int elen = il2p_encode_frame(pp, ext, encoded + IL2P_SYNC_WORD_SIZE, &ext);
+
+            if (elen < 0)
+            {
+                fprintf(stderr, "Unable to encode frame into IL2P\n");
+                exit(1);
+            }
+
+            elen += IL2P_SYNC_WORD_SIZE;
+
+            tx_len = 0;
+
+            il2p_send_preamble(port, txdelay);
+            il2p_send_encoded(port, ext, encoded, elen);
+            il2p_send_idle(port, 2);
+
+            air_samples += tx_len / 4;
+
+            for (int i = 0; i < (int)(FS * GAP_MS / 1000) * 4; i++)
+            {
+                audio_put(port, 0);
+            }
+
+            send_through_channel(&ch);
+
+            rx_bit_count = 0;
+
+            while (rx_len - rx_next >= CYCLES * 4)
+            {
+                complex float csamples[CYCLES];
+
+                demod_get_samples(port, csamples);
+                processSymbols(port, csamples);
+            }
+
+            int errors = count_bit_errors(encoded, elen);
+
+            if (errors >= 0)
+            {
+                bits += (elen - IL2P_SYNC_WORD_SIZE) * 8;
+                bit_errors += errors;
+                snr += get_frame_snr(port);
+                synced++;
+            }
+
+            /*
+             * Frames that made it through
+             */
+            struct dlq_item_s *pitem;
+
+            while ((pitem = dlq_remove()) != NULL)
+            {
+                if (pitem->type == DLQ_REC_FRAME &&
+                    ax25_get_frame_len(pitem->pp) == ax25_get_frame_len(pp) &&
+                    memcmp(ax25_get_frame_data_ptr(pitem->pp), ax25_get_frame_data_ptr(pp), ax25_get_frame_len(pp)) == 0)
+                {
+                    ok++;
+                }
+
+                dlq_delete(pitem);
+            }
+
+            ax25_delete(pp);
+        }
+
+        channel_free(&ch);
+
+        double airtime = air_samples / FS;
+
+        printf("%.2f %d %d %.5f %ld %ld %.3e %.1f %.1f\n", ebn0, frames, ok, 1.0 - ((double)ok / frames),
+               bits, bit_errors, (bits > 0) ? (double)bit_errors / bits : 0.5, (ok * len * 8) / airtime,
+               (synced > 0) ? snr / synced : 0.0);
+        fflush(stdout);
+    }
+
+    return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * channel.c
+ *
+ * IP Node Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Simulated radio channel for the 9600 rate I/Q samples
+ * between the modulator and the demodulator.
+ *
+ * The impairments are applied in the order a real signal meets them:
+ * two-path fading, carrier offset, receiver sample clock error,
+ * impulse noise, and then white noise.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+
+#include "ipnode.h"
+#include "channel.h"
+
+/*
+ * Uniform in (0,1]
+ */
+static float uniform(struct channel_s *ch)
+{
+    return ((float)rand_r(&ch->seed) + 1.0f) / ((float)RAND_MAX + 1.0f);
+}
+
+/*
+ * Unit power complex Gaussian, Box-Muller
+ */
+static complex float gaussian(struct channel_s *ch)
+{
+    float r = sqrtf(-logf(uniform(ch)));
+    float a = TAU * uniform(ch);
+
+    return CMPLXF(r * cosf(a), r * sinf(a));
+}
+
+void channel_init(struct channel_s *ch, unsigned int seed)
+{
+    memset(ch, 0, sizeof(struct channel_s));
+
+    ch->seed = seed;
+    ch->ebn0_db = 100.0f;
+    ch->bits_per_symbol = 2;
+    ch->path2_db = 0.0f;
+    ch->impulse_db = 20.0f;
+    ch->signal_power = 1.0f;
+    ch->position = 1.0; // no delay when the clocks agree
+
+    ch->fade[0] = CMPLXF(1.0f, 0.0f);
+    ch->fade[1] = CMPLXF(1.0f, 0.0f);
+
+    ch->history_len = (int)(CHANNEL_MAX_DELAY_MS * FS / 1000.0) + 1;
+    ch->history = (complex float *)calloc(ch->history_len, sizeof(complex float));
+}
+
+void channel_free(struct channel_s *ch)
+{
+    free(ch->history);
+    ch->history = NULL;
+}
+
+float channel_signal_power(complex float *x, int n)
+{
+    double sum = 0.0;
+    int count = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        float p = crealf(x[i]) * crealf(x[i]) + cimagf(x[i]) * cimagf(x[i]);
+
+        if (p > 0.0f)
+        {
+            sum += p;
+            count++;
+        }
+    }
+
+    return (count > 0) ? (float)(sum / count) : 0.0f;
+}
+
+/*
+ * Watterson style fading: each path has a unit power Rayleigh gain.
+ * The gains are first order lowpass filtered Gaussian noise, which
+ * has a Lorentzian rather than Gaussian Doppler spectrum but the
+ * same spread.
+ */
+static complex float multipath(struct channel_s *ch, complex float x)
+{
+    int delay = (int)(ch->delay_ms * FS / 1000.0f + 0.5f);
+
+    if (delay >= ch->history_len)
+    {
+        delay = ch->history_len - 1;
+    }
+
+    ch->history[ch->history_next] = x;
+
+    if (ch->doppler_hz > 0.0f)
+    {
+        float a = expf(-M_PI * ch->doppler_hz / FS);
+        float b = sqrtf(1.0f - a * a);
+
+        ch->fade[0] = a * ch->fade[0] + b * gaussian(ch);
+        ch->fade[1] = a * ch->fade[1] + b * gaussian(ch);
+    }
+
+    complex float y = x * ch->fade[0];
+
+    if (ch->delay_ms > 0.0f)
+    {
+        int i = ch->history_next - delay;
+
+        if (i < 0)
+        {
+            i += ch->history_len;
+        }
+
+        y += ch->history[i] * ch->fade[1] * powf(10.0f, ch->path2_db / 20.0f);
+
+        // keep the total power of the two paths at unity
+        y /= sqrtf(1.0f + powf(10.0f, ch->path2_db / 10.0f));
+    }
+
+    if (++ch->history_next >= ch->history_len)
+    {
+        ch->history_next = 0;
+    }
+
+    return y;
+}
+
+/*
+ * Returns the number of samples put in out, which needs room
+ * for n * (1 + ppm / 1e6) + 2 samples.
+ */
+int channel_process(struct channel_s *ch, complex float *in, int n, complex float *out)
+{
+    double step = 1.0 / (1.0 + ch->ppm * 1.0e-6);
+    double dphase = TAU * ch->offset_hz / FS;
+    double phase0 = TAU * ch->phase_deg / 360.0;
+
+    /*
+     * Noise per sample for the Eb/N0, with b bits per symbol:
+     * Eb = P / (b RS) and N0 = sigma^2 / FS
+     */
+    float ebn0 = powf(10.0f, ch->ebn0_db / 10.0f);
+    float sigma = sqrtf((ch->signal_power * FS) / (ch->bits_per_symbol * RS * ebn0));
+
+    float impulse = sqrtf(ch->signal_power) * powf(10.0f, ch->impulse_db / 20.0f);
+    float impulse_chance = ch->impulse_rate / FS;
+
+    int count = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        complex float x = multipath(ch, in[i]);
+
+        x *= cmplx((float)(ch->phase + phase0));
+
+        ch->phase = fmod(ch->phase + dphase, TAU);
+
+        /*
+         * The receiver clock runs ppm fast, so it takes a sample
+         * every step of the transmitted ones.  Linear interpolation
+         * between the last two input samples.
+         */
+        while (ch->position <= 1.0)
+        {
+            complex float y = ch->last + (x - ch->last) * (float)ch->position;
+
+            if (impulse_chance > 0.0f && ch->impulse_left == 0 && uniform(ch) <= impulse_chance)
+            {
+                ch->impulse_left = 1 + (int)(uniform(ch) * CYCLES); // up to a symbol long
+            }
+
+            if (ch->impulse_left > 0)
+            {
+                y += impulse * gaussian(ch);
+                ch->impulse_left--;
+            }
+
+            out[count++] = y + sigma * gaussian(ch);
+
+            ch->position += step;
+        }
+
+        ch->position -= 1.0;
+        ch->last = x;
+    }
+
+    return count;
+}
@@ -0,0 +1,60 @@
+/*
+ * channel.h
+ *
+ * IP Node Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <complex.h>
+#include <stdbool.h>
+
+/*
+ * Longest second path delay, milliseconds
+ */
+#define CHANNEL_MAX_DELAY_MS 10
+
+    struct channel_s
+    {
+        /* Settings */
+
+        float ebn0_db;      // AWGN, per bit at the symbol rate
+        int bits_per_symbol; // that Eb is per, 2 for QPSK
+        float offset_hz;    // carrier frequency offset
+        float phase_deg;    // carrier phase offset
+        float ppm;          // receiver sample clock error, + is fast
+        float delay_ms;     // second path delay, 0 for a single path
+        float path2_db;     // second path level relative to the first
+        float doppler_hz;   // fading spread, 0 for no fading
+        float impulse_rate; // impulses per second
+        float impulse_db;   // impulse level relative to the signal
+        float signal_power; // mean |x|^2 of the transmitted signal
+
+        /* State */
+
+        unsigned int seed;
+        double phase;       // frequency offset
+        double position;    // resampler
+        complex float last; // previous sample for the resampler
+        complex float fade[2];
+        complex float *history;
+        int history_len;
+        int history_next;
+        int impulse_left;
+    };
+
+    void channel_init(struct channel_s *, unsigned int);
+    void channel_free(struct channel_s *);
+    int channel_process(struct channel_s *, complex float *, int, complex float *);
+    float channel_signal_power(complex float *, int);
+
+#ifdef __cplusplus
+}
+#endif
@@ -16,12 +16,14 @@
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
+#include <sched.h>
 #include <bsd/bsd.h>
 
 #include "ipnode.h"
 #include "ax25_pad.h"
 #include "audio.h"
 #include "config.h"
+#include "equalizer.h"
 #include "tx.h"
 #include "ax25_link.h"
 
@@ -199,12 +201,11 @@ static char *split(char *string)
     return t;
 }
 
-void config_init(char *fname, struct audio_s *p_audio_config, struct misc_config_s *p_misc_config)
+/*
+ * Each port starts out with these
+ */
+static void audio_defaults(struct audio_s *p_audio_config)
 {
-    /*
-     * First apply defaults.
-     */
-
     memset(p_audio_config, 0, sizeof(struct audio_s));
 
     strlcpy(p_audio_config->adevice_in, DEFAULT_ADEVICE, sizeof(p_audio_config->adevice_in));    // see audio.h
@@ -230,8 +231,34 @@ void config_init(char *fname, struct audio_s *p_audio_config, struct misc_config
     p_audio_config->txdelay = DEFAULT_TXDELAY;
     p_audio_config->txtail = DEFAULT_TXTAIL;
     p_audio_config->fulldup = DEFAULT_FULLDUP;
+    p_audio_config->aggregate = DEFAULT_AGGREGATE;
+    p_audio_config->dqpsk = DEFAULT_DQPSK;
+    p_audio_config->eq_taps = DEFAULT_EQ_TAPS;
+    p_audio_config->adaptive = DEFAULT_ADAPTIVE;
+    p_audio_config->interleave = DEFAULT_INTERLEAVE;
+    p_audio_config->mmap = DEFAULT_MMAP;
+    p_audio_config->period = DEFAULT_PERIOD;
+    p_audio_config->cpu = DEFAULT_CPU;
 
     strlcpy(p_audio_config->mycall, "NOCALL", 6);
+}
+
+/*
+ * audio_config has MAX_PORTS entries.  The radio settings
+ * before the first PORT line are for port 0.
+ */
+void config_init(char *fname, struct audio_s audio_config[], struct misc_config_s *p_misc_config)
+{
+    /*
+     * First apply defaults.
+     */
+
+    for (int n = 0; n < MAX_PORTS; n++)
+    {
+        audio_defaults(&audio_config[n]);
+    }
+
+    struct audio_s *p_audio_config = &audio_config[0];
 
     memset(p_misc_config, 0, sizeof(struct misc_config_s));
 
@@ -242,6 +269,8 @@ void config_init(char *fname, struct audio_s *p_audio_config, struct misc_config
     p_misc_config->paclen = AX25_N1_PACLEN_DEFAULT;    /* Max number of bytes in information part of frame. */
     p_misc_config->maxframe = AX25_K_MAXFRAME_DEFAULT; /* Max frames to send before ACK.  mod 8 "Window" size. */
 
+    rt_defaults(&p_misc_config->rt);
+
     char filepath[128];
 
     strlcpy(filepath, fname, sizeof(filepath));
@@ -292,10 +321,33 @@ void config_init(char *fname, struct audio_s *p_audio_config, struct misc_config
         }
 
         /*
-         * ADEVICE
+         * PORT  n		- The radio settings that follow, up to the
+         *			  next PORT, are for KISS port n.
          */
 
-        if (strcasecmp(t, "adevice") == 0)
+        if (strcasecmp(t, "PORT") == 0)
+        {
+            t = split(NULL);
+
+            int n = (t == NULL) ? -1 : atoi(t);
+
+            if (t == NULL || !isdigit(*t) || n >= MAX_PORTS)
+            {
+                printf("Line %d: Expected a port number 0 to %d for PORT.\n", line, MAX_PORTS - 1);
+                continue;
+            }
+
+            p_audio_config = &audio_config[n];
+        }
+
+        /*
+         * ADEVICE  device-name [ output-device-name ]
+         *
+         * Besides ALSA names, these can be a .wav or raw I/Q
+         * file, - for stdin/stdout, or null for no output.
+         */
+
+        else if (strcasecmp(t, "adevice") == 0)
         {
             t = split(NULL);
 
@@ -308,6 +360,13 @@ void config_init(char *fname, struct audio_s *p_audio_config, struct misc_config
             strlcpy(p_audio_config->adevice_in, t, sizeof(p_audio_config->adevice_in));
             strlcpy(p_audio_config->adevice_out, t, sizeof(p_audio_config->adevice_out));
 
+            t = split(NULL);
+
+            if (t != NULL)
+            {
+                strlcpy(p_audio_config->adevice_out, t, sizeof(p_audio_config->adevice_out));
+            }
+
             p_audio_config->defined = true;
         }
 
@@ -633,6 +692,217 @@ void config_init(char *fname, struct audio_s *p_audio_config, struct misc_config
             }
         }
 
+        /*
+         * AGGREGATE  {on|off} 		- Pack short frames into one IL2P burst
+         *				  for peers that also do.
+         */
+        else if (strcasecmp(t, "AGGREGATE") == 0)
+        {
+            t = split(NULL);
+
+            if (t == NULL)
+            {
+                printf("Line %d: Missing parameter for AGGREGATE command.  Expecting ON or OFF.\n", line);
+                continue;
+            }
+
+            if (strcasecmp(t, "ON") == 0)
+            {
+                p_audio_config->aggregate = 1;
+            }
+            else if (strcasecmp(t, "OFF") == 0)
+            {
+                p_audio_config->aggregate = 0;
+            }
+            else
+            {
+                p_audio_config->aggregate = 0;
+
+                printf("Line %d: Expected ON or OFF for AGGREGATE.\n", line);
+            }
+        }
+
+        /*
+         * MODULATION  {QPSK|DQPSK}	- Coherent QPSK, or differential with no
+         *				  need for the carrier phase.  Both ends of
+         *				  the link must agree.
+         */
+        else if (strcasecmp(t, "MODULATION") == 0)
+        {
+            t = split(NULL);
+
+            if (t == NULL)
+            {
+                printf("Line %d: Missing parameter for MODULATION command.  Expecting QPSK or DQPSK.\n", line);
+                continue;
+            }
+
+            if (strcasecmp(t, "QPSK") == 0)
+            {
+                p_audio_config->dqpsk = 0;
+            }
+            else if (strcasecmp(t, "DQPSK") == 0)
+            {
+                p_audio_config->dqpsk = 1;
+            }
+            else
+            {
+                p_audio_config->dqpsk = DEFAULT_DQPSK;
+
+                printf("Line %d: Expected QPSK or DQPSK for MODULATION.\n", line);
+            }
+        }
+
+        /*
+         * EQUALIZER  n		- Receive equalizer taps, half a symbol
+         *				  apart, for multipath.  0 is off.
+         */
+        else if (strcasecmp(t, "EQUALIZER") == 0)
+        {
+            t = split(NULL);
+
+            if (t == NULL)
+            {
+                printf("Line %d: Missing number of taps for EQUALIZER command.\n", line);
+                continue;
+            }
+
+            int n = atoi(t);
+
+            if (n == 0 || (n >= 3 && n <= EQ_MAX_TAPS))
+            {
+                p_audio_config->eq_taps = n;
+            }
+            else
+            {
+                p_audio_config->eq_taps = DEFAULT_EQ_TAPS;
+
+                printf("Line %d: Invalid number of taps for EQUALIZER, expected 0 or 3 to %d.\n", line, EQ_MAX_TAPS);
+            }
+        }
+
+        /*
+         * ADAPTIVE  {on|off}		- Send payloads as BPSK, QPSK or 8PSK,
+         *				  whichever the peer's signal is good for.
+         */
+        else if (strcasecmp(t, "ADAPTIVE") == 0)
+        {
+            t = split(NULL);
+
+            if (t == NULL)
+            {
+                printf("Line %d: Missing parameter for ADAPTIVE command.  Expecting ON or OFF.\n", line);
+                continue;
+            }
+
+            if (strcasecmp(t, "ON") == 0)
+            {
+                p_audio_config->adaptive = 1;
+            }
+            else if (strcasecmp(t, "OFF") == 0)
+            {
+                p_audio_config->adaptive = 0;
+            }
+            else
+            {
+                p_audio_config->adaptive = DEFAULT_ADAPTIVE;
+
+                printf("Line %d: Expected ON or OFF for ADAPTIVE.\n", line);
+            }
+        }
+
+        /*
+         * INTERLEAVE  {on|off}		- Interleave the RS blocks of payloads
+         *				  longer than one block.
+         */
+        else if (strcasecmp(t, "INTERLEAVE") == 0)
+        {
+            t = split(NULL);
+
+            if (t == NULL)
+            {
+                printf("Line %d: Missing parameter for INTERLEAVE command.  Expecting ON or OFF.\n", line);
+                continue;
+            }
+
+            if (strcasecmp(t, "ON") == 0)
+            {
+                p_audio_config->interleave = 1;
+            }
+            else if (strcasecmp(t, "OFF") == 0)
+            {
+                p_audio_config->interleave = 0;
+            }
+            else
+            {
+                p_audio_config->interleave = DEFAULT_INTERLEAVE;
+
+                printf("Line %d: Expected ON or OFF for INTERLEAVE.\n", line);
+            }
+        }
+
+        /*
+         * MMAP  {on|off} 		- Map the sound card buffers rather than
+         *				  reading and writing them.
+         */
+        else if (strcasecmp(t, "MMAP") == 0)
+        {
+            t = split(NULL);
+
+            if (t == NULL)
+            {
+                printf("Line %d: Missing parameter for MMAP command.  Expecting ON or OFF.\n", line);
+                continue;
+            }
+
+            if (strcasecmp(t, "ON") == 0)
+            {
+                p_audio_config->mmap = 1;
+            }
+            else if (strcasecmp(t, "OFF") == 0)
+            {
+                p_audio_config->mmap = 0;
+            }
+            else
+            {
+                p_audio_config->mmap = DEFAULT_MMAP;
+
+                printf("Line %d: Expected ON or OFF for MMAP.\n", line);
+            }
+        }
+
+        /*
+         * PERIOD  {n|auto}		- Sound card period in mS, or tune it
+         *				  from the overruns and wakeup delays.
+         */
+        else if (strcasecmp(t, "PERIOD") == 0)
+        {
+            t = split(NULL);
+
+            if (t == NULL)
+            {
+                printf("Line %d: Missing time for PERIOD command.\n", line);
+                continue;
+            }
+
+            int n = atoi(t);
+
+            if (strcasecmp(t, "AUTO") == 0)
+            {
+                p_audio_config->period = AUDIO_PERIOD_AUTO;
+            }
+            else if (n >= 2 && n <= 200)
+            {
+                p_audio_config->period = n;
+            }
+            else
+            {
+                p_audio_config->period = DEFAULT_PERIOD;
+
+                printf("Line %d: Invalid time for PERIOD, expected 2 to 200 or AUTO. Tuning it instead.\n", line);
+            }
+        }
+
         /*
          * FRACK  n 		- Number of seconds to wait for ack to transmission.
          */
@@ -741,6 +1011,156 @@ void config_init(char *fname, struct audio_s *p_audio_config, struct misc_config
                        line, AX25_K_MAXFRAME_MIN, AX25_K_MAXFRAME_MAX, p_misc_config->maxframe);
             }
         }
+
+        /*
+         * METRICS  socket-path	- Unix domain socket for reading the counters.
+         */
+
+        else if (strcasecmp(t, "METRICS") == 0)
+        {
+            t = split(NULL);
+
+            if (t == NULL)
+            {
+                printf("Line %d: Missing socket name for METRICS.\n", line);
+                continue;
+            }
+
+            strlcpy(p_misc_config->metrics, t, sizeof(p_misc_config->metrics));
+        }
+
+        /*
+         * RTPRIO  thread  {FIFO|RR|OTHER}  [priority]	- Scheduling for the capture, rx, tx,
+         *						  kiss or link thread.
+         */
+
+        else if (strcasecmp(t, "RTPRIO") == 0)
+        {
+            t = split(NULL);
+
+            int thread = (t == NULL) ? -1 : rt_thread_lookup(t);
+
+            if (thread < 0)
+            {
+                printf("Line %d: Expected capture, rx, tx, kiss or link for RTPRIO.\n", line);
+                continue;
+            }
+
+            struct rt_thread_s *th = &p_misc_config->rt.thread[thread];
+
+            t = split(NULL);
+
+            if (t == NULL)
+            {
+                printf("Line %d: Missing policy for RTPRIO.  Expecting FIFO, RR or OTHER.\n", line);
+                continue;
+            }
+
+            if (strcasecmp(t, "FIFO") == 0)
+            {
+                th->policy = SCHED_FIFO;
+            }
+            else if (strcasecmp(t, "RR") == 0)
+            {
+                th->policy = SCHED_RR;
+            }
+            else if (strcasecmp(t, "OTHER") == 0)
+            {
+                th->policy = SCHED_OTHER;
+                th->priority = 0;
+                continue;
+            }
+            else
+            {
+                printf("Line %d: Expected FIFO, RR or OTHER for RTPRIO.\n", line);
+                continue;
+            }
+
+            t = split(NULL);
+
+            int n = (t == NULL) ? 0 : atoi(t);
+
+            if (n >= 1 && n <= 99)
+            {
+                th->priority = n;
+            }
+            else
+            {
+                th->policy = SCHED_OTHER;
+                th->priority = 0;
+
+                printf("Line %d: Invalid RTPRIO priority, expecting 1 to 99.  Not using real time.\n", line);
+            }
+        }
+
+        /*
+         * CPU  thread  n		- Pin the capture, rx, tx, kiss or link
+         *			  thread to one CPU.
+         * CPU  n		- Pin the port's capture, rx and tx
+         *			  threads to one CPU.
+         */
+
+        else if (strcasecmp(t, "CPU") == 0)
+        {
+            t = split(NULL);
+
+            if (t != NULL && isdigit(*t))
+            {
+                p_audio_config->cpu = atoi(t);
+                continue;
+            }
+
+            int thread = (t == NULL) ? -1 : rt_thread_lookup(t);
+
+            if (thread < 0)
+            {
+                printf("Line %d: Expected capture, rx, tx, kiss, link or a number for CPU.\n", line);
+                continue;
+            }
+
+            t = split(NULL);
+
+            int n = (t == NULL) ? -1 : atoi(t);
+
+            if (t != NULL && n >= 0)
+            {
+                p_misc_config->rt.thread[thread].cpu = n;
+            }
+            else
+            {
+                printf("Line %d: Invalid CPU number.\n", line);
+            }
+        }
+
+        /*
+         * MLOCK  {on|off}		- Lock memory and prefault thread stacks.
+         */
+
+        else if (strcasecmp(t, "MLOCK") == 0)
+        {
+            t = split(NULL);
+
+            if (t == NULL)
+            {
+                printf("Line %d: Missing parameter for MLOCK command.  Expecting ON or OFF.\n", line);
+                continue;
+            }
+
+            if (strcasecmp(t, "ON") == 0)
+            {
+                p_misc_config->rt.mlock = true;
+            }
+            else if (strcasecmp(t, "OFF") == 0)
+            {
+                p_misc_config->rt.mlock = false;
+            }
+            else
+            {
+                p_misc_config->rt.mlock = false;
+
+                printf("Line %d: Expected ON or OFF for MLOCK.\n", line);
+            }
+        }
     }
 
     fclose(fp);
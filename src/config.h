@@ -17,6 +17,7 @@ extern "C"
 #endif
 
 #include "audio.h"
+#include "rt.h"
 
     struct misc_config_s
     {
@@ -24,9 +25,11 @@ extern "C"
         int retry;    /* Number of times to retry before giving up. */
         int paclen;   /* Max number of bytes in information part of frame. */
         int maxframe; /* Max frames to send before ACK.  mod 8 "Window" size. */
+        char metrics[108]; /* Unix socket for the counters, none if empty. */
+        struct rt_config_s rt; /* Scheduling, CPU and memory locking. */
     };
 
-    void config_init(char *, struct audio_s *, struct misc_config_s *);
+    void config_init(char *, struct audio_s[], struct misc_config_s *);
 
 #ifdef __cplusplus
 }
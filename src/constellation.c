@@ -13,6 +13,25 @@
 
 static complex float d_qpsk[4];
 
+/*
+ * 8PSK by tribit, Gray-coded around the circle
+ * so the nearest wrong point is one bit off
+ */
+#define R M_SQRT1_2
+
+static const complex float d_8psk[8] = {
+    CMPLXF(1.0f, 0.0f),  // 0 degrees
+    CMPLXF(R, R),        // 45
+    CMPLXF(-R, R),       // 135
+    CMPLXF(0.0f, 1.0f),  // 90
+    CMPLXF(R, -R),       // 315
+    CMPLXF(0.0f, -1.0f), // 270
+    CMPLXF(-1.0f, 0.0f), // 180
+    CMPLXF(-R, -R)       // 225
+};
+
+#undef R
+
 void createQPSKConstellation()
 {
     // Gray-coded
@@ -38,3 +57,18 @@ unsigned char qpskToDiBit(complex float sample)
     // Imag component determines big bit.
     return 2 * (cimagf(sample) > 0.0f) + (crealf(sample) > 0.0f);
 }
+
+complex float get8PSKPoint(unsigned char triBit)
+{
+    return d_8psk[triBit & 0x7];
+}
+
+/*
+ * The sample is in the phase it was sent in
+ */
+unsigned char psk8ToTriBit(complex float sample)
+{
+    int k = (int)lrintf(cargf(sample) / (float)M_PI_4) & 0x7;
+
+    return k ^ (k >> 1); // the point k * 45 degrees round
+}
@@ -19,6 +19,8 @@ void createQPSKConstellation(void);
 complex float *getQPSKConstellation(void);
 complex float getQPSKQuadrant(unsigned char);
 unsigned char qpskToDiBit(complex float);
+complex float get8PSKPoint(unsigned char);
+unsigned char psk8ToTriBit(complex float);
 
 #ifdef __cplusplus
 }
@@ -14,39 +14,31 @@
 #include "costas_loop.h"
 #include "ipnode.h"
 
-static float d_phase;
-static float d_freq;
-
-static float d_max_freq;
-static float d_min_freq;
-
-static float d_damping;
-static float d_loop_bw;
-
-static float d_alpha;
-static float d_beta;
-
-static bool d_enable;
-
 /*
  * A Costas loop carrier recovery algorithm.
  *
  * The Costas loop locks to the center frequency of a signal and
  * downconverts signal to baseband.
  */
-void create_control_loop(float loop_bw, float min_freq, float max_freq) {
-    set_phase(0.0f);
-    set_frequency(0.0f);
+void create_control_loop(struct costas_s *C, float loop_bw, float min_freq, float max_freq) {
+    set_phase(C, 0.0f);
+    set_frequency(C, 0.0f);
 
-    set_max_freq(max_freq);
-    set_min_freq(min_freq);
+    set_max_freq(C, max_freq);
+    set_min_freq(C, min_freq);
 
-    set_damping_factor(sqrtf(2.0f) / 2.0f);
+    set_damping_factor(C, sqrtf(2.0f) / 2.0f);
 
     // Calls update_gains() which sets alpha and beta
-    set_loop_bandwidth(loop_bw);
+    set_loop_bandwidth(C, loop_bw);
+
+    // One bandwidth until set_gear_bandwidths() is called
+    C->d_acquire_bw = loop_bw;
+    C->d_track_bw = loop_bw;
+    C->d_lock_metric = 1.0f - (2.0f / M_PI);
+    C->d_locked = false;
 
-    set_costas_enable(true);
+    set_costas_enable(C, true);
 }
 
 float phase_detector(complex float sample) {
@@ -54,114 +46,152 @@ float phase_detector(complex float sample) {
             (cimagf(sample) > 0.0f ? 1.0f : -1.0f) * crealf(sample));
 }
 
-void update_gains() {
-    float denom = ((1.0f + (2.0f * d_damping * d_loop_bw)) + (d_loop_bw * d_loop_bw));
+void update_gains(struct costas_s *C) {
+    float denom = ((1.0f + (2.0f * C->d_damping * C->d_loop_bw)) + (C->d_loop_bw * C->d_loop_bw));
 
-    d_alpha = (4.0f * d_damping * d_loop_bw) / denom;
-    d_beta = (4.0f * d_loop_bw * d_loop_bw) / denom;
+    C->d_alpha = (4.0f * C->d_damping * C->d_loop_bw) / denom;
+    C->d_beta = (4.0f * C->d_loop_bw * C->d_loop_bw) / denom;
 }
 
-void advance_loop(float error) {
-    d_freq += (d_beta * error);
-    d_phase += (d_freq + d_alpha * error);
+void advance_loop(struct costas_s *C, float error) {
+    C->d_freq += (C->d_beta * error);
+    C->d_phase += (C->d_freq + C->d_alpha * error);
 }
 
-void phase_wrap() {
-    while (d_phase > TAU)
-        d_phase -= TAU;
+void phase_wrap(struct costas_s *C) {
+    while (C->d_phase > TAU)
+        C->d_phase -= TAU;
 
-    while (d_phase < -TAU)
-        d_phase += TAU;
+    while (C->d_phase < -TAU)
+        C->d_phase += TAU;
 }
 
-void frequency_limit() {
-    if (d_freq > d_max_freq)
-        d_freq = d_max_freq;
-    else if (d_freq < d_min_freq)
-        d_freq = d_min_freq;
+void frequency_limit(struct costas_s *C) {
+    if (C->d_freq > C->d_max_freq)
+        C->d_freq = C->d_max_freq;
+    else if (C->d_freq < C->d_min_freq)
+        C->d_freq = C->d_min_freq;
+}
+
+/*
+ * Called with each symbol and its phase detector error.
+ *
+ * A wide loop pulls in quickly but lets noise through to the
+ * phase, a narrow one is quiet but slow.  So the loop runs at
+ * the acquire bandwidth until it is locked, and at the track
+ * bandwidth after that.
+ */
+void lock_detector(struct costas_s *C, complex float sample, float error) {
+    float level = cabsf(sample);
+    float e2 = 1.0f; // worse than no lock
+
+    if (level > LOCK_MIN_LEVEL)
+        e2 = (error * error) / (level * level);
+
+    C->d_lock_metric += LOCK_AVERAGE * (e2 - C->d_lock_metric);
+
+    if (C->d_locked == false && C->d_lock_metric < LOCK_ON) {
+        C->d_locked = true;
+        set_loop_bandwidth(C, C->d_track_bw);
+    } else if (C->d_locked == true && C->d_lock_metric > LOCK_OFF) {
+        C->d_locked = false;
+        set_loop_bandwidth(C, C->d_acquire_bw);
+    }
 }
 
 
 // Setters
 
-void set_loop_bandwidth(float bw)
+void set_loop_bandwidth(struct costas_s *C, float bw)
 {
     if (bw < 0.0f) {
-        d_loop_bw = 0.0f;
+        C->d_loop_bw = 0.0f;
     }
 
-    d_loop_bw = bw;
-    update_gains();
+    C->d_loop_bw = bw;
+    update_gains(C);
 }
 
-void set_damping_factor(float df)
+void set_damping_factor(struct costas_s *C, float df)
 {
     if (df <= 0.0f) {
-        d_damping = 0.0f;
+        C->d_damping = 0.0f;
     }
 
-    d_damping = df;
-    update_gains();
+    C->d_damping = df;
+    update_gains(C);
 }
 
-void set_alpha(float alpha)
+void set_alpha(struct costas_s *C, float alpha)
 {
     if (alpha < 0.0f || alpha > 1.0f) {
-        d_alpha = 0.0f;
+        C->d_alpha = 0.0f;
     }
 
-    d_alpha = alpha;
+    C->d_alpha = alpha;
 }
 
-void set_beta(float beta)
+void set_beta(struct costas_s *C, float beta)
 {
     if (beta < 0.0f || beta > 1.0f) {
-        d_beta = 0.0f;
+        C->d_beta = 0.0f;
     }
 
-    d_beta = beta;
+    C->d_beta = beta;
 }
 
-void set_frequency(float freq)
+void set_frequency(struct costas_s *C, float freq)
 {
-    if (freq > d_max_freq)
-        d_freq = d_max_freq;
-    else if (freq < d_min_freq)
-        d_freq = d_min_freq;
+    if (freq > C->d_max_freq)
+        C->d_freq = C->d_max_freq;
+    else if (freq < C->d_min_freq)
+        C->d_freq = C->d_min_freq;
     else
-        d_freq = freq;
+        C->d_freq = freq;
 }
 
-void set_phase(float phase)
+void set_phase(struct costas_s *C, float phase)
 {
-    d_phase = phase;
+    C->d_phase = phase;
 
-    phase_wrap();
+    phase_wrap(C);
 }
 
-void set_max_freq(float freq) { d_max_freq = freq; }
+void set_max_freq(struct costas_s *C, float freq) { C->d_max_freq = freq; }
+
+void set_min_freq(struct costas_s *C, float freq) { C->d_min_freq = freq; }
 
-void set_min_freq(float freq) { d_min_freq = freq; }
+void set_gear_bandwidths(struct costas_s *C, float acquire_bw, float track_bw)
+{
+    C->d_acquire_bw = acquire_bw;
+    C->d_track_bw = track_bw;
+
+    set_loop_bandwidth(C, (C->d_locked == true) ? track_bw : acquire_bw);
+}
 
-void set_costas_enable(bool val) { d_enable = val; }
+void set_costas_enable(struct costas_s *C, bool val) { C->d_enable = val; }
 
 // Getters
 
-float get_loop_bandwidth() { return d_loop_bw; }
+float get_loop_bandwidth(struct costas_s *C) { return C->d_loop_bw; }
+
+float get_damping_factor(struct costas_s *C) { return C->d_damping; }
+
+float get_alpha(struct costas_s *C) { return C->d_alpha; }
 
-float get_damping_factor() { return d_damping; }
+float get_beta(struct costas_s *C) { return C->d_beta; }
 
-float get_alpha() { return d_alpha; }
+float get_frequency(struct costas_s *C) { return C->d_freq; }
 
-float get_beta() { return d_beta; }
+float get_phase(struct costas_s *C) { return C->d_phase; }
 
-float get_frequency() { return d_freq; }
+float get_max_freq(struct costas_s *C) { return C->d_max_freq; }
 
-float get_phase() { return d_phase; }
+float get_min_freq(struct costas_s *C) { return C->d_min_freq; }
 
-float get_max_freq() { return d_max_freq; }
+float get_lock_metric(struct costas_s *C) { return C->d_lock_metric; }
 
-float get_min_freq() { return d_min_freq; }
+bool get_locked(struct costas_s *C) { return C->d_locked; }
 
-bool get_costas_enable() { return d_enable; }
+bool get_costas_enable(struct costas_s *C) { return C->d_enable; }
 
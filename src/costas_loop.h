@@ -17,38 +17,73 @@ extern "C"
 #include <stdbool.h>
 #include <complex.h>
 
-void create_control_loop(float, float, float);
+/*
+ * Lock detector, on the phase detector error normalized to
+ * the symbol magnitude.  The mean square is 1 - 2/PI (0.36)
+ * with no lock and goes toward 0 with lock.
+ */
+#define LOCK_AVERAGE 0.03f // about 32 symbols
+#define LOCK_ON 0.20f
+#define LOCK_OFF 0.28f
+#define LOCK_MIN_LEVEL 1.0e-4f // no signal counts as no lock
+
+/*
+ * One loop per receiver
+ */
+struct costas_s
+{
+    float d_phase;
+    float d_freq;
+    float d_max_freq;
+    float d_min_freq;
+    float d_damping;
+    float d_loop_bw;
+    float d_alpha;
+    float d_beta;
+    bool d_enable;
+
+    float d_acquire_bw;
+    float d_track_bw;
+    float d_lock_metric;
+    bool d_locked;
+};
+
+void create_control_loop(struct costas_s *, float, float, float);
 float phase_detector(complex float);
-void update_gains(void);
-void advance_loop(float);
-void phase_wrap(void);
-void frequency_limit(void);
+void update_gains(struct costas_s *);
+void advance_loop(struct costas_s *, float);
+void phase_wrap(struct costas_s *);
+void frequency_limit(struct costas_s *);
+void lock_detector(struct costas_s *, complex float, float);
 
 // Setters
 
-void set_loop_bandwidth(float);
-void set_damping_factor(float);
-void set_alpha(float);
-void set_beta(float);
-void set_frequency(float);
-void set_phase(float);
-void set_max_freq(float);
-void set_min_freq(float);
+void set_loop_bandwidth(struct costas_s *, float);
+void set_damping_factor(struct costas_s *, float);
+void set_alpha(struct costas_s *, float);
+void set_beta(struct costas_s *, float);
+void set_frequency(struct costas_s *, float);
+void set_phase(struct costas_s *, float);
+void set_max_freq(struct costas_s *, float);
+void set_min_freq(struct costas_s *, float);
+void set_gear_bandwidths(struct costas_s *, float, float);
 
-void set_costas_enable(bool);
+void set_costas_enable(struct costas_s *, bool);
 
 // Getters
 
-float get_loop_bandwidth(void);
-float get_damping_factor(void);
-float get_alpha(void);
-float get_beta(void);
-float get_frequency(void);
-float get_phase(void);
-float get_max_freq(void);
-float get_min_freq(void);
+float get_loop_bandwidth(struct costas_s *);
+float get_damping_factor(struct costas_s *);
+float get_alpha(struct costas_s *);
+float get_beta(struct costas_s *);
+float get_frequency(struct costas_s *);
+float get_phase(struct costas_s *);
+float get_max_freq(struct costas_s *);
+float get_min_freq(struct costas_s *);
+float get_lock_metric(struct costas_s *);
+bool get_locked(struct costas_s *);
 
-bool get_costas_enable(void);
+bool get_costas_enable(struct costas_s *);
 
 #ifdef __cplusplus
 }
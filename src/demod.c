@@ -32,20 +32,15 @@
 #include "ptt.h"
 #include "constellation.h"
 #include "timing_error_detector.h"
+#include "equalizer.h"
+#include "port.h"
 
-// Globals
-
-static struct audio_s *save_audio_config_p;
-static struct demodulator_state_s demodulator_state;
-
-static complex float rx_filter[NTAPS];
-static complex float m_rxPhase;
-static complex float m_rxRect;
-static complex float recvBlock[8]; // 8 CYCLES per symbol
-
-static float m_offset_freq;
-
-static bool dcdDetect;
+/*
+ * The Costas loop leaves the symbols on the diagonals, where
+ * qpskToDiBit() gives back the dibit of each getQPSKQuadrant()
+ * point once it is turned by this much
+ */
+#define SLICE_ROTATE (3.0f * M_PI / 4.0f)
 
 static float cnormf(complex float val)
 {
@@ -55,27 +50,219 @@ static float cnormf(complex float val)
     return (realf * realf) + (imagf * imagf);
 }
 
-bool dcd_detect()
+bool dcd_detect(struct port_s *P)
 {
-    return dcdDetect;
+    return P->demod.dcdDetect;
 }
 
-void demod_init(struct audio_s *pa)
+/*
+ * Also creates the port's costas loop and TED
+ */
+void demod_init(struct port_s *P)
 {
-    save_audio_config_p = pa;
-    dcdDetect = false;
+    struct demod_s *M = &P->demod;
+
+    memset(M, 0, sizeof(struct demod_s));
+
+    M->dcdDetect = false;
 
-    m_rxRect = cmplxconj((TAU * CENTER) / FS);
-    m_rxPhase = cmplx(0.0f);
+    M->m_rxRect = cmplxconj((TAU * CENTER) / FS);
+    M->m_rxPhase = cmplx(0.0f);
 
-    struct demodulator_state_s *D = &demodulator_state;
-    memset(D, 0, sizeof(struct demodulator_state_s));
+    struct demodulator_state_s *D = &M->state;
 
     D->quick_attack = 0.080f * 0.2f;
     D->sluggish_decay = 0.00012f * 0.2f;
+
+    /*
+     * Create a costas loop
+     *
+     * All terms are radians per sample.
+     *
+     * The loop bandwidth determins the lock range
+     * and should be set around TAU/100 to TAU/200.
+     * It is halved once the loop is locked.
+     */
+    create_control_loop(&M->costas, (TAU / 180.0f), -1.0f, 1.0f);
+    set_gear_bandwidths(&M->costas, (TAU / 180.0f), (TAU / 360.0f));
+    create_timing_error_detector(&M->ted);
+    M->ted_strobe = 1;
+
+    create_equalizer(&M->eq, P->audio->eq_taps);
+
+    M->acq_fft = fft_alloc(ACQ_NFFT, 0, NULL, NULL);
+
+    for (int n = 0; n < TRAIN_SYMBOLS; n++)
+    {
+        M->train[n] = conjf(getQPSKQuadrant((TRAIN_WORD >> (30 - (n * 2))) & 0x3));
+    }
+
+    M->train_nco = cmplx(0.0f);
 }
 
-bool demod_get_samples(complex float csamples[])
+/*
+ * Coarse carrier frequency acquisition
+ *
+ * The narrow Costas loop takes hundreds of symbols to pull in
+ * a radio that is off by 100 Hz, and the start of the frame
+ * is lost.  Raising the symbols to the 4th power removes the
+ * QPSK modulation and leaves a line at 4 times the offset.
+ *
+ * This runs over a sliding window of ACQ_SYMBOLS symbols, as
+ * there is no carrier detect to mark the start of a burst.  The loop
+ * is only reseeded when it is not locked and a clear line disagrees
+ * with it.  Near the band edge the line reads a few Hz high, and
+ * the locked loop and the training preamble know better.
+ */
+static void coarse_acquire(struct demod_s *M, complex float decision)
+{
+    complex float squared = decision * decision;
+
+    M->acq_buf[M->acq_next] = squared * squared;
+    M->acq_next = (M->acq_next + 1) % ACQ_SYMBOLS;
+
+    if (++M->acq_count < ACQ_STEP)
+        return;
+
+    M->acq_count = 0;
+
+    complex float in[ACQ_NFFT];
+    complex float out[ACQ_NFFT];
+    float mag[ACQ_NFFT];
+
+    /*
+     * Oldest first, as the zero padding is not circular
+     */
+    for (int i = 0; i < ACQ_SYMBOLS; i++)
+    {
+        in[i] = M->acq_buf[(M->acq_next + i) % ACQ_SYMBOLS];
+    }
+
+    memset(&in[ACQ_SYMBOLS], 0, sizeof(complex float) * (ACQ_NFFT - ACQ_SYMBOLS));
+
+    fft(M->acq_fft, in, out);
+
+    int peak = 0;
+    float mean = 0.0f;
+
+    for (int i = 0; i < ACQ_NFFT; i++)
+    {
+        mag[i] = cabsf(out[i]);
+        mean += mag[i] * mag[i];
+
+        if (mag[i] > mag[peak])
+            peak = i;
+    }
+
+    mean /= ACQ_NFFT;
+
+    if (mean <= 0.0f || (mag[peak] * mag[peak]) < (ACQ_THRESHOLD * mean))
+        return; // noise or silence
+
+    /*
+     * Parabolic interpolation between the bins
+     */
+    float left = mag[(peak + ACQ_NFFT - 1) % ACQ_NFFT];
+    float right = mag[(peak + 1) % ACQ_NFFT];
+    float denom = left - (2.0f * mag[peak]) + right;
+    float bin = (float)peak;
+
+    if (denom < 0.0f)
+        bin += 0.5f * (left - right) / denom;
+
+    if (bin > (ACQ_NFFT / 2))
+        bin -= ACQ_NFFT;
+
+    float freq = (TAU * bin) / (4.0f * ACQ_NFFT); // radians per symbol
+
+    if (get_locked(&M->costas) == false && fabsf(freq - get_frequency(&M->costas)) > (TAU * ACQ_MIN_ERROR / RS))
+    {
+        set_frequency(&M->costas, freq);
+    }
+}
+
+/*
+ * Data-aided acquisition on the training preamble
+ *
+ * Every filter output sample is correlated with the TRAIN_SYMBOLS
+ * one symbol apart that end on it.  The peak is on the best sample
+ * of the last training symbol.  The segments of the correlation
+ * turn with the frequency error, and once that is taken out the
+ * whole correlation gives the carrier phase.
+ *
+ * The samples are first turned back by the loop frequency, so
+ * what is measured is the error left over after coarse_acquire().
+ *
+ * Returns true when the sample before this one was a peak, and
+ * train_phase and train_freq are its estimates.
+ */
+static bool train_detect(struct demod_s *M, complex float sample)
+{
+    M->train_nco *= cmplxconj(get_frequency(&M->costas) / CYCLES);
+    M->train_nco /= cabsf(M->train_nco);
+
+    M->train_buf[M->train_next] = sample * M->train_nco;
+    M->train_next = (M->train_next + 1) % TRAIN_SPAN;
+
+    complex float seg[TRAIN_SEGMENTS];
+    complex float turn = 0.0f;
+    float power = 0.0f;
+
+    for (int s = 0; s < TRAIN_SEGMENTS; s++)
+    {
+        seg[s] = 0.0f;
+
+        for (int k = 0; k < TRAIN_SEGMENT; k++)
+        {
+            int n = (s * TRAIN_SEGMENT) + k;
+            complex float y = M->train_buf[(M->train_next + (n * CYCLES) + (CYCLES - 1)) % TRAIN_SPAN];
+
+            seg[s] += M->train[n] * y;
+            power += cnormf(y);
+        }
+
+        if (s > 0)
+            turn += seg[s] * conjf(seg[s - 1]);
+    }
+
+    float freq = cargf(turn) / TRAIN_SEGMENT; // radians per symbol
+
+    /*
+     * Line the segments up on the last one and add them
+     */
+    complex float rotate = cmplx(freq * TRAIN_SEGMENT);
+    complex float sum = seg[0];
+
+    for (int s = 1; s < TRAIN_SEGMENTS; s++)
+    {
+        sum = (sum * rotate) + seg[s];
+    }
+
+    float metric = 0.0f;
+
+    if (power > 0.0f)
+        metric = cnormf(sum) / (TRAIN_SYMBOLS * power);
+
+    bool peak = (M->train_rising == true && metric < M->train_metric &&
+                 M->train_metric >= TRAIN_THRESHOLD);
+
+    if (peak == false)
+    {
+        /*
+         * The last segment is centred half a segment before
+         * the last symbol.  Put back what the NCO took out.
+         */
+        M->train_phase = cargf(sum) + (freq * (TRAIN_SEGMENT - 1) / 2.0f) - cargf(M->train_nco);
+        M->train_freq = get_frequency(&M->costas) + freq;
+    }
+
+    M->train_rising = (metric > M->train_metric);
+    M->train_metric = metric;
+
+    return peak;
+}
+
+bool demod_get_samples(struct port_s *P, complex float csamples[])
 {
     signed short pcm_I, pcm_Q;
     int lsb, msb;
@@ -86,24 +273,24 @@ bool demod_get_samples(complex float csamples[])
      */
     for (int i = 0; i < CYCLES; i++)
     {
-        lsb = audio_get(); // get I byte
+        lsb = audio_get(P); // get I byte
 
         if (lsb < 0)
             return false;
 
-        msb = audio_get(); // next byte
+        msb = audio_get(P); // next byte
 
         if (msb < 0)
             return false;
 
         pcm_I = (msb << 8) | lsb;
 
-        lsb = audio_get(); // get Q byte
+        lsb = audio_get(P); // get Q byte
 
         if (lsb < 0)
             return false;
 
-        msb = audio_get(); // next byte
+        msb = audio_get(P); // next byte
 
         if (msb < 0)
             return false;
@@ -124,39 +311,132 @@ int demod_get_audio_level(struct demodulator_state_s *D)
 }
 
 /*
- * QPSK Receive function
+ * Start the loops from the training preamble estimates.  The
+ * peak was the last training symbol, so the TED is restarted
+ * to take its first symbol one symbol after that.
  *
- * Remove any frequency and timing offsets
- *                                                             THIS IS A MESS
- * Process one 1200 Baud symbol at 9600 rate
+ * A locked loop knows the frequency better than 16 symbols do,
+ * but the phase is still set, as it may be locked a quarter
+ * turn off.
  */
-void processSymbols(complex float csamples[])
+static void train_acquire(struct demod_s *M)
 {
-    unsigned char diBits;
+    if (get_locked(&M->costas) == false)
+        set_frequency(&M->costas, M->train_freq);
+
+    set_phase(&M->costas, M->train_phase + M->train_freq + SLICE_ROTATE);
 
-    struct demodulator_state_s *D = &demodulator_state;
+    sync_reset(&M->ted);
+    M->ted_strobe = CYCLES;
 
     /*
-     * Convert 9600 rate complex samples to baseband.
+     * The taps are kept, as the path seldom changes much between
+     * bursts and CMA takes hundreds of symbols to learn it again
      */
-    for (int i = 0; i < CYCLES; i++)
+    set_equalizer_cma(&M->eq, get_locked(&M->costas) == false);
+}
+
+/*
+ * Bits of a symbol, QPSK on the diagonals, and the point
+ * decided on, of unit magnitude in the phase of the symbol
+ *
+ * DQPSK takes the phase change from the symbol before instead,
+ * which is a getQPSKQuadrant() point.  Any phase the loop is off
+ * by is in both and cancels, and a slip costs only one symbol.
+ *
+ * BPSK and 8PSK payloads are turned back to the phase they were
+ * sent in, as the turn that puts QPSK on the diagonals puts
+ * their points in between.
+ */
+static int slice(struct port_s *P, int mode, complex float symbol, complex float *point)
+{
+    struct demod_s *M = &P->demod;
+    int bits;
+
+    if (mode == Mode_BPSK)
     {
-        m_rxPhase *= m_rxRect;
+        bits = crealf(symbol * cmplx(SLICE_ROTATE)) < 0.0f;
+        *point = getQPSKQuadrant(bits ? 3 : 0) * cmplxconj(SLICE_ROTATE);
 
-        recvBlock[i] = csamples[i] * m_rxPhase;
+        return bits;
     }
+    else if (mode == Mode_8PSK)
+    {
+        bits = psk8ToTriBit(symbol * cmplx(SLICE_ROTATE));
+        *point = get8PSKPoint(bits) * cmplxconj(SLICE_ROTATE);
 
-    rrc_fir(rx_filter, recvBlock, CYCLES);
+        return bits;
+    }
 
-    /*
-     * Decimate by 4 for TED calculation (two samples per symbol)
-     */
-    for (int i = 0; i < CYCLES; i += 4)
+    *point = CMPLXF(copysignf(M_SQRT1_2, crealf(symbol)), copysignf(M_SQRT1_2, cimagf(symbol)));
+
+    if (mode == Mode_QPSK)
+        return qpskToDiBit(symbol);
+
+    complex float change = symbol * conjf(M->last_symbol);
+
+    M->last_symbol = symbol;
+
+    return qpskToDiBit(change * cmplxconj(SLICE_ROTATE));
+}
+
+static int mode_bits(int mode)
+{
+    if (mode == Mode_BPSK)
+        return 1;
+
+    return (mode == Mode_8PSK) ? 3 : 2;
+}
+
+/*
+ * Adapt the equalizer to the point decided on, turned back
+ * by the phase that was taken out for the decision
+ */
+static void equalize(struct demod_s *M, complex float point, float phase)
+{
+    if (get_equalizer_enable(&M->eq) == false)
+        return;
+
+    equalizer_update(&M->eq, point * cmplx(phase));
+}
+
+/*
+ * Sum the header symbols against the points decided on, for
+ * the signal to noise of the sender.  See get_frame_snr().
+ * The sums are kept until the next header.
+ */
+static void frame_snr(struct port_s *P, complex float symbol, complex float point)
+{
+    struct demod_s *M = &P->demod;
+    bool header = (P->il2p.state == IL2P_HEADER);
+
+    if (header == true && M->snr_header == false)
     {
-        ted_input(&recvBlock[i]);
+        M->snr_signal = 0.0f;
+        M->snr_power = 0.0f;
+        M->snr_count = 0;
     }
 
-    complex float decision = getMiddleSample(); // use middle TED sample
+    M->snr_header = header;
+
+    if (header == true)
+    {
+        M->snr_signal += crealf(symbol * conjf(point));
+        M->snr_power += cnormf(symbol);
+        M->snr_count++;
+    }
+}
+
+/*
+ * One symbol decision, with the carrier removed
+ */
+static void process_decision(struct port_s *P, complex float decision)
+{
+    complex float point;
+    int bits;
+
+    struct demod_s *M = &P->demod;
+    struct demodulator_state_s *D = &M->state;
 
     float fsam = cnormf(decision);
 
@@ -178,47 +458,218 @@ void processSymbols(complex float csamples[])
         D->alevel_rec_valley = fsam * D->sluggish_decay + D->alevel_rec_valley * (1.0f - D->sluggish_decay);
     }
 
-    if (get_costas_enable() == true)
+    /*
+     * DQPSK ports send the whole frame as DQPSK
+     */
+    int mode = (P->audio->dqpsk == true) ? Mode_DQPSK : il2p_rec_mode(P);
+
+    if (get_costas_enable(&M->costas) == true)
     {
-        complex float costasSymbol = decision * cmplxconj(get_phase());
+        coarse_acquire(M, decision);
 
-        diBits = qpskToDiBit(costasSymbol);
+        float phase = get_phase(&M->costas);
+        complex float costasSymbol = decision * cmplxconj(phase);
+
+        bits = slice(P, mode, costasSymbol, &point);
+        equalize(M, point, phase);
+        frame_snr(P, costasSymbol, point);
 
         /*
          * The constellation gets rotated +45 degrees (rectangular)
-         * from what was transmitted (diamond) with costas enabled
+         * from what was transmitted (diamond) with costas enabled.
+         *
+         * BPSK and 8PSK take the error from the point decided on,
+         * which for QPSK is the same as the phase detector.
          */
-        float d_error = phase_detector(costasSymbol);
+        float d_error;
+
+        if (mode == Mode_BPSK || mode == Mode_8PSK)
+            d_error = M_SQRT2 * cimagf(costasSymbol * conjf(point));
+        else
+            d_error = phase_detector(costasSymbol);
+
+        lock_detector(&M->costas, costasSymbol, d_error);
+        advance_loop(&M->costas, d_error);
+        phase_wrap(&M->costas);
+        frequency_limit(&M->costas);
 
-        advance_loop(d_error);
-        phase_wrap();
-        frequency_limit();
+        /*
+         * The timing loop shifts gear with the carrier lock, as the
+         * phase error is only small when the timing is right too.
+         * The equalizer can trust the decisions once locked.
+         * Lock is also the carrier detect.
+         */
+        bool locked = get_locked(&M->costas);
+
+        if (locked != get_ted_locked(&M->ted))
+        {
+            set_ted_gear(&M->ted, locked);
+            set_equalizer_cma(&M->eq, locked == false);
+            M->dcdDetect = locked;
+            ptt_set(P, OCTYPE_DCD, locked);
+        }
     }
     else
     {
         /*
          * Rotate constellation from diamond to rectangular.
          * This makes easier quadrant detection possible.
+         * The loop phase only holds turns found at a sync word.
          */
-        complex float decodedSymbol = decision * cmplxconj(ROTATE45);
+        float phase = ROTATE45 + get_phase(&M->costas);
+        complex float decodedSymbol = decision * cmplxconj(phase);
 
-        diBits = qpskToDiBit(decodedSymbol);
+        bits = slice(P, mode, decodedSymbol, &point);
+        equalize(M, point, phase);
+        frame_snr(P, decodedSymbol, point);
     }
 
     /*
      * Detected frequency error
      */
-    m_offset_freq = (get_frequency() * RS / TAU); // convert radians to freq at symbol rate
+    M->m_offset_freq = (get_frequency(&M->costas) * RS / TAU); // convert radians to freq at symbol rate
+
+    if (M->bit_tap != NULL)
+    {
+        for (int k = mode_bits(mode) - 1; k >= 0; k--)
+        {
+            M->bit_tap((bits >> k) & 0x1);
+        }
+    }
 
     /*
-     * Add to the output stream MSB first
+     * Add to the output stream.  A sync word found turned
+     * means the phase is off, so the rest of the frame, and
+     * the loop, are turned back.  DQPSK has no phase to be off,
+     * and the sync word is never in a BPSK or 8PSK payload.
      */
-    il2p_rec_bit((diBits >> 1) & 0x1);
-    il2p_rec_bit(diBits & 0x1);
+    if (mode == Mode_QPSK)
+    {
+        int turns = il2p_rec_dibit(P, bits);
+
+        if (turns != 0)
+        {
+            set_phase(&M->costas, get_phase(&M->costas) - (turns * (M_PI / 2.0)));
+        }
+    }
+    else
+    {
+        for (int k = mode_bits(mode) - 1; k >= 0; k--)
+        {
+            il2p_rec_bit(P, (bits >> k) & 0x1);
+        }
+    }
+}
+
+/*
+ * QPSK Receive function
+ *
+ * Remove any frequency and timing offsets, and any
+ * multipath when the equalizer is on
+ *
+ * Process CYCLES samples at 9600 rate, which is one 1200 Baud
+ * symbol, or none or two when the timing loop has moved
+ */
+void processSymbols(struct port_s *P, complex float csamples[])
+{
+    struct demod_s *M = &P->demod;
+
+    /*
+     * Convert 9600 rate complex samples to baseband.
+     */
+    for (int i = 0; i < CYCLES; i++)
+    {
+        M->m_rxPhase *= M->m_rxRect;
+
+        M->recvBlock[i] = csamples[i] * M->m_rxPhase;
+    }
+
+    rrc_fir(M->rx_filter, M->recvBlock, CYCLES);
+
+    /*
+     * Every 4th sample goes to the TED (two samples per symbol),
+     * give or take one when the timing loop moves the symbol.
+     * Between frames the training preamble is looked for too.
+     */
+    bool searching = (get_costas_enable(&M->costas) == true && P->il2p.state == IL2P_SEARCHING);
+
+    for (int i = 0; i < CYCLES; i++)
+    {
+        if (searching == true && train_detect(M, M->recvBlock[i]) == true)
+        {
+            train_acquire(M);
+        }
+
+        if (--M->ted_strobe > 0)
+            continue;
+
+        M->ted_strobe = CYCLES / 2;
+
+        bool equalized = get_equalizer_enable(&M->eq);
+
+        if (equalized == true)
+        {
+            equalizer_input(&M->eq, M->recvBlock[i]);
+        }
+
+        if (ted_input(&M->ted, &M->recvBlock[i]) == true)
+        {
+            M->ted_strobe += ted_loop(&M->ted);
+        }
+        else if (equalized == true)
+        {
+            process_decision(P, equalizer_output(&M->eq));
+        }
+        else
+        {
+            process_decision(P, getMiddleSample(&M->ted)); // use middle TED sample
+        }
+    }
+}
+
+/*
+ * Test hook, sees every demodulated bit
+ */
+void demod_set_bit_tap(struct port_s *P, void (*tap)(int))
+{
+    P->demod.bit_tap = tap;
+}
+
+float get_offset_freq(struct port_s *P)
+{
+    return P->demod.m_offset_freq;
+}
+
+/*
+ * Lock state, for the stats
+ */
+bool get_carrier_locked(struct port_s *P)
+{
+    return get_locked(&P->demod.costas);
+}
+
+/*
+ * Es/N0 in dB over the header of the last frame,
+ * from the mean of the symbols along the points decided on
+ * and the power left over.  0 with nothing to go on.
+ */
+float get_frame_snr(struct port_s *P)
+{
+    struct demod_s *M = &P->demod;
+
+    if (M->snr_count == 0 || M->snr_signal <= 0.0f)
+        return 0.0f;
+
+    float signal = M->snr_signal / M->snr_count;
+    float noise = (M->snr_power / M->snr_count) - (signal * signal);
+
+    signal *= signal;
+
+    return 10.0f * log10f(signal / fmaxf(noise, signal * SNR_MIN_NOISE));
 }
 
-float get_offset_freq()
+float get_carrier_lock_metric(struct port_s *P)
 {
-    return m_offset_freq;
+    return get_lock_metric(&P->demod.costas);
 }
 
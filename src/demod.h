@@ -19,11 +19,45 @@ extern "C"
 #include <complex.h>
 #include <stdbool.h>
 
+#include "ipnode.h"
 #include "audio.h"
 #include "ax25_pad.h"
+#include "rrc_fir.h"
+#include "costas_loop.h"
+#include "timing_error_detector.h"
+#include "equalizer.h"
+#include "fft.h"
 
 #define EOF_COST_VALUE 0.99
 
+/*
+ * Coarse frequency acquisition, see demod.c
+ *
+ * The 4th power spectrum of the last ACQ_SYMBOLS symbols,
+ * zero padded to ACQ_NFFT and taken every ACQ_STEP symbols,
+ * gives the carrier offset to about a Hz over +/- RS/8 (150 Hz).
+ */
+#define ACQ_SYMBOLS 64
+#define ACQ_STEP 16
+#define ACQ_NFFT 256
+#define ACQ_THRESHOLD 10.0f // peak bin over the mean, for a usable line
+#define ACQ_MIN_ERROR 3.0f  // Hz from the loop frequency before it is reseeded
+
+/*
+ * Training preamble detection, see train_detect() in demod.c
+ *
+ * The TRAIN_SYMBOLS are correlated in TRAIN_SEGMENTS, which
+ * gives the frequency over +/- RS/(2 * TRAIN_SEGMENT) (150 Hz).
+ * The metric is 1.0 for a clean preamble and about 1/16 for
+ * noise or data.
+ */
+#define TRAIN_SEGMENT 4
+#define TRAIN_SEGMENTS (TRAIN_SYMBOLS / TRAIN_SEGMENT)
+#define TRAIN_SPAN (TRAIN_SYMBOLS * 8) // 8 CYCLES per symbol
+#define TRAIN_THRESHOLD 0.6f
+
+#define SNR_MIN_NOISE 1.0e-4f // of the signal, or 40 dB
+
     struct demodulator_state_s
     {
         float quick_attack;
@@ -32,12 +66,60 @@ extern "C"
         float alevel_rec_valley;
     };
 
-    void demod_init(struct audio_s *);
-    bool demod_get_samples(complex float[]);
-    void processSymbols(complex float[]);
+    /*
+     * Receiver state for one port
+     */
+    struct demod_s
+    {
+        struct demodulator_state_s state;
+        struct costas_s costas;
+        struct ted_s ted;
+        struct eq_s eq;
+
+        complex float rx_filter[NTAPS];
+        complex float m_rxPhase;
+        complex float m_rxRect;
+        complex float last_symbol; // received, the DQPSK reference
+        complex float recvBlock[8]; // 8 CYCLES per symbol
+        int ted_strobe;             // samples to the next TED input
+
+        fft_cfg acq_fft;
+        complex float acq_buf[ACQ_SYMBOLS];
+        int acq_next;
+        int acq_count;
+
+        complex float train[TRAIN_SYMBOLS];  // conjugate of what was sent
+        complex float train_buf[TRAIN_SPAN]; // filter output, less the loop frequency
+        int train_next;
+        complex float train_nco;
+        float train_metric; // of the last sample
+        float train_phase;
+        float train_freq;
+        bool train_rising;
+
+        float snr_signal; // of the header, see get_frame_snr()
+        float snr_power;
+        int snr_count;
+        bool snr_header;
+
+        float m_offset_freq;
+        bool dcdDetect;
+
+        void (*bit_tap)(int);
+    };
+
+    struct port_s;
+
+    void demod_init(struct port_s *);
+    bool demod_get_samples(struct port_s *, complex float[]);
+    void processSymbols(struct port_s *, complex float[]);
     int demod_get_audio_level(struct demodulator_state_s *);
-    bool dcd_detect(void);
-    float get_offset_freq(void);
+    bool dcd_detect(struct port_s *);
+    float get_offset_freq(struct port_s *);
+    bool get_carrier_locked(struct port_s *);
+    float get_carrier_lock_metric(struct port_s *);
+    float get_frame_snr(struct port_s *);
+    void demod_set_bit_tap(struct port_s *, void (*)(int));
 
 #ifdef __cplusplus
 }
@@ -14,11 +14,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <bsd/bsd.h>
 
 #include "ipnode.h"
 #include "ax25_pad.h"
 #include "audio.h"
 #include "dlq.h"
+#include "ax25_link.h"
 
 static struct dlq_item_s *queue_head = NULL;
 
@@ -135,7 +137,7 @@ static void append_to_queue(struct dlq_item_s *pnew)
 /*
  * Called from il2p_rec upon IL2P_DECODE
  */
-void dlq_rec_frame(packet_t pp)
+void dlq_rec_frame(struct port_s *P, packet_t pp)
 {
     struct dlq_item_s *pnew = (struct dlq_item_s *)calloc(1, sizeof(struct dlq_item_s));
 
@@ -150,15 +152,18 @@ void dlq_rec_frame(packet_t pp)
 
     pnew->nextp = NULL;
     pnew->type = DLQ_REC_FRAME;
+    pnew->port = P;
     pnew->pp = pp;
 
+    pp->trace[TRACE_RX_DLQ] = dtime_now();
+
     append_to_queue(pnew);
 }
 
 /*
  * Called from ptt
  */
-void dlq_channel_busy(int activity, int status)
+void dlq_channel_busy(struct port_s *P, int activity, int status)
 {
     if (activity == OCTYPE_PTT || activity == OCTYPE_DCD)
     {
@@ -166,6 +171,7 @@ void dlq_channel_busy(int activity, int status)
         s_new_count++;
 
         pnew->type = DLQ_CHANNEL_BUSY;
+        pnew->port = P;
         pnew->activity = activity;
         pnew->status = status;
 
@@ -176,16 +182,93 @@ void dlq_channel_busy(int activity, int status)
 /*
  * Called from tx
  */
-void dlq_seize_confirm()
+void dlq_seize_confirm(struct port_s *P)
 {
     struct dlq_item_s *pnew = (struct dlq_item_s *)calloc(1, sizeof(struct dlq_item_s));
     s_new_count++;
 
     pnew->type = DLQ_SEIZE_CONFIRM;
+    pnew->port = P;
+
+    append_to_queue(pnew);
+}
+
+/*
+ * Called from tx when the transmitter is unkeyed
+ *
+ * Reports how long the burst was on the air, in seconds
+ */
+void dlq_tx_airtime(struct port_s *P, double airtime)
+{
+    struct dlq_item_s *pnew = (struct dlq_item_s *)calloc(1, sizeof(struct dlq_item_s));
+    s_new_count++;
+
+    pnew->type = DLQ_TX_AIRTIME;
+    pnew->port = P;
+    pnew->airtime = airtime;
+
+    append_to_queue(pnew);
+}
+
+/*
+ * Requests from a connected mode client.  They are queued
+ * so the data link state machines are only ever run by
+ * the thread in rx_process().
+ */
+static void client_request(struct port_s *P, dlq_type_t type, char addrs[][AX25_MAX_ADDR_LEN], int client, cdata_t *txdata)
+{
+    struct dlq_item_s *pnew = (struct dlq_item_s *)calloc(1, sizeof(struct dlq_item_s));
+    s_new_count++;
+
+    pnew->type = type;
+    pnew->port = P;
+    pnew->client = client;
+    pnew->txdata = txdata;
+
+    for (int i = 0; i < AX25_ADDRS; i++)
+    {
+        strlcpy(pnew->addrs[i], addrs[i], sizeof(pnew->addrs[i]));
+    }
 
     append_to_queue(pnew);
 }
 
+/*
+ * Incoming connections to the callsign go to the client
+ */
+void dlq_register_callsign(char *callsign, int client)
+{
+    char addrs[AX25_ADDRS][AX25_MAX_ADDR_LEN];
+
+    memset(addrs, 0, sizeof(addrs));
+    strlcpy(addrs[AX25_SOURCE], callsign, sizeof(addrs[AX25_SOURCE]));
+
+    client_request(NULL, DLQ_REGISTER_CALLSIGN, addrs, client, NULL);
+}
+
+/*
+ * The port picks which radio a new link goes out on
+ */
+void dlq_connect_request(struct port_s *P, char addrs[][AX25_MAX_ADDR_LEN], int client)
+{
+    client_request(P, DLQ_CONNECT_REQUEST, addrs, client, NULL);
+}
+
+void dlq_disconnect_request(struct port_s *P, char addrs[][AX25_MAX_ADDR_LEN], int client)
+{
+    client_request(P, DLQ_DISCONNECT_REQUEST, addrs, client, NULL);
+}
+
+void dlq_xmit_data_request(struct port_s *P, char addrs[][AX25_MAX_ADDR_LEN], int client, int pid, char *data, int len)
+{
+    client_request(P, DLQ_XMIT_DATA_REQUEST, addrs, client, cdata_new(pid, data, len));
+}
+
+void dlq_link_stats_request(struct port_s *P, char addrs[][AX25_MAX_ADDR_LEN], int client)
+{
+    client_request(P, DLQ_LINK_STATS_REQUEST, addrs, client, NULL);
+}
+
 int dlq_wait_while_empty(double timeout)
 {
     int timed_out_result = 0;
@@ -21,6 +21,8 @@ extern "C"
 
 #define TXDATA_MAGIC 0x09110911
 
+    struct port_s;
+
     typedef struct cdata_s
     {
         struct cdata_s *next;
@@ -37,25 +39,39 @@ extern "C"
     {
         DLQ_REC_FRAME,
         DLQ_CHANNEL_BUSY,
-        DLQ_SEIZE_CONFIRM
+        DLQ_SEIZE_CONFIRM,
+        DLQ_TX_AIRTIME,
+        DLQ_REGISTER_CALLSIGN,
+        DLQ_CONNECT_REQUEST,
+        DLQ_DISCONNECT_REQUEST,
+        DLQ_XMIT_DATA_REQUEST,
+        DLQ_LINK_STATS_REQUEST
     } dlq_type_t;
 
     typedef struct dlq_item_s
     {
         struct dlq_item_s *nextp;
+        struct port_s *port; // radio it came from or goes to
         cdata_t *txdata;
         packet_t pp;
         dlq_type_t type;
         int client;
         int activity;
         int status;
+        double airtime;
         char addrs[AX25_ADDRS][AX25_MAX_ADDR_LEN];
     } dlq_item_t;
 
     void dlq_init(void);
-    void dlq_rec_frame(packet_t);
-    void dlq_channel_busy(int, int);
-    void dlq_seize_confirm(void);
+    void dlq_rec_frame(struct port_s *, packet_t);
+    void dlq_channel_busy(struct port_s *, int, int);
+    void dlq_seize_confirm(struct port_s *);
+    void dlq_tx_airtime(struct port_s *, double);
+    void dlq_register_callsign(char *, int);
+    void dlq_connect_request(struct port_s *, char[][AX25_MAX_ADDR_LEN], int);
+    void dlq_disconnect_request(struct port_s *, char[][AX25_MAX_ADDR_LEN], int);
+    void dlq_xmit_data_request(struct port_s *, char[][AX25_MAX_ADDR_LEN], int, int, char *, int);
+    void dlq_link_stats_request(struct port_s *, char[][AX25_MAX_ADDR_LEN], int);
     int dlq_wait_while_empty(double);
     struct dlq_item_s *dlq_remove(void);
     void dlq_delete(struct dlq_item_s *);
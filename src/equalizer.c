@@ -0,0 +1,186 @@
+/*
+ * equalizer.c
+ *
+ * IP Node Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <string.h>
+#include <complex.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "equalizer.h"
+
+/*
+ * Adaptive equalizer for multipath
+ *
+ * An echo a symbol or two late smears each symbol into the
+ * next, and past a point no FEC can make up for it.  This is a
+ * linear filter on the TED input samples, two per symbol, whose
+ * taps learn the inverse of the path.
+ *
+ * It starts blind with the Constant Modulus Algorithm, which
+ * only wants the symbols to have the same magnitude, so it works
+ * before the carrier is found.  Once the Costas loop is locked,
+ * the decisions are good enough for decision directed LMS, which
+ * gets the phase and the noise right too.
+ *
+ * The center tap is on a symbol sample, so with the other taps
+ * at zero it passes the symbol samples as they are.  It is put
+ * before the middle, as echoes come late and need the older taps.
+ */
+
+/*
+ * Turn the equalizer on with this many taps, or off with 0
+ */
+void create_equalizer(struct eq_s *E, int taps)
+{
+    memset(E, 0, sizeof(struct eq_s));
+
+    if (taps > EQ_MAX_TAPS)
+        taps = EQ_MAX_TAPS;
+    else if (taps > 0 && taps < 3)
+        taps = 3;
+
+    E->d_taps = taps;
+    E->d_center = (((taps - 1) / 2) - 1) | 1; // odd, the newest is a middle sample
+
+    reset_equalizer(E);
+}
+
+/*
+ * Back to passing the samples through, and to CMA
+ */
+void reset_equalizer(struct eq_s *E)
+{
+    memset(E->d_wr, 0, sizeof(E->d_wr));
+    memset(E->d_wi, 0, sizeof(E->d_wi));
+
+    if (E->d_taps > 0)
+        E->d_wr[E->d_center] = 1.0f;
+
+    E->d_cma = true;
+}
+
+/*
+ * Each TED input, normalized to unit power
+ */
+void equalizer_input(struct eq_s *E, complex float x)
+{
+    float power = crealf(x * conjf(x));
+
+    E->d_power += ((power > E->d_power) ? EQ_POWER_ATTACK : EQ_POWER_DECAY) * (power - E->d_power);
+
+    float scale = 1.0f / sqrtf(fmaxf(E->d_power, EQ_MIN_POWER));
+
+    E->d_next = (E->d_next == 0) ? (E->d_taps - 1) : (E->d_next - 1);
+
+    E->d_xr[E->d_next] = E->d_xr[E->d_next + E->d_taps] = crealf(x) * scale;
+    E->d_xi[E->d_next] = E->d_xi[E->d_next + E->d_taps] = cimagf(x) * scale;
+}
+
+/*
+ * The symbol, at the input level, after a middle sample is input.
+ * It is (center - 1) / 2 symbols behind the TED.
+ */
+complex float equalizer_output(struct eq_s *E)
+{
+    const float *restrict xr = &E->d_xr[E->d_next];
+    const float *restrict xi = &E->d_xi[E->d_next];
+    const float *restrict wr = E->d_wr;
+    const float *restrict wi = E->d_wi;
+    float yr = 0.0f;
+    float yi = 0.0f;
+
+    for (int k = 0; k < E->d_taps; k++)
+    {
+        yr += (wr[k] * xr[k]) - (wi[k] * xi[k]);
+        yi += (wr[k] * xi[k]) + (wi[k] * xr[k]);
+    }
+
+    if (isfinite(yr) == false || isfinite(yi) == false)
+    {
+        reset_equalizer(E); // the taps ran away
+        yr = yi = 0.0f;
+    }
+
+    E->d_output = CMPLXF(yr, yi);
+
+    return E->d_output * sqrtf(fmaxf(E->d_power, EQ_MIN_POWER));
+}
+
+/*
+ * Adapt the taps to the last output.
+ *
+ * @param target is the symbol decided on, of unit magnitude,
+ * in the phase of the output.  CMA does not use it.
+ */
+void equalizer_update(struct eq_s *E, complex float target)
+{
+    const float *restrict xr = &E->d_xr[E->d_next];
+    const float *restrict xi = &E->d_xi[E->d_next];
+    float *restrict wr = E->d_wr;
+    float *restrict wi = E->d_wi;
+    complex float y = E->d_output;
+    complex float error;
+    float step;
+
+    if (E->d_cma == true)
+    {
+        error = y * (1.0f - crealf(y * conjf(y)));
+        step = EQ_CMA_STEP;
+    }
+    else
+    {
+        float power = 0.0f;
+
+        for (int k = 0; k < E->d_taps; k++)
+        {
+            power += (xr[k] * xr[k]) + (xi[k] * xi[k]);
+        }
+
+        error = target - y;
+        step = EQ_LMS_STEP / (power + EQ_MIN_POWER);
+    }
+
+    /*
+     * The CMA error is cubic in the output, so one
+     * outlier could throw the taps right off
+     */
+    float size = cabsf(error);
+
+    if (size > EQ_MAX_ERROR)
+        error *= EQ_MAX_ERROR / size;
+
+    float er = step * crealf(error);
+    float ei = step * cimagf(error);
+
+    /*
+     * w += step * error * conj(x)
+     */
+    for (int k = 0; k < E->d_taps; k++)
+    {
+        wr[k] += (er * xr[k]) + (ei * xi[k]);
+        wi[k] += (ei * xr[k]) - (er * xi[k]);
+    }
+}
+
+/*
+ * CMA until the carrier is locked, LMS after
+ */
+void set_equalizer_cma(struct eq_s *E, bool cma)
+{
+    E->d_cma = cma;
+}
+
+bool get_equalizer_enable(struct eq_s *E)
+{
+    return E->d_taps > 0;
+}
+
+bool get_equalizer_cma(struct eq_s *E)
+{
+    return E->d_cma;
+}
@@ -0,0 +1,63 @@
+/*
+ * equalizer.h
+ *
+ * IP Node Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <complex.h>
+#include <stdbool.h>
+
+/*
+ * Fractionally spaced, the taps are half a symbol apart.
+ * The step sizes are for the input normalized to unit power.
+ */
+#define EQ_MAX_TAPS 32
+#define EQ_CMA_STEP 0.002f
+#define EQ_LMS_STEP 0.005f // normalized by the power in the taps
+#define EQ_POWER_ATTACK 0.2f // quick, so a burst after silence is not huge
+#define EQ_POWER_DECAY 0.01f
+#define EQ_MIN_POWER 1.0e-6f
+#define EQ_MAX_ERROR 1.0f
+
+/*
+ * One equalizer per receiver
+ *
+ * The delay line is kept twice over, so the taps always
+ * see it in one piece, newest first, without wrapping.
+ * Real and imaginary parts are apart so the kernels vectorize.
+ */
+struct eq_s
+{
+    int d_taps; // 0 is off
+    int d_center;
+    int d_next;
+    float d_xr[EQ_MAX_TAPS * 2];
+    float d_xi[EQ_MAX_TAPS * 2];
+    float d_wr[EQ_MAX_TAPS];
+    float d_wi[EQ_MAX_TAPS];
+    complex float d_output; // normalized
+    float d_power;
+    bool d_cma;
+};
+
+void create_equalizer(struct eq_s *, int);
+void reset_equalizer(struct eq_s *);
+void equalizer_input(struct eq_s *, complex float);
+complex float equalizer_output(struct eq_s *);
+void equalizer_update(struct eq_s *, complex float);
+void set_equalizer_cma(struct eq_s *, bool);
+bool get_equalizer_enable(struct eq_s *);
+bool get_equalizer_cma(struct eq_s *);
+
+#ifdef __cplusplus
+}
+#endif
@@ -55,7 +55,7 @@ extern "C"
     }
 #define MODNN(x) modnn(rs, x)
 
-    void encode_rs_char(struct rs *, unsigned char *, unsigned char *);
+    void encode_rs_char(struct rs *, unsigned char *, int, unsigned char *);
     int decode_rs_char(struct rs *, unsigned char *, int *, int);
     struct rs *init_rs_char(unsigned int, unsigned int, unsigned int, unsigned int, unsigned int);
 
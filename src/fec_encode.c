@@ -16,11 +16,16 @@
 
 #include "fec.h"
 
-void encode_rs_char(struct rs *rs, unsigned char *data, unsigned char *bb)
+/*
+ * Shortened code: data_size bytes with the leading zero pad implied.
+ * Zeros ahead of the data leave the shift register untouched, so they
+ * are simply not clocked through.
+ */
+void encode_rs_char(struct rs *rs, unsigned char *data, int data_size, unsigned char *bb)
 {
     memset(bb, 0, NROOTS * sizeof(unsigned char)); // clear out the FEC data area
 
-    for (int i = 0; i < NN - NROOTS; i++)
+    for (int i = 0; i < data_size; i++)
     {
         unsigned char feedback = INDEX_OF[data[i] ^ bb[0]];
 
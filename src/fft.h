@@ -49,8 +49,10 @@ extern "C" {
 #define TAU     (2.0 * M_PI)
 #endif
 
+#ifndef cmplx
 #define cmplx(value) (cosf(value) + sinf(value) * I)
 #define cmplxconj(value) (cosf(value) + sinf(value) * -I)
+#endif
 
 /* Complex FFT */
 
@@ -33,32 +33,70 @@ extern "C"
 #define IL2P_HEADER_SIZE 13
 #define IL2P_HEADER_PARITY 2
 
+/*
+ * A header with the FEC level bit clear is followed by an extension
+ * octet, with RS parity of its own, that says how the payload is
+ * sent.  Zero is the same as no extension, which is what a frame
+ * that needs none gets, so other stations still decode it.
+ */
+#define IL2P_EXT_SIZE 1
+#define IL2P_EXT_PARITY 2
+#define IL2P_EXT_MODE 0x03 // payload modulation, see il2p_ext_mode()
+#define IL2P_EXT_FEC 0x0c  // payload parity per block, see il2p_ext_parity()
+#define IL2P_EXT_INTERLEAVE 0x10 // payload blocks interleaved, if more than one
+
 #define IL2P_MAX_PAYLOAD_SIZE 1023
 #define IL2P_MAX_PAYLOAD_BLOCKS 5
+#define IL2P_MAX_BLOCK_DATA 239 // payload octets in an RS block
 #define IL2P_MAX_PARITY_SYMBOLS 16
 #define IL2P_MAX_ENCODED_PAYLOAD_SIZE (IL2P_MAX_PAYLOAD_SIZE + IL2P_MAX_PAYLOAD_BLOCKS * IL2P_MAX_PARITY_SYMBOLS)
 
-#define IL2P_MAX_PACKET_SIZE (IL2P_SYNC_WORD_SIZE + IL2P_HEADER_SIZE + IL2P_HEADER_PARITY + IL2P_MAX_ENCODED_PAYLOAD_SIZE)
+#define IL2P_MAX_PACKET_SIZE (IL2P_SYNC_WORD_SIZE + IL2P_HEADER_SIZE + IL2P_HEADER_PARITY + IL2P_EXT_SIZE + IL2P_EXT_PARITY + IL2P_MAX_ENCODED_PAYLOAD_SIZE)
+
+/*
+ * Aggregate bursts use header type 0 and one of the future PID values.
+ *
+ * The payload is a flags byte followed by the AX.25 frames,
+ * each with a 2-byte big-endian length in front.
+ */
+#define IL2P_PID_AGGREGATE 7
+#define IL2P_AGG_ACCEPT 0x01
+#define IL2P_AGG_EXTEND 0x02 // sender reads header extensions
+
+#define IL2P_AGG_MAX_FRAME_LEN 128 // only frames this short are packed
+#define IL2P_AGG_MAX_FRAMES 32
 
     enum il2p_s
     {
         IL2P_SEARCHING = 0,
         IL2P_HEADER,
+        IL2P_EXTENSION,
         IL2P_PAYLOAD,
         IL2P_DECODE
     };
 
+/*
+ * Quarter turns of the QPSK constellation, see il2p_rec_dibit()
+ */
+#define IL2P_TURNS 4
+
     struct il2p_context_s
     {
         enum il2p_s state;
         unsigned int acc;
+        unsigned int tacc[IL2P_TURNS]; // acc as if turned, [0] is not used
         int bc;
         int hc;
         int eplen;
         int pc;
         unsigned char shdr[IL2P_HEADER_SIZE + IL2P_HEADER_PARITY];
         unsigned char uhdr[IL2P_HEADER_SIZE];
+        unsigned char sext[IL2P_EXT_SIZE + IL2P_EXT_PARITY];
+        int ext;  // 0 without an extension
+        int mode; // of the payload symbols
         unsigned char spayload[IL2P_MAX_ENCODED_PAYLOAD_SIZE];
+        double sync_time;
+        double header_time;
     };
 
     typedef struct
@@ -76,21 +114,49 @@ extern "C"
     struct rs *il2p_find_rs(int);
     void il2p_encode_rs(unsigned char *, int, int, unsigned char *);
     int il2p_decode_rs(unsigned char *, int, int, unsigned char *);
-    void il2p_rec_bit(int);
-    int il2p_send_frame(packet_t);
-    void il2p_send_idle(int);
-    int il2p_encode_frame(packet_t, unsigned char *);
+    struct port_s;
+
+    int il2p_rec_dibit(struct port_s *, int);
+    void il2p_rec_bit(struct port_s *, int);
+    int il2p_rec_mode(struct port_s *);
+    void il2p_rec_trace(struct port_s *, packet_t);
+    int il2p_send_frame(struct port_s *, packet_t);
+    int il2p_send_encoded(struct port_s *, int, unsigned char *, int);
+    void il2p_send_preamble(struct port_s *, int);
+    void il2p_send_idle(struct port_s *, int);
+    int il2p_encode_frame(packet_t, int, unsigned char *, int *);
     packet_t il2p_decode_frame(unsigned char *);
-    packet_t il2p_decode_header_payload(unsigned char *, unsigned char *, int *);
+    packet_t il2p_decode_header_payload(unsigned char *, int, unsigned char *, int *, int *);
     int il2p_type_1_header(packet_t, unsigned char *);
     packet_t il2p_decode_header_type_1(unsigned char *, int);
     int il2p_clarify_header(unsigned char *, unsigned char *);
+    int il2p_clarify_ext(unsigned char *, int *);
     void il2p_scramble_block(unsigned char *, unsigned char *, int);
     void il2p_descramble_block(unsigned char *, unsigned char *, int);
-    int il2p_payload_compute(il2p_payload_properties_t *, int);
-    int il2p_encode_payload(unsigned char *, int, unsigned char *);
-    int il2p_decode_payload(unsigned char *, int, unsigned char *, int *);
+    int il2p_payload_compute(il2p_payload_properties_t *, int, int);
+    int il2p_encode_payload(unsigned char *, int, int, unsigned char *);
+    int il2p_decode_payload(unsigned char *, int, int, unsigned char *, int *, int *);
     int il2p_get_header_attributes(unsigned char *);
+    int il2p_get_header_extended(unsigned char *);
+    void il2p_set_header_extended(unsigned char *);
+    int il2p_header_length(int);
+    int il2p_ext_mode(int);
+    int il2p_mode_ext(int);
+    int il2p_ext_parity(int);
+    int il2p_parity_ext(int);
+    int il2p_type_0_header(packet_t, int, unsigned char *);
+    int il2p_is_aggregate(unsigned char *);
+    int il2p_decode_header_addrs(unsigned char *, char[][AX25_MAX_ADDR_LEN], int);
+    void il2p_aggregate_init(void);
+    int il2p_aggregate_ok(struct port_s *, packet_t);
+    int il2p_aggregate_advertise(struct port_s *, packet_t);
+    int il2p_send_aggregate(struct port_s *, packet_t[], int);
+    void il2p_decode_aggregate(struct port_s *, unsigned char *, int, unsigned char *, int);
+    void il2p_adapt_init(void);
+    void il2p_adapt_heard(struct port_s *, unsigned char *, float);
+    void il2p_adapt_extends(struct port_s *, char *);
+    void il2p_adapt_corrected(struct port_s *, unsigned char *, int, int, int);
+    int il2p_adapt_ext(struct port_s *, char *);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,346 @@
+/*
+ * il2p_adapt.c
+ *
+ * IP Node Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <bsd/bsd.h>
+
+#include "ipnode.h"
+#include "il2p.h"
+#include "ax25_link.h"
+#include "port.h"
+
+/*
+ * The header always goes as QPSK, so every station can read it,
+ * and the payload as whatever the peer's signal is good for:
+ * 8PSK for 3600 bit/s on a strong link, QPSK, or BPSK to keep a
+ * weak one going.  The header extension says which.
+ *
+ * The RS parity of the payload blocks goes the same way.  A
+ * clean path needs only 4 of the 16 symbols, which is 5% of the
+ * airtime of a full block, and a noisy one keeps all 16.
+ *
+ * What is known of the path to a peer is its signal here, the
+ * Es/N0 over the headers of its frames, and the symbols RS
+ * corrected in their payloads.  The path is taken to be the
+ * same both ways.
+ *
+ * A station that does not read the extension would take its
+ * frames for baseline FEC and lose them all, so a peer only
+ * gets one once it has sent us a frame with one, or has said
+ * in an aggregate burst that it reads them.
+ *
+ * Each port is its own radio and path, so a link is a peer
+ * on a port.  Reading extensions goes with the station, and
+ * counts whichever port it was heard on.
+ */
+#define MAX_LINKS 32
+#define LINK_EXPIRE_SECS 600.0 // back to QPSK for a peer we no longer hear
+#define SNR_AVERAGE 0.25f      // of a new frame
+
+/*
+ * Es/N0 in dB to go up to each modulation, and the
+ * margin either side so a link does not flip between two
+ */
+#define SNR_QPSK 8.5f
+#define SNR_8PSK 15.0f
+#define SNR_HYSTERESIS 1.0f
+
+/*
+ * Symbol errors in a block are about Poisson, so the parity
+ * is the least that corrects the mean errors of a full block
+ * and three deviations more, plus one.  A block RS could not
+ * correct counts as one error more than the parity could.
+ */
+#define ERRORS_AVERAGE 0.1f // of a new payload
+#define ERRORS_MIN_FRAMES 4 // heard before the parity comes down
+#define ERRORS_BLOCK 255
+
+static const int parities[] = {4, 6, 8, 16};
+
+struct link_s
+{
+    int port;
+    char addr[AX25_MAX_ADDR_LEN];
+    double heard; // last header heard from it
+    double extends; // last said it reads extensions, 0 if never
+    float snr;    // dB, averaged
+    int mode;     // its payloads are sent in
+    float errors; // symbols RS corrected per octet, averaged
+    int frames;   // payloads the errors are over
+    int parity;   // per block of its payloads
+};
+
+static struct link_s links[MAX_LINKS];
+static pthread_mutex_t link_mutex;
+
+/*
+ * The links of all ports are in the one table
+ */
+void il2p_adapt_init()
+{
+    memset(links, 0, sizeof(links));
+    il2p_mutex_init(&link_mutex);
+}
+
+static double link_last_used(struct link_s *l)
+{
+    return (l->heard > l->extends) ? l->heard : l->extends;
+}
+
+/*
+ * Find the peer on the port, or take the link used least recently.
+ *
+ * Caller holds link_mutex.
+ */
+static struct link_s *find_link(struct port_s *P, char *addr, bool create)
+{
+    struct link_s *oldest = &links[0];
+
+    for (int i = 0; i < MAX_LINKS; i++)
+    {
+        if (links[i].port == P->number && strcmp(links[i].addr, addr) == 0)
+        {
+            return &links[i];
+        }
+
+        if (link_last_used(&links[i]) < link_last_used(oldest))
+        {
+            oldest = &links[i];
+        }
+    }
+
+    if (create == false)
+    {
+        return NULL;
+    }
+
+    memset(oldest, 0, sizeof(struct link_s));
+    oldest->port = P->number;
+    strlcpy(oldest->addr, addr, sizeof(oldest->addr));
+    oldest->mode = Mode_QPSK;
+    oldest->parity = IL2P_MAX_PARITY_SYMBOLS;
+
+    return oldest;
+}
+
+/*
+ * Go up a step once the signal is a margin over the
+ * step, and down once it is a margin under
+ */
+static int choose_mode(struct link_s *l)
+{
+    if (l->mode == Mode_8PSK)
+    {
+        if (l->snr < (SNR_8PSK - SNR_HYSTERESIS))
+            l->mode = Mode_QPSK;
+    }
+    else if (l->mode == Mode_BPSK)
+    {
+        if (l->snr >= (SNR_QPSK + SNR_HYSTERESIS))
+            l->mode = Mode_QPSK;
+    }
+    else if (l->snr >= (SNR_8PSK + SNR_HYSTERESIS))
+    {
+        l->mode = Mode_8PSK;
+    }
+    else if (l->snr < (SNR_QPSK - SNR_HYSTERESIS))
+    {
+        l->mode = Mode_BPSK;
+    }
+
+    return l->mode;
+}
+
+/*
+ * Called from il2p_rec_bit() with each good header
+ * and the signal to noise measured over it
+ */
+void il2p_adapt_heard(struct port_s *P, unsigned char *uhdr, float snr)
+{
+    char addrs[AX25_ADDRS][AX25_MAX_ADDR_LEN];
+
+    /*
+     * Quietly, the frame decode reports any bad addresses
+     */
+    if (il2p_decode_header_addrs(uhdr, addrs, 1) < 0)
+    {
+        return;
+    }
+
+    double now = dtime_now();
+
+    il2p_mutex_lock(&link_mutex);
+
+    struct link_s *l = find_link(P, addrs[AX25_SOURCE], true);
+
+    if (l->heard == 0.0 || (now - l->heard) >= LINK_EXPIRE_SECS)
+    {
+        l->snr = snr;
+        l->mode = Mode_QPSK;
+        l->errors = 0.0f;
+        l->frames = 0;
+        l->parity = IL2P_MAX_PARITY_SYMBOLS;
+    }
+    else
+    {
+        l->snr += SNR_AVERAGE * (snr - l->snr);
+    }
+
+    l->heard = now;
+
+    choose_mode(l);
+
+    il2p_mutex_unlock(&link_mutex);
+}
+
+/*
+ * Called when the peer sent a good frame with an extension,
+ * or an aggregate burst saying it reads them
+ */
+void il2p_adapt_extends(struct port_s *P, char *addr)
+{
+    il2p_mutex_lock(&link_mutex);
+
+    find_link(P, addr, true)->extends = dtime_now();
+
+    il2p_mutex_unlock(&link_mutex);
+}
+
+/*
+ * Has the station said lately, on any port, that it reads
+ * extensions?  Caller holds link_mutex.
+ */
+static bool reads_extensions(char *addr, double now)
+{
+    for (int i = 0; i < MAX_LINKS; i++)
+    {
+        if (strcmp(links[i].addr, addr) == 0 && links[i].extends != 0.0 && (now - links[i].extends) < LINK_EXPIRE_SECS)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int choose_parity(struct link_s *l)
+{
+    if (l->frames < ERRORS_MIN_FRAMES)
+    {
+        l->parity = IL2P_MAX_PARITY_SYMBOLS;
+        return l->parity;
+    }
+
+    float mean = l->errors * ERRORS_BLOCK;
+    float needed = mean + (3.0f * sqrtf(mean)) + 1.0f;
+
+    l->parity = IL2P_MAX_PARITY_SYMBOLS;
+
+    for (int i = 0; i < (int)(sizeof(parities) / sizeof(parities[0])); i++)
+    {
+        if ((parities[i] / 2) >= needed)
+        {
+            l->parity = parities[i];
+            break;
+        }
+    }
+
+    return l->parity;
+}
+
+/*
+ * Called from il2p_rec_bit() after the payload of a frame from
+ * the peer is decoded, with the symbols RS corrected in its good
+ * blocks and the number of blocks that were past correcting
+ */
+void il2p_adapt_corrected(struct port_s *P, unsigned char *uhdr, int ext, int corrected, int failed)
+{
+    char addrs[AX25_ADDRS][AX25_MAX_ADDR_LEN];
+    il2p_payload_properties_t plprop;
+
+    int elen = il2p_payload_compute(&plprop, il2p_get_header_attributes(uhdr), ext);
+
+    if (elen <= 0 || il2p_decode_header_addrs(uhdr, addrs, 1) < 0)
+    {
+        return;
+    }
+
+    corrected += failed * ((plprop.parity_symbols_per_block / 2) + 1);
+
+    il2p_mutex_lock(&link_mutex);
+
+    struct link_s *l = find_link(P, addrs[AX25_SOURCE], false);
+
+    if (l != NULL)
+    {
+        float errors = (float)corrected / elen;
+
+        if (l->frames == 0)
+            l->errors = errors;
+        else
+            l->errors += ERRORS_AVERAGE * (errors - l->errors);
+
+        l->frames++;
+
+        choose_parity(l);
+    }
+
+    il2p_mutex_unlock(&link_mutex);
+}
+
+/*
+ * The header extension for a frame to the peer, 0 for none.
+ * DQPSK ports keep the payload in DQPSK.  INTERLEAVE goes
+ * with or without ADAPTIVE, but only to peers that read it.
+ */
+int il2p_adapt_ext(struct port_s *P, char *addr)
+{
+    int mode = Mode_QPSK;
+    int parity = IL2P_MAX_PARITY_SYMBOLS;
+
+    if (P->audio->adaptive == false && P->audio->interleave == false)
+    {
+        return 0;
+    }
+
+    double now = dtime_now();
+
+    il2p_mutex_lock(&link_mutex);
+
+    if (reads_extensions(addr, now) == false)
+    {
+        il2p_mutex_unlock(&link_mutex);
+        return 0;
+    }
+
+    struct link_s *l = find_link(P, addr, false);
+
+    if (P->audio->adaptive == true && l != NULL && (now - l->heard) < LINK_EXPIRE_SECS)
+    {
+        mode = l->mode;
+        parity = l->parity;
+    }
+
+    il2p_mutex_unlock(&link_mutex);
+
+    if (P->audio->dqpsk == true)
+    {
+        mode = Mode_QPSK;
+    }
+
+    int ext = il2p_mode_ext(mode) | il2p_parity_ext(parity);
+
+    if (P->audio->interleave == true)
+        ext |= IL2P_EXT_INTERLEAVE;
+
+    return ext;
+}
@@ -0,0 +1,312 @@
+/*
+ * il2p_aggregate.c
+ *
+ * IP Node Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <bsd/bsd.h>
+
+#include "ipnode.h"
+#include "il2p.h"
+#include "tx.h"
+#include "tq.h"
+#include "dlq.h"
+#include "ax25_link.h"
+#include "port.h"
+
+/*
+ * Several short AX.25 frames share one IL2P header and the
+ * RS parity of the payload blocks.  A station only sends them
+ * to peers it has heard an aggregate burst from, so every node
+ * advertises itself with an empty one now and then.
+ *
+ * The same burst tells a peer that we read header extensions,
+ * which no other station is sent, see il2p_adapt.c.
+ */
+#define MAX_PEERS 32
+#define ADVERTISE_SECS 60.0 // tell a peer again after this long
+#define PEER_EXPIRE_SECS 600.0  // forget a peer we no longer hear
+
+struct peer_s
+{
+    char addr[AX25_MAX_ADDR_LEN];
+    double heard; // last aggregate burst heard from it, 0 if never
+    double told;  // last time we sent it one
+};
+
+static struct peer_s peers[MAX_PEERS];
+static pthread_mutex_t peer_mutex;
+
+/*
+ * The peers are shared by all ports, AGGREGATE is per port
+ */
+void il2p_aggregate_init()
+{
+    memset(peers, 0, sizeof(peers));
+    il2p_mutex_init(&peer_mutex);
+}
+
+static double peer_last_used(struct peer_s *p)
+{
+    return (p->heard > p->told) ? p->heard : p->told;
+}
+
+/*
+ * Find the peer.  If not there and create is set, take
+ * the entry that was used least recently.
+ *
+ * Caller holds peer_mutex.
+ */
+static struct peer_s *find_peer(char *addr, bool create)
+{
+    struct peer_s *oldest = &peers[0];
+
+    for (int i = 0; i < MAX_PEERS; i++)
+    {
+        if (strcmp(peers[i].addr, addr) == 0)
+        {
+            return &peers[i];
+        }
+
+        if (peer_last_used(&peers[i]) < peer_last_used(oldest))
+        {
+            oldest = &peers[i];
+        }
+    }
+
+    if (create == false)
+    {
+        return NULL;
+    }
+
+    memset(oldest, 0, sizeof(struct peer_s));
+    strlcpy(oldest->addr, addr, sizeof(oldest->addr));
+
+    return oldest;
+}
+
+/*
+ * Can the frame go into an aggregate burst?
+ */
+int il2p_aggregate_ok(struct port_s *P, packet_t pp)
+{
+    char addr[AX25_MAX_ADDR_LEN];
+    int ok;
+
+    if (P->audio->aggregate == false || ax25_get_frame_len(pp) > IL2P_AGG_MAX_FRAME_LEN)
+    {
+        return 0;
+    }
+
+    ax25_get_addr_with_ssid(pp, AX25_DESTINATION, addr);
+
+    il2p_mutex_lock(&peer_mutex);
+
+    struct peer_s *p = find_peer(addr, false);
+
+    ok = (p != NULL && p->heard != 0.0 && (dtime_now() - p->heard) < PEER_EXPIRE_SECS);
+
+    il2p_mutex_unlock(&peer_mutex);
+
+    return ok;
+}
+
+/*
+ * Mark the destinations as told, returns 1 if
+ * the first one had not been told recently.
+ */
+static int peers_told(packet_t pp[], int count)
+{
+    char addr[AX25_MAX_ADDR_LEN];
+    double now = dtime_now();
+    int due = 0;
+
+    il2p_mutex_lock(&peer_mutex);
+
+    for (int i = 0; i < count; i++)
+    {
+        ax25_get_addr_with_ssid(pp[i], AX25_DESTINATION, addr);
+
+        struct peer_s *p = find_peer(addr, true);
+
+        if (i == 0)
+        {
+            due = (now - p->told) >= ADVERTISE_SECS;
+        }
+
+        p->told = now;
+    }
+
+    il2p_mutex_unlock(&peer_mutex);
+
+    return due;
+}
+
+/*
+ * Encode and send one aggregate burst of count frames, which
+ * may be zero.  The header addresses are taken from pp[0].
+ *
+ * Returns number of bits sent, or -1 on error.
+ */
+static int send_aggregate(struct port_s *P, packet_t pp[], int count)
+{
+    unsigned char payload[IL2P_MAX_PAYLOAD_SIZE];
+    unsigned char encoded[IL2P_MAX_PACKET_SIZE];
+    unsigned char hdr[IL2P_HEADER_SIZE];
+    int plen = 0;
+
+    payload[plen++] = (P->audio->aggregate ? IL2P_AGG_ACCEPT : 0) | ((P->audio->adaptive || P->audio->interleave) ? IL2P_AGG_EXTEND : 0);
+
+    for (int i = 0; i < count; i++)
+    {
+        int flen = ax25_get_frame_len(pp[i]);
+
+        if (plen + 2 + flen > IL2P_MAX_PAYLOAD_SIZE)
+        {
+            fprintf(stderr, "IL2P: Aggregate payload too long\n");
+            return -1;
+        }
+
+        payload[plen++] = (flen >> 8) & 0xff;
+        payload[plen++] = flen & 0xff;
+        memcpy(payload + plen, ax25_get_frame_data_ptr(pp[i]), flen);
+        plen += flen;
+    }
+
+    if (il2p_type_0_header(pp[0], plen, hdr) < 0)
+    {
+        return -1;
+    }
+
+    encoded[0] = (IL2P_SYNC_WORD >> 16) & 0xff;
+    encoded[1] = (IL2P_SYNC_WORD >> 8) & 0xff;
+    encoded[2] = (IL2P_SYNC_WORD)&0xff;
+
+    unsigned char *pout = encoded + IL2P_SYNC_WORD_SIZE;
+
+    il2p_scramble_block(hdr, pout, IL2P_HEADER_SIZE);
+    il2p_encode_rs(pout, IL2P_HEADER_SIZE, IL2P_HEADER_PARITY, pout + IL2P_HEADER_SIZE);
+
+    int elen = IL2P_SYNC_WORD_SIZE + IL2P_HEADER_SIZE + IL2P_HEADER_PARITY;
+    int k = il2p_encode_payload(payload, plen, 0, encoded + elen);
+
+    if (k <= 0)
+    {
+        return -1;
+    }
+
+    elen += k;
+
+    tx_frame_octets(P, tx_data_mode(P), encoded, elen);
+
+    return elen * 8;
+}
+
+/*
+ * Called ahead of a frame that is sent on its own.
+ * If aggregation, ADAPTIVE or INTERLEAVE is enabled and the
+ * destination has not heard from us lately, send an empty
+ * aggregate burst to announce it.
+ *
+ * Returns number of bits sent.
+ */
+int il2p_aggregate_advertise(struct port_s *P, packet_t pp)
+{
+    if ((P->audio->aggregate == false && P->audio->adaptive == false && P->audio->interleave == false) || peers_told(&pp, 1) == 0)
+    {
+        return 0;
+    }
+
+    int nb = send_aggregate(P, &pp, 0);
+
+    return (nb > 0) ? nb : 0;
+}
+
+/*
+ * The caller only passes frames that passed il2p_aggregate_ok()
+ */
+int il2p_send_aggregate(struct port_s *P, packet_t pp[], int count)
+{
+    peers_told(pp, count);
+
+    return send_aggregate(P, pp, count);
+}
+
+/*
+ * Called from il2p_rec_bit() when the header marks an aggregate
+ */
+void il2p_decode_aggregate(struct port_s *P, unsigned char *uhdr, int ext, unsigned char *epayload, int corrected)
+{
+    unsigned char payload[IL2P_MAX_PAYLOAD_SIZE];
+    char addrs[AX25_ADDRS][AX25_MAX_ADDR_LEN];
+
+    int plen = il2p_get_header_attributes(uhdr);
+
+    if (plen < 1)
+    {
+        return;
+    }
+
+    int failed = 0;
+
+    bool ok = (il2p_decode_payload(epayload, plen, ext, payload, &corrected, &failed) == plen);
+
+    il2p_adapt_corrected(P, uhdr, ext, corrected, failed);
+
+    if (ok == false)
+    {
+        return;
+    }
+
+    /*
+     * The sender takes aggregates, or extensions, remember that
+     */
+    if (il2p_decode_header_addrs(uhdr, addrs, corrected) == 0)
+    {
+        if (payload[0] & IL2P_AGG_ACCEPT)
+        {
+            il2p_mutex_lock(&peer_mutex);
+
+            find_peer(addrs[AX25_SOURCE], true)->heard = dtime_now();
+
+            il2p_mutex_unlock(&peer_mutex);
+        }
+
+        if (payload[0] & IL2P_AGG_EXTEND)
+        {
+            il2p_adapt_extends(P, addrs[AX25_SOURCE]);
+        }
+    }
+
+    int i = 1;
+
+    while (i + 2 <= plen)
+    {
+        int flen = (payload[i] << 8) | payload[i + 1];
+
+        i += 2;
+
+        if (i + flen > plen)
+        {
+            fprintf(stderr, "IL2P: Aggregate frame length %d overruns payload\n", flen);
+            return;
+        }
+
+        packet_t pp = ax25_from_frame(payload + i, flen);
+
+        if (pp != NULL)
+        {
+            il2p_rec_trace(P, pp);
+            dlq_rec_frame(P, pp);
+        }
+
+        i += flen;
+    }
+}
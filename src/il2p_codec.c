@@ -17,7 +17,13 @@
 #include "il2p.h"
 #include "demod.h"
 
-int il2p_encode_frame(packet_t pp, unsigned char *iout)
+/*
+ * The extension octet, 0 for none, only goes
+ * with a payload as it describes the payload.
+ * The one that went, if any, is put in sent_ext
+ * unless it is NULL.
+ */
+int il2p_encode_frame(packet_t pp, int ext, unsigned char *iout, int *sent_ext)
 {
     unsigned char hdr[IL2P_HEADER_SIZE + IL2P_HEADER_PARITY];
 
@@ -26,6 +32,21 @@ int il2p_encode_frame(packet_t pp, unsigned char *iout)
     if (e < 0)
         return -1;
 
+    /*
+     * Interleaving is only for more than one payload block
+     */
+    if (e <= IL2P_MAX_BLOCK_DATA)
+        ext &= ~IL2P_EXT_INTERLEAVE;
+
+    if (e == 0)
+        ext = 0;
+
+    if (sent_ext != NULL)
+        *sent_ext = ext;
+
+    if (ext != 0)
+        il2p_set_header_extended(hdr);
+
     il2p_scramble_block(hdr, iout, IL2P_HEADER_SIZE);
     il2p_encode_rs(iout, IL2P_HEADER_SIZE, IL2P_HEADER_PARITY, iout + IL2P_HEADER_SIZE);
 
@@ -36,12 +57,20 @@ int il2p_encode_frame(packet_t pp, unsigned char *iout)
         return out_len;
     }
 
+    if (ext != 0)
+    {
+        iout[out_len] = ext;
+        il2p_encode_rs(iout + out_len, IL2P_EXT_SIZE, IL2P_EXT_PARITY, iout + out_len + IL2P_EXT_SIZE);
+
+        out_len += IL2P_EXT_SIZE + IL2P_EXT_PARITY;
+    }
+
     // Payload is AX.25 info part.
     unsigned char *pinfo;
 
     int info_len = ax25_get_info(pp, &pinfo);
 
-    int k = il2p_encode_payload(pinfo, info_len, iout + out_len);
+    int k = il2p_encode_payload(pinfo, info_len, ext, iout + out_len);
 
     if (k > 0)  // Success. Info part was <= 1023 bytes.
     {
@@ -58,11 +87,31 @@ packet_t il2p_decode_frame(unsigned char *irec)
 {
     unsigned char uhdr[IL2P_HEADER_SIZE];
     int e = il2p_clarify_header(irec, uhdr);
+    int ext = 0;
 
-    return il2p_decode_header_payload(uhdr, irec + IL2P_HEADER_SIZE + IL2P_HEADER_PARITY, &e);
+    if (e < 0)
+        return NULL;
+
+    irec += IL2P_HEADER_SIZE + IL2P_HEADER_PARITY;
+
+    if (il2p_get_header_extended(uhdr))
+    {
+        if (il2p_clarify_ext(irec, &ext) < 0)
+            return NULL;
+
+        irec += IL2P_EXT_SIZE + IL2P_EXT_PARITY;
+    }
+
+    int failed = 0;
+
+    return il2p_decode_header_payload(uhdr, ext, irec, &e, &failed);
 }
 
-packet_t il2p_decode_header_payload(unsigned char *uhdr, unsigned char *epayload, int *symbols_corrected)
+/*
+ * The symbols RS corrected in the payload are added to symbols_corrected,
+ * and the blocks it could not correct to blocks_failed
+ */
+packet_t il2p_decode_header_payload(unsigned char *uhdr, int ext, unsigned char *epayload, int *symbols_corrected, int *blocks_failed)
 {
     int payload_len = il2p_get_header_attributes(uhdr);
 
@@ -78,7 +127,7 @@ packet_t il2p_decode_header_payload(unsigned char *uhdr, unsigned char *epayload
         // This is the AX.25 Information part.
 
         unsigned char extracted[IL2P_MAX_PAYLOAD_SIZE];
-        int e = il2p_decode_payload(epayload, payload_len, extracted, symbols_corrected);
+        int e = il2p_decode_payload(epayload, payload_len, ext, extracted, symbols_corrected, blocks_failed);
 
         // It would be possible to have a good header but too many errors in the payload.
 
@@ -81,12 +81,16 @@ static int get_field(unsigned char *hdr, int bit_num, int lsb_index, int width)
     return result;
 }
 
+#define GET_FEC_LEVEL(hdr) get_field(hdr, 7, 0, 1)
+
 #define GET_UI(hdr) get_field(hdr, 6, 0, 1)
 
 #define GET_PID(hdr) get_field(hdr, 6, 4, 4)
 
 #define GET_CONTROL(hdr) get_field(hdr, 6, 11, 7)
 
+#define GET_HDR_TYPE(hdr) get_field(hdr, 7, 1, 1)
+
 #define GET_PAYLOAD_BYTE_COUNT(hdr) get_field(hdr, 7, 11, 10)
 
 static int encode_pid(packet_t pp)
@@ -155,12 +159,11 @@ static int decode_pid(int pid)
     return axpid[pid];
 }
 
-int il2p_type_1_header(packet_t pp, unsigned char *hdr)
+/*
+ * Destination and source addresses go into low bits 0-5 for bytes 0-11.
+ */
+static int encode_addrs(packet_t pp, unsigned char *hdr)
 {
-    memset(hdr, 0, IL2P_HEADER_SIZE);
-
-    // Destination and source addresses go into low bits 0-5 for bytes 0-11.
-
     char dst_addr[AX25_MAX_ADDR_LEN];
     char src_addr[AX25_MAX_ADDR_LEN];
 
@@ -197,6 +200,18 @@ int il2p_type_1_header(packet_t pp, unsigned char *hdr)
     // Byte 12 has DEST SSID in upper nibble and SRC SSID in lower nibble and
     hdr[12] = (dst_ssid << 4) | src_ssid;
 
+    return 0;
+}
+
+int il2p_type_1_header(packet_t pp, unsigned char *hdr)
+{
+    memset(hdr, 0, IL2P_HEADER_SIZE);
+
+    if (encode_addrs(pp, hdr) < 0)
+    {
+        return -1;
+    }
+
     ax25_frame_type_t frame_type;
     cmdres_t cr; // command or response.
     int pf;      // Poll/Final.
@@ -347,6 +362,38 @@ int il2p_type_1_header(packet_t pp, unsigned char *hdr)
     return info_len;
 }
 
+/*
+ * Header type 0 with PID 7 marks an aggregate burst.  The addresses
+ * are those of the first frame, so the sender can be identified
+ * even when the payload carries no frames.
+ */
+int il2p_type_0_header(packet_t pp, int payload_len, unsigned char *hdr)
+{
+    memset(hdr, 0, IL2P_HEADER_SIZE);
+
+    if (encode_addrs(pp, hdr) < 0)
+    {
+        return -1;
+    }
+
+    if (payload_len < 0 || payload_len > IL2P_MAX_PAYLOAD_SIZE)
+    {
+        return -2;
+    }
+
+    SET_PID(hdr, IL2P_PID_AGGREGATE);
+    SET_FEC_LEVEL(hdr, 1);
+    SET_HDR_TYPE(hdr, 0);
+    SET_PAYLOAD_BYTE_COUNT(hdr, payload_len);
+
+    return payload_len;
+}
+
+int il2p_is_aggregate(unsigned char *hdr)
+{
+    return (GET_HDR_TYPE(hdr) == 0 && GET_PID(hdr) == IL2P_PID_AGGREGATE);
+}
+
 static void trim(char *stuff)
 {
     char *p = stuff + strlen(stuff) - 1;
@@ -358,12 +405,11 @@ static void trim(char *stuff)
     }
 }
 
-packet_t il2p_decode_header_type_1(unsigned char *hdr, int num_sym_changed)
+/*
+ * Get the addresses including SSID.
+ */
+int il2p_decode_header_addrs(unsigned char *hdr, char addrs[][AX25_MAX_ADDR_LEN], int num_sym_changed)
 {
-    // First get the addresses including SSID.
-
-    char addrs[AX25_ADDRS][AX25_MAX_ADDR_LEN];
-
     memset(addrs, 0, 2 * AX25_MAX_ADDR_LEN);
 
     for (int i = 0; i <= 5; i++)
@@ -381,7 +427,7 @@ packet_t il2p_decode_header_type_1(unsigned char *hdr, int num_sym_changed)
             {
                 fprintf(stderr, "IL2P: Invalid character '%c' in destination address '%s'\n", addrs[AX25_DESTINATION][i], addrs[AX25_DESTINATION]);
             }
-            return NULL;
+            return -1;
         }
     }
 
@@ -402,12 +448,24 @@ packet_t il2p_decode_header_type_1(unsigned char *hdr, int num_sym_changed)
             {
                 fprintf(stderr, "IL2P: Invalid character '%c' in source address '%s'\n", addrs[AX25_SOURCE][i], addrs[AX25_SOURCE]);
             }
-            return NULL;
+            return -1;
         }
     }
 
     snprintf(addrs[AX25_SOURCE] + strlen(addrs[AX25_SOURCE]), 4, "-%d", hdr[12] & 0xf);
 
+    return 0;
+}
+
+packet_t il2p_decode_header_type_1(unsigned char *hdr, int num_sym_changed)
+{
+    char addrs[AX25_ADDRS][AX25_MAX_ADDR_LEN];
+
+    if (il2p_decode_header_addrs(hdr, addrs, num_sym_changed) < 0)
+    {
+        return NULL;
+    }
+
     // The PID field gives us the general type.
     // 0 = 'S' frame.
     // 1 = 'U' frame other than UI.
@@ -532,6 +590,98 @@ int il2p_get_header_attributes(unsigned char *hdr)
     return GET_PAYLOAD_BYTE_COUNT(hdr);
 }
 
+/*
+ * The FEC level is always max here, so when it
+ * is clear an extension octet follows the header
+ */
+int il2p_get_header_extended(unsigned char *hdr)
+{
+    return GET_FEC_LEVEL(hdr) == 0;
+}
+
+void il2p_set_header_extended(unsigned char *hdr)
+{
+    hdr[0] &= ~(1 << 7);
+}
+
+/*
+ * Header octets with their parity, and the extension if any
+ */
+int il2p_header_length(int ext)
+{
+    int length = IL2P_HEADER_SIZE + IL2P_HEADER_PARITY;
+
+    if (ext != 0)
+    {
+        length += IL2P_EXT_SIZE + IL2P_EXT_PARITY;
+    }
+
+    return length;
+}
+
+/*
+ * The payload modulation in the extension.  QPSK is 0, so a
+ * frame without one is QPSK, or DQPSK on a DQPSK port.
+ */
+static const int ext_modes[4] = {
+    Mode_QPSK,
+    Mode_BPSK,
+    Mode_8PSK,
+    Mode_QPSK // reserved
+};
+
+int il2p_ext_mode(int ext)
+{
+    return ext_modes[ext & IL2P_EXT_MODE];
+}
+
+int il2p_mode_ext(int mode)
+{
+    if (mode == Mode_BPSK)
+        return 1;
+
+    if (mode == Mode_8PSK)
+        return 2;
+
+    return 0;
+}
+
+/*
+ * The RS parity symbols per payload block in the extension.
+ * 16 is 0, so a frame without one has the max FEC.
+ */
+static const int ext_parity[4] = {16, 8, 6, 4};
+
+int il2p_ext_parity(int ext)
+{
+    return ext_parity[(ext & IL2P_EXT_FEC) >> 2];
+}
+
+int il2p_parity_ext(int parity)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        if (ext_parity[i] == parity)
+            return i << 2;
+    }
+
+    return 0;
+}
+
+/*
+ * Returns the symbols corrected, or -1
+ */
+int il2p_clarify_ext(unsigned char *rec_ext, int *ext)
+{
+    unsigned char corrected[IL2P_EXT_SIZE];
+
+    int e = il2p_decode_rs(rec_ext, IL2P_EXT_SIZE, IL2P_EXT_PARITY, corrected);
+
+    *ext = (e >= 0) ? corrected[0] : 0;
+
+    return e;
+}
+
 int il2p_clarify_header(unsigned char *rec_hdr, unsigned char *corrected_descrambled_hdr)
 {
     unsigned char corrected[IL2P_HEADER_SIZE + IL2P_HEADER_PARITY];
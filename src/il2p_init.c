@@ -69,10 +69,7 @@ struct rs *il2p_find_rs(int nparity)
 
 void il2p_encode_rs(unsigned char *tx_data, int data_size, int num_parity, unsigned char *parity_out)
 {
-    unsigned char rs_block[FEC_BLOCK_SIZE];
-    memset(rs_block, 0, sizeof(rs_block));
-    memcpy(rs_block + sizeof(rs_block) - data_size - num_parity, tx_data, data_size);
-    encode_rs_char(il2p_find_rs(num_parity), rs_block, parity_out);
+    encode_rs_char(il2p_find_rs(num_parity), tx_data, data_size, parity_out);
 }
 
 int il2p_decode_rs(unsigned char *rec_block, int data_size, int num_parity, unsigned char *out)
@@ -12,11 +12,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
 
 #include "ipnode.h"
 #include "il2p.h"
+#include "metrics.h"
 
-int il2p_payload_compute(il2p_payload_properties_t *p, int payload_size)
+/*
+ * The blocks are the same whatever the parity, which
+ * comes from the header extension ext, 0 for none
+ */
+int il2p_payload_compute(il2p_payload_properties_t *p, int payload_size, int ext)
 {
     memset(p, 0, sizeof(il2p_payload_properties_t));
 
@@ -30,12 +36,12 @@ int il2p_payload_compute(il2p_payload_properties_t *p, int payload_size)
     }
 
     p->payload_byte_count = payload_size;
-    p->payload_block_count = (p->payload_byte_count + 238) / 239;
+    p->payload_block_count = (p->payload_byte_count + IL2P_MAX_BLOCK_DATA - 1) / IL2P_MAX_BLOCK_DATA;
     p->small_block_size = p->payload_byte_count / p->payload_block_count;
     p->large_block_size = p->small_block_size + 1;
     p->large_block_count = p->payload_byte_count - (p->payload_block_count * p->small_block_size);
     p->small_block_count = p->payload_block_count - p->large_block_count;
-    p->parity_symbols_per_block = 16;
+    p->parity_symbols_per_block = il2p_ext_parity(ext);
 
     // Return the total size for the encoded format.
 
@@ -43,7 +49,55 @@ int il2p_payload_compute(il2p_payload_properties_t *p, int payload_size)
             p->large_block_count * (p->large_block_size + p->parity_symbols_per_block));
 }
 
-int il2p_encode_payload(unsigned char *payload, int payload_size, unsigned char *enc)
+/*
+ * The encoded blocks go out a byte of each in turn, so a burst of
+ * errors is shared among them, rather than all of it in one block
+ * while the others have correction to spare.  The large blocks
+ * come first and are one longer, so only they are in the last turn.
+ *
+ * blocks is the blocks one after the other, sent is as they are
+ * sent, and reverse takes them back.
+ */
+static void interleave(il2p_payload_properties_t *p, unsigned char *blocks, unsigned char *sent, bool reverse)
+{
+    int start[IL2P_MAX_PAYLOAD_BLOCKS];
+    int length[IL2P_MAX_PAYLOAD_BLOCKS];
+    int offset = 0;
+
+    for (int b = 0; b < p->payload_block_count; b++)
+    {
+        start[b] = offset;
+        length[b] = ((b < p->large_block_count) ? p->large_block_size : p->small_block_size) + p->parity_symbols_per_block;
+
+        offset += length[b];
+    }
+
+    int k = 0;
+
+    for (int i = 0; i < length[0]; i++)
+    {
+        for (int b = 0; b < p->payload_block_count; b++)
+        {
+            if (i >= length[b])
+                continue;
+
+            if (reverse == true)
+                blocks[start[b] + i] = sent[k++];
+            else
+                sent[k++] = blocks[start[b] + i];
+        }
+    }
+}
+
+/*
+ * A single block is never interleaved, so it costs it nothing
+ */
+static bool interleaved(il2p_payload_properties_t *p, int ext)
+{
+    return (ext & IL2P_EXT_INTERLEAVE) && p->payload_block_count > 1;
+}
+
+int il2p_encode_payload(unsigned char *payload, int payload_size, int ext, unsigned char *enc)
 {
     if (payload_size > IL2P_MAX_PAYLOAD_SIZE)
     {
@@ -58,35 +112,37 @@ int il2p_encode_payload(unsigned char *payload, int payload_size, unsigned char
 
     il2p_payload_properties_t ipp;
 
-    int e = il2p_payload_compute(&ipp, payload_size);
+    int e = il2p_payload_compute(&ipp, payload_size, ext);
 
     if (e <= 0)
     {
         return e;
     }
 
+    unsigned char blocks[IL2P_MAX_ENCODED_PAYLOAD_SIZE];
+
     unsigned char *pin = payload;
-    unsigned char *pout = enc;
+    unsigned char *pout = interleaved(&ipp, ext) ? blocks : enc;
 
     int encoded_length = 0;
-    
-    unsigned char scram[256];
-    unsigned char parity[IL2P_MAX_PARITY_SYMBOLS];
+
+    /*
+     * Scramble straight into the output and put the parity
+     * right behind each block, no bounce buffers unless
+     * the blocks are interleaved.
+     */
 
     // First the large blocks.
 
     for (int b = 0; b < ipp.large_block_count; b++)
     {
-        il2p_scramble_block(pin, scram, ipp.large_block_size);
-        memcpy(pout, scram, ipp.large_block_size);
+        il2p_scramble_block(pin, pout, ipp.large_block_size);
+        il2p_encode_rs(pout, ipp.large_block_size, ipp.parity_symbols_per_block, pout + ipp.large_block_size);
 
         pin += ipp.large_block_size;
         pout += ipp.large_block_size;
 
         encoded_length += ipp.large_block_size;
-        il2p_encode_rs(scram, ipp.large_block_size, ipp.parity_symbols_per_block, parity);
-
-        memcpy(pout, parity, ipp.parity_symbols_per_block);
 
         pout += ipp.parity_symbols_per_block;
         encoded_length += ipp.parity_symbols_per_block;
@@ -96,40 +152,70 @@ int il2p_encode_payload(unsigned char *payload, int payload_size, unsigned char
 
     for (int b = 0; b < ipp.small_block_count; b++)
     {
-        il2p_scramble_block(pin, scram, ipp.small_block_size);
-        memcpy(pout, scram, ipp.small_block_size);
+        il2p_scramble_block(pin, pout, ipp.small_block_size);
+        il2p_encode_rs(pout, ipp.small_block_size, ipp.parity_symbols_per_block, pout + ipp.small_block_size);
 
         pin += ipp.small_block_size;
         pout += ipp.small_block_size;
 
         encoded_length += ipp.small_block_size;
-        il2p_encode_rs(scram, ipp.small_block_size, ipp.parity_symbols_per_block, parity);
-
-        memcpy(pout, parity, ipp.parity_symbols_per_block);
 
         pout += ipp.parity_symbols_per_block;
         encoded_length += ipp.parity_symbols_per_block;
     }
 
+    if (interleaved(&ipp, ext))
+    {
+        interleave(&ipp, blocks, enc, false);
+    }
+
     return encoded_length;
 }
 
-int il2p_decode_payload(unsigned char *received, int payload_size, unsigned char *payload_out, int *symbols_corrected)
+/*
+ * Count a received block by the symbols RS corrected
+ */
+static void block_metrics(int corrected)
+{
+    if (corrected < 0)
+    {
+        metrics_add(METRIC_PAYLOAD_FAIL, 1);
+    }
+    else
+    {
+        metrics_add(METRIC_PAYLOAD_CORRECTED + ((corrected < METRICS_MAX_CORRECTED) ? corrected : METRICS_MAX_CORRECTED), 1);
+    }
+}
+
+/*
+ * The symbols corrected in the good blocks are added to
+ * symbols_corrected, and the blocks past correcting to
+ * blocks_failed
+ */
+int il2p_decode_payload(unsigned char *received, int payload_size, int ext, unsigned char *payload_out, int *symbols_corrected, int *blocks_failed)
 {
     // Determine number of blocks and sizes.
 
     il2p_payload_properties_t ipp;
 
-    int e = il2p_payload_compute(&ipp, payload_size);
+    int e = il2p_payload_compute(&ipp, payload_size, ext);
 
     if (e <= 0)
     {
         return e;
     }
 
+    unsigned char blocks[IL2P_MAX_ENCODED_PAYLOAD_SIZE];
+
     unsigned char *pin = received;
     unsigned char *pout = payload_out;
 
+    if (interleaved(&ipp, ext))
+    {
+        interleave(&ipp, blocks, received, true);
+        pin = blocks;
+    }
+
     int decoded_length = 0;
     int failed = 0;
 
@@ -144,9 +230,11 @@ int il2p_decode_payload(unsigned char *received, int payload_size, unsigned char
         int e = il2p_decode_rs(pin, ipp.large_block_size, ipp.parity_symbols_per_block, corrected_block);
 
         if (e < 0)
-            failed = 1;
+            failed++;
+        else
+            *symbols_corrected += e;
 
-        *symbols_corrected += e;
+        block_metrics(e);
 
         il2p_descramble_block(corrected_block, pout, ipp.large_block_size);
 
@@ -165,9 +253,11 @@ int il2p_decode_payload(unsigned char *received, int payload_size, unsigned char
         int e = il2p_decode_rs(pin, ipp.small_block_size, ipp.parity_symbols_per_block, corrected_block);
 
         if (e < 0)
-            failed = 1;
+            failed++;
+        else
+            *symbols_corrected += e;
 
-        *symbols_corrected += e;
+        block_metrics(e);
 
         il2p_descramble_block(corrected_block, pout, ipp.small_block_size);
 
@@ -177,6 +267,8 @@ int il2p_decode_payload(unsigned char *received, int payload_size, unsigned char
         decoded_length += ipp.small_block_size;
     }
 
+    *blocks_failed += failed;
+
     if (failed)
     {
         return -2;
@@ -12,24 +12,145 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
 
 #include "ipnode.h"
 #include "il2p.h"
 #include "demod.h"
 #include "dlq.h"
+#include "ax25_link.h"
+#include "metrics.h"
+#include "port.h"
 
-static struct il2p_context_s il2p_context;
+/*
+ * The frame being decoded got here
+ */
+void il2p_rec_trace(struct port_s *P, packet_t pp)
+{
+    pp->trace[TRACE_RX_SYNC] = P->il2p.sync_time;
+    pp->trace[TRACE_RX_HEADER] = P->il2p.header_time;
+    pp->trace[TRACE_RX_PAYLOAD] = dtime_now();
+}
 
 /*
- * Called from demod
+ * The dibit of each QPSK point after the point is turned
+ * 0, 1, 2 and 3 quarter turns counterclockwise
  */
-void il2p_rec_bit(int dbit)
+static const unsigned char turn_dibit[IL2P_TURNS][4] = {
+    {0, 1, 2, 3},
+    {1, 3, 0, 2},
+    {3, 2, 1, 0},
+    {2, 0, 3, 1}};
+
+static bool sync_match(unsigned int acc)
 {
-    struct il2p_context_s *F = &il2p_context;
-    packet_t pp;
-    int corrected; // not used
+    return __builtin_popcount(acc ^ IL2P_SYNC_WORD) <= 1; // allow single bit mismatch
+}
+
+static void sync_found(struct il2p_context_s *F)
+{
+    metrics_add(METRIC_SYNC_WORDS, 1);
+
+    F->sync_time = dtime_now();
+    F->state = IL2P_HEADER;
+    F->bc = 0;
+    F->hc = 0;
+    F->ext = 0;
+    F->mode = Mode_QPSK;
+}
+
+/*
+ * The header, and the extension if any, are in.
+ * How much payload is expected?
+ */
+static void payload_start(struct il2p_context_s *F)
+{
+    il2p_payload_properties_t plprop;
+
+    int len = il2p_get_header_attributes(F->uhdr);
+
+    F->eplen = il2p_payload_compute(&plprop, len, F->ext);
+    F->pc = 0;
+
+    if (F->eplen >= 1) // Need to gather payload.
+    {
+        F->mode = il2p_ext_mode(F->ext);
+        F->state = IL2P_PAYLOAD;
+    }
+    else if (F->eplen == 0) // No payload.
+    {
+        F->state = IL2P_DECODE;
+    }
+    else // Error.
+    {
+        F->state = IL2P_SEARCHING;
+    }
+}
+
+/*
+ * The modulation of the next symbol, which the demodulator
+ * asks for before each one.  Only the payload can differ,
+ * and it starts on a symbol, after a whole header octet.
+ */
+int il2p_rec_mode(struct port_s *P)
+{
+    struct il2p_context_s *F = &P->il2p;
+
+    return (F->state == IL2P_PAYLOAD) ? F->mode : Mode_QPSK;
+}
+
+/*
+ * Called from demod with each QPSK symbol
+ *
+ * The Costas loop can lock a quarter turn off, or two or
+ * three, and every symbol then decodes to the wrong dibit.
+ * So while searching, the sync word is also looked for in
+ * the symbols as they would be when turned.
+ *
+ * Returns the quarter turns, counterclockwise, that the
+ * rest of the frame needs, or 0.  Its dibits have not been
+ * turned, that is up to the demodulator.
+ */
+int il2p_rec_dibit(struct port_s *P, int dibit)
+{
+    struct il2p_context_s *F = &P->il2p;
 
-    memset(F, 0, sizeof(struct il2p_context_s));
+    for (int r = 1; r < IL2P_TURNS; r++)
+    {
+        F->tacc[r] = ((F->tacc[r] << 2) | turn_dibit[r][dibit & 0x3]) & 0x00ffffff;
+    }
+
+    if (F->state == IL2P_SEARCHING)
+    {
+        for (int r = 1; r < IL2P_TURNS; r++)
+        {
+            if (sync_match(F->tacc[r]) == true)
+            {
+                metrics_add(METRIC_SYNC_TURNED, 1);
+
+                F->acc = F->tacc[r];
+                sync_found(F);
+
+                return r;
+            }
+        }
+    }
+
+    il2p_rec_bit(P, (dibit >> 1) & 0x1);
+    il2p_rec_bit(P, dibit & 0x1);
+
+    return 0;
+}
+
+/*
+ * Called from il2p_rec_dibit(), or from demod for DQPSK, MSB first
+ */
+void il2p_rec_bit(struct port_s *P, int dbit)
+{
+    struct il2p_context_s *F = &P->il2p;
+    packet_t pp;
+    int corrected = 0;
+    int failed = 0;
 
     // Accumulate most recent 24 bits received.  Most recent is LSB.
 
@@ -41,11 +162,9 @@ void il2p_rec_bit(int dbit)
     {
     case IL2P_SEARCHING: // Searching for the sync word.
 
-        if (__builtin_popcount(F->acc ^ IL2P_SYNC_WORD) <= 1) // allow single bit mismatch
+        if (sync_match(F->acc) == true)
         {
-            F->state = IL2P_HEADER;
-            F->bc = 0;
-            F->hc = 0;
+            sync_found(F);
         }
         break;
 
@@ -65,28 +184,26 @@ void il2p_rec_bit(int dbit)
                 // Fix any errors and descramble.
                 int corrected = il2p_clarify_header(F->shdr, F->uhdr);
 
+                metrics_add((corrected >= 0) ? METRIC_HEADER_PASS : METRIC_HEADER_FAIL, 1);
+
                 if (corrected >= 0) // Good header.
                 {
-                    // How much payload is expected?
-                    il2p_payload_properties_t plprop;
-
-                    int len = il2p_get_header_attributes(F->uhdr);
+                    F->header_time = dtime_now();
 
-                    F->eplen = il2p_payload_compute(&plprop, len);
+                    /*
+                     * The signal of the sender, measured over the
+                     * header, for the modulation we send it
+                     */
+                    il2p_adapt_heard(P, F->uhdr, get_frame_snr(P));
 
-                    if (F->eplen >= 1) // Need to gather payload.
+                    if (il2p_get_header_extended(F->uhdr))
                     {
-                        F->pc = 0;
-                        F->state = IL2P_PAYLOAD;
+                        F->hc = 0;
+                        F->state = IL2P_EXTENSION;
                     }
-                    else if (F->eplen == 0) // No payload.
+                    else
                     {
-                        F->pc = 0;
-                        F->state = IL2P_DECODE;
-                    }
-                    else // Error.
-                    {
-                        F->state = IL2P_SEARCHING;
+                        payload_start(F);
                     }
                 }
                 else // corrected == -1
@@ -97,6 +214,30 @@ void il2p_rec_bit(int dbit)
         }
         break;
 
+    case IL2P_EXTENSION: // Gathering the extension octet.
+
+        F->bc++;
+
+        if (F->bc == 8)
+        {
+            F->bc = 0;
+
+            F->sext[F->hc++] = F->acc & 0xff;
+
+            if (F->hc == IL2P_EXT_SIZE + IL2P_EXT_PARITY)
+            {
+                if (il2p_clarify_ext(F->sext, &F->ext) >= 0)
+                {
+                    payload_start(F);
+                }
+                else
+                {
+                    F->state = IL2P_SEARCHING;
+                }
+            }
+        }
+        break;
+
     case IL2P_PAYLOAD: // Gathering the payload, if any.
 
         F->bc++;
@@ -116,11 +257,37 @@ void il2p_rec_bit(int dbit)
 
     case IL2P_DECODE:
 
-        pp = il2p_decode_header_payload(F->uhdr, F->spayload, &corrected);
+        if (il2p_is_aggregate(F->uhdr))
+        {
+            il2p_decode_aggregate(P, F->uhdr, F->ext, F->spayload, 0);
+
+            F->state = IL2P_SEARCHING;
+            break;
+        }
+
+        pp = il2p_decode_header_payload(F->uhdr, F->ext, F->spayload, &corrected, &failed);
+
+        /*
+         * The payload errors, for the parity of what we send back
+         */
+        if (pp != NULL || failed > 0)
+            il2p_adapt_corrected(P, F->uhdr, F->ext, corrected, failed);
 
         if (pp != NULL)
         {
-            dlq_rec_frame(pp);
+            /*
+             * The sender reads extensions too
+             */
+            if (il2p_get_header_extended(F->uhdr))
+            {
+                char addr[AX25_MAX_ADDR_LEN];
+
+                ax25_get_addr_with_ssid(pp, AX25_SOURCE, addr);
+                il2p_adapt_extends(P, addr);
+            }
+
+            il2p_rec_trace(P, pp);
+            dlq_rec_frame(P, pp);
         }
 
         F->state = IL2P_SEARCHING;
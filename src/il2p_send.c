@@ -21,19 +21,29 @@
 #include "audio.h"
 #include "rrc_fir.h"
 #include "constellation.h"
+#include "port.h"
 
 /*
- * Transmit bits are stored in tx_bits array
+ * Encode the frame, in the payload modulation chosen for
+ * its destination, and send it to the modulator
  */
-int il2p_send_frame(packet_t pp)
+int il2p_send_frame(struct port_s *P, packet_t pp)
 {
     unsigned char encoded[IL2P_MAX_PACKET_SIZE];
+    char addr[AX25_MAX_ADDR_LEN];
 
     encoded[0] = (IL2P_SYNC_WORD >> 16) & 0xff;
     encoded[1] = (IL2P_SYNC_WORD >> 8) & 0xff;
     encoded[2] = (IL2P_SYNC_WORD)&0xff;
 
-    int elen = il2p_encode_frame(pp, encoded + IL2P_SYNC_WORD_SIZE);
+    ax25_get_addr_with_ssid(pp, AX25_DESTINATION, addr);
+
+    int ext = il2p_adapt_ext(P, addr);
+
+    /*
+     * The extension sent can be less than asked for
+     */
+    int elen = il2p_encode_frame(pp, ext, encoded + IL2P_SYNC_WORD_SIZE, &ext);
 
     if (elen == -1)
     {
@@ -43,61 +53,74 @@ int il2p_send_frame(packet_t pp)
 
     elen += IL2P_SYNC_WORD_SIZE;
 
-    unsigned char tx_bits[elen * 8];
+    return il2p_send_encoded(P, ext, encoded, elen);
+}
 
-    for (int i = 0; i < (elen * 8); i++)
+/*
+ * Send an encoded frame, from the sync word, to the modulator.
+ * The header goes in the port's modulation and the payload in
+ * the one in the extension, ext.
+ *
+ * Returns the time on the air as bits at the QPSK rate.
+ */
+int il2p_send_encoded(struct port_s *P, int ext, unsigned char *encoded, int elen)
+{
+    int hlen = IL2P_SYNC_WORD_SIZE + il2p_header_length(ext);
+    int mode = il2p_ext_mode(ext);
+
+    if (mode == Mode_QPSK || hlen >= elen)
     {
-        tx_bits[i] = 0U;
+        tx_frame_octets(P, tx_data_mode(P), encoded, elen);
+
+        return elen * 8;
     }
 
-    int number_of_bits = 0;
+    tx_frame_octets(P, tx_data_mode(P), encoded, hlen);
+    tx_frame_octets(P, mode, encoded + hlen, elen - hlen);
 
-    /*
-     * Send byte to modulator MSB first
-     */
-    for (int j = 0; j < elen; j++)
-    {
-        unsigned char x = encoded[j];
+    int plen = (elen - hlen) * 8;
 
-        for (int k = 0; k < 8; k++)
-        {
-            tx_bits[(j * 8) + k] = (x & 0x80) != 0;
-            x <<= 1;
-        }
+    if (mode == Mode_8PSK)
+        plen = ((plen + 2) / 3) * 2; // symbols, two bits each at QPSK
+    else
+        plen *= 2;
 
-        number_of_bits += 8;
-    }
+    return (hlen * 8) + plen;
+}
 
-    tx_frame_bits(Mode_QPSK, tx_bits, number_of_bits);
+/*
+ * Send the training preamble for a txdelay to modulator.
+ * The transmitter plays a cached copy, see tx.c
+ */
+void il2p_send_preamble(struct port_s *P, int txdelay)
+{
+    unsigned char train[4];
+
+    for (int i = 0; i < 4; i++)
+    {
+        train[i] = (TRAIN_WORD >> (24 - (i * 8))) & 0xff;
+    }
 
-    return number_of_bits;
+    for (int n = tx_preamble_symbols(txdelay); n > 0; n -= TRAIN_SYMBOLS)
+    {
+        tx_frame_octets(P, Mode_QPSK, train, sizeof(train));
+    }
 }
 
 /*
- * Send txdelay and txtail flag bits to modulator
+ * Send txtail flag octets to modulator
  */
-void il2p_send_idle(int num_flags)
+void il2p_send_idle(struct port_s *P, int num_flags)
 {
-    int number_of_bits = 0;
+    unsigned char flags[64];
 
-    unsigned char tx_bits[num_flags * 8];  // one flag is 8-Bits
+    memset(flags, FLAG, sizeof(flags));
 
-    /*
-     * Send byte to modulator MSB first
-     */
-    for (int i = 0; i < num_flags; i++)
+    while (num_flags > 0)
     {
-        unsigned char x = FLAG;
+        int n = (num_flags < (int)sizeof(flags)) ? num_flags : (int)sizeof(flags);
 
-        for (int j = 0; j < 8; j++)
-        {
-            tx_bits[(i * 8) + j] = (x & 0x80) != 0;
-            x <<= 1;
-        }
-
-        number_of_bits += 8;
+        tx_frame_octets(P, Mode_BPSK, flags, n);
+        num_flags -= n;
     }
-
-    tx_frame_bits(Mode_BPSK, tx_bits, number_of_bits);
 }
-
@@ -41,23 +41,40 @@
 #include "costas_loop.h"
 #include "constellation.h"
 #include "rrc_fir.h"
+#include "metrics.h"
+#include "rt.h"
+#include "port.h"
 
 bool node_shutdown;
 
 #define IS_DIR_SEPARATOR(c) ((c) == '/')
 
-static struct audio_s audio_config;
+static struct audio_s audio_config[MAX_PORTS];
 static struct misc_config_s misc_config;
 static char *progname;
 
+static void usage()
+{
+    fprintf(stderr, "Usage: %s [-c config-file] [-f]\n", progname);
+    fprintf(stderr, "  -c  Configuration file name, default ipnode.conf\n");
+    fprintf(stderr, "  -f  Decode input file as fast as possible and report symbols/s\n");
+    exit(1);
+}
+
 /* Process control-C and window close events. */
 
 static void cleanup(int x)
 {
     node_shutdown = true; // kill tx/rx threads
 
-    ptt_term();
-    audio_close();
+    for (int i = 0; i < port_count(); i++)
+    {
+        if (port_get(i) != NULL)
+        {
+            ptt_term(port_get(i));
+            audio_close(port_get(i));
+        }
+    }
 
     SLEEP_SEC(1);
     exit(0);
@@ -67,6 +84,8 @@ int main(int argc, char *argv[])
 {
     char config_file[100];
     char input_file[80];
+    bool fast = false;
+    int opt;
 
     if (getuid() == 0 || geteuid() == 0)
     {
@@ -84,24 +103,29 @@ int main(int argc, char *argv[])
     // default name
     strlcpy(config_file, "ipnode.conf", sizeof(config_file));
 
-    config_init(config_file, &audio_config, &misc_config);
+    while ((opt = getopt(argc, argv, "c:fh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            strlcpy(config_file, optarg, sizeof(config_file));
+            break;
+
+        case 'f':
+            fast = true;
+            break;
+
+        default:
+            usage();
+        }
+    }
+
+    config_init(config_file, audio_config, &misc_config);
 
     strlcpy(input_file, "", sizeof(input_file));
 
     signal(SIGINT, cleanup);
 
-    /*
-     * Open the audio source
-     */
-    int err = audio_open(&audio_config);
-
-    if (err < 0)
-    {
-        fprintf(stderr, "Fatal: No audio device found\n");
-        SLEEP_SEC(5);
-        exit(1);
-    }
-
     createQPSKConstellation();
 
     /*
@@ -110,27 +134,49 @@ int main(int argc, char *argv[])
      */
     rrc_make(FS, RS, .35f);
 
-    /*
-     * Create a costas loop
-     *
-     * All terms are radians per sample.
-     *
-     * The loop bandwidth determins the lock range
-     * and should be set around TAU/100 to TAU/200
-     */
-    create_control_loop((TAU / 180.0f), -1.0f, 1.0f);
-
     node_shutdown = false;
 
+    rt_init(&misc_config.rt);    // before any threads
+    metrics_init(misc_config.metrics);
     dlq_init();
     ax25_link_init(&misc_config);
     il2p_init();
-    // ptt_init(&audio_config);          ///////////// disabled for debugging
-    tx_init(&audio_config);
-    rx_init(&audio_config);    // also inits demod and TED
+    il2p_aggregate_init();
+    il2p_adapt_init();
+
+    /*
+     * One audio, demod and tx pipeline for each port with an ADEVICE
+     */
+    for (int n = 0; n < MAX_PORTS; n++)
+    {
+        if (audio_config[n].defined == false)
+            continue;
+
+        audio_config[n].fast = fast;
+
+        struct port_s *P = port_new(n, &audio_config[n]);
+
+        if (audio_open(P) < 0)
+        {
+            fprintf(stderr, "Fatal: No audio device found for port %d\n", n);
+            SLEEP_SEC(5);
+            exit(1);
+        }
+
+        // ptt_init(P);          ///////////// disabled for debugging
+        tx_init(P);
+        rx_init(P);    // also inits demod, costas loop and TED
+    }
+
+    if (port_count() == 0)
+    {
+        fprintf(stderr, "Fatal: No audio device found\n");
+        SLEEP_SEC(5);
+        exit(1);
+    }
 
     kisspt_init();                    // kiss pseudo-terminal
-    kiss_frame_init(&audio_config);   // normal kiss
+    kiss_frame_init(audio_config);    // normal kiss
 
     // Run daemon process forever
 
@@ -139,11 +185,13 @@ int main(int argc, char *argv[])
     exit(EXIT_SUCCESS);
 }
 
-void app_process_rec_packet(packet_t pp)
+void app_process_rec_packet(struct port_s *P, packet_t pp)
 {
     unsigned char fbuf[AX25_MAX_PACKET_LEN];
 
     int flen = ax25_pack(pp, fbuf);
 
-    kisspt_send_rec_packet(KISS_CMD_DATA_FRAME, fbuf, flen); // KISS pseudo terminal
+    kisspt_send_rec_packet(P->number, KISS_CMD_DATA_FRAME, fbuf, flen); // KISS pseudo terminal
+
+    pp->trace[TRACE_RX_KISS] = dtime_now();
 }
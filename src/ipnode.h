@@ -43,8 +43,18 @@ extern "C"
  */
 #define FLAG 0b01010101
 
+/*
+ * Training preamble, 16 QPSK symbols MSB first, sent
+ * over and over for the txdelay.  See demod.c for why.
+ */
+#define TRAIN_WORD 0xFB5B4198
+#define TRAIN_SYMBOLS 16
+#define TRAIN_MIN_PERIODS 2
+
 #define Mode_BPSK 0
 #define Mode_QPSK 1
+#define Mode_DQPSK 2 // QPSK sent as phase changes, see tx_frame_octets()
+#define Mode_8PSK 3 // payloads only, see il2p_adapt.c
 
 /*
  * This method is much faster than using cexp()
@@ -55,7 +65,9 @@ extern "C"
 
 #define il2p_mutex_init(x) pthread_mutex_init(x, NULL)
 
-    void app_process_rec_packet(packet_t);
+    struct port_s;
+
+    void app_process_rec_packet(struct port_s *, packet_t);
 
 #ifdef __cplusplus
 }
@@ -20,9 +20,10 @@
 #include "kiss_frame.h"
 #include "tq.h"
 #include "tx.h"
+#include "ax25_link.h"
+#include "port.h"
 
-static void kiss_process_msg(unsigned char *, int, int);
-static int kiss_unwrap(unsigned char *, int, unsigned char *);
+static void kiss_process_msg(kiss_frame_t *, int);
 
 static struct audio_s *save_audio_config_p;
 
@@ -62,75 +63,44 @@ int kiss_encapsulate(unsigned char *in, int ilen, unsigned char *out)
     return olen;
 }
 
-static int kiss_unwrap(unsigned char *in, int ilen, unsigned char *out)
+/*
+ * Store one unescaped byte.  The first is the KISS command,
+ * the rest land directly in the frame buffer of the packet.
+ */
+static void kiss_put_byte(kiss_frame_t *kf, unsigned char chr)
 {
-    int olen = 0;
-    int escaped_mode = 0;
-
-    if (ilen < 2)
+    if (kf->kiss_len == 0)
     {
-        fprintf(stderr, "KISS message less than minimum length.\n");
-        return 0;
+        kf->kiss_port = (chr >> 4) & 0xf;
+        kf->kiss_cmd = chr & 0xf;
+        kf->kiss_len++;
+        return;
     }
 
-    if (in[ilen - 1] == FEND)
-    {
-        ilen--;
-    }
-    else
+    if (kf->kiss_cmd != KISS_CMD_DATA_FRAME)
     {
-        fprintf(stderr, "KISS frame should end with FEND.\n");
+        /* ignore all the other KISS bo-jive */
+        return;
     }
 
-    int j;
-
-    if (in[0] == FEND)
-    {
-        j = 1;
-    }
-    else
+    if (kf->kiss_len > AX25_MAX_PACKET_LEN)
     {
-        j = 0;
-    }
-
-    for (; j < ilen; j++)
-    {
-        unsigned char chr = in[j];
-
-        if (chr == FEND)
+        if (kf->kiss_len == AX25_MAX_PACKET_LEN + 1)
         {
-            fprintf(stderr, "KISS frame should not have FEND in the middle.\n");
+            fprintf(stderr, "KISS message exceeded maximum length.\n");
         }
 
-        if (escaped_mode)
-        {
-
-            if (chr == TFESC)
-            {
-                out[olen++] = FESC;
-            }
-            else if (chr == TFEND)
-            {
-                out[olen++] = FEND;
-            }
-            else
-            {
-                fprintf(stderr, "KISS protocol error.  Found 0x%02x after FESC.\n", chr);
-            }
+        kf->kiss_len = AX25_MAX_PACKET_LEN + 2;
+        return;
+    }
 
-            escaped_mode = 0;
-        }
-        else if (chr == FESC)
-        {
-            escaped_mode = 1;
-        }
-        else
-        {
-            out[olen++] = chr;
-        }
+    if (kf->pp == NULL)
+    {
+        kf->pp = ax25_new();
     }
 
-    return olen;
+    ax25_get_frame_data_ptr(kf->pp)[kf->kiss_len - 1] = chr;
+    kf->kiss_len++;
 }
 
 /*
@@ -146,7 +116,7 @@ void kiss_rec_byte(kiss_frame_t *kf, unsigned char chr, int client)
         if (chr == FEND)
         {
             kf->kiss_len = 0;
-            kf->kiss_msg[kf->kiss_len++] = chr;
+            kf->escaped_mode = 0;
             kf->state = KS_COLLECTING;
         }
         break;
@@ -154,64 +124,82 @@ void kiss_rec_byte(kiss_frame_t *kf, unsigned char chr, int client)
     case KS_COLLECTING: /* Frame collection in progress. */
         if (chr == FEND)
         {
-            unsigned char unwrapped[AX25_MAX_PACKET_LEN];
-
             /* End of frame. */
 
             if (kf->kiss_len == 0)
             {
-                /* Empty frame.  Starting a new one. */
-                kf->kiss_msg[kf->kiss_len++] = chr;
+                /* Empty frame.  Just go on collecting. */
                 return;
             }
 
-            if (kf->kiss_len == 1 && kf->kiss_msg[0] == FEND)
+            if (kf->escaped_mode)
             {
-                /* Empty frame.  Just go on collecting. */
-                return;
+                fprintf(stderr, "KISS protocol error.  Frame ended after FESC.\n");
             }
 
-            kf->kiss_msg[kf->kiss_len++] = chr;
-
-            int ulen = kiss_unwrap(kf->kiss_msg, kf->kiss_len, unwrapped);
-
-            kiss_process_msg(unwrapped, ulen, client);
+            kiss_process_msg(kf, client);
 
             kf->state = KS_SEARCHING;
             return;
         }
 
-        if (kf->kiss_len < MAX_KISS_LEN)
+        if (kf->escaped_mode)
         {
-            kf->kiss_msg[kf->kiss_len++] = chr;
+            if (chr == TFESC)
+            {
+                kiss_put_byte(kf, FESC);
+            }
+            else if (chr == TFEND)
+            {
+                kiss_put_byte(kf, FEND);
+            }
+            else
+            {
+                fprintf(stderr, "KISS protocol error.  Found 0x%02x after FESC.\n", chr);
+            }
+
+            kf->escaped_mode = 0;
+        }
+        else if (chr == FESC)
+        {
+            kf->escaped_mode = 1;
         }
         else
         {
-            fprintf(stderr, "KISS message exceeded maximum length.\n");
+            kiss_put_byte(kf, chr);
         }
     }
 }
 
-static void kiss_process_msg(unsigned char *kiss_msg, int kiss_len, int client)
+/*
+ * The packet is handed to the transmit queue of the port
+ * in the command byte as is, or kept for the next frame
+ * when it is not usable.
+ */
+static void kiss_process_msg(kiss_frame_t *kf, int client)
 {
-    int cmd = kiss_msg[0] & 0xf;
-    packet_t pp;
+    struct port_s *P;
 
-    /* ignore all the other KISS bo-jive */
-
-    switch (cmd)
+    switch (kf->kiss_cmd)
     {
     case KISS_CMD_DATA_FRAME: /* 0 = Data Frame */
 
-        pp = ax25_from_frame(kiss_msg + 1, kiss_len - 1);
+        P = port_get(kf->kiss_port);
 
-        if (pp == NULL)
+        if (P == NULL)
+        {
+            fprintf(stderr, "ERROR - KISS frame for port %d, which is not configured.\n", kf->kiss_port);
+        }
+        else if (kf->pp == NULL || ax25_set_frame_len(kf->pp, kf->kiss_len - 1) == 0)
         {
             fprintf(stderr, "ERROR - Invalid KISS data frame.\n");
         }
         else
         {
-            tq_append(TQ_PRIO_1_LO, pp);
+            kf->pp->trace[TRACE_TX_KISS] = dtime_now();
+
+            tq_append(P, TQ_PRIO_1_LO, kf->pp);
+            kf->pp = NULL;
         }
     }
 }
@@ -17,6 +17,7 @@ extern "C"
 #endif
 
 #include "audio.h"
+#include "ax25_pad.h"
 
 #define KISS_CMD_DATA_FRAME 0
 
@@ -31,13 +32,18 @@ extern "C"
         KS_COLLECTING
     };
 
-#define MAX_KISS_LEN 2048
-
+    /*
+     * KISS frames are unescaped straight into the frame
+     * buffer of the packet that goes on the transmit queue.
+     */
     typedef struct kiss_frame_s
     {
         enum kiss_state_e state;
+        int escaped_mode;
+        int kiss_port; // high nibble of the command byte
+        int kiss_cmd;
         int kiss_len;
-        unsigned char kiss_msg[MAX_KISS_LEN];
+        packet_t pp;
     } kiss_frame_t;
 
     void kiss_frame_init(struct audio_s *);
@@ -31,6 +31,8 @@
 #include "kiss_pt.h"
 #include "kiss_frame.h"
 #include "tx.h"
+#include "metrics.h"
+#include "rt.h"
 
 #define TMP_KISSTNC_SYMLINK "/tmp/kisstnc"
 
@@ -45,6 +47,7 @@ static int kisspt_open_pt();
 void kisspt_init()
 {
     pthread_t kiss_pterm_listen_tid;
+    pthread_attr_t attr;
 
     memset(&kf, 0, sizeof(kf));
 
@@ -52,7 +55,9 @@ void kisspt_init()
 
     if (pt_master_fd != -1)
     {
-        int e = pthread_create(&kiss_pterm_listen_tid, (pthread_attr_t *)NULL, kisspt_listen_thread, NULL);
+        rt_thread_attr(&attr);
+
+        int e = pthread_create(&kiss_pterm_listen_tid, &attr, kisspt_listen_thread, NULL);
 
         if (e != 0)
         {
@@ -140,7 +145,10 @@ static int kisspt_open_pt()
     return fd;
 }
 
-void kisspt_send_rec_packet(int kiss_cmd, unsigned char *fbuf, int flen)
+/*
+ * The port number goes in the high nibble of the command byte
+ */
+void kisspt_send_rec_packet(int port, int kiss_cmd, unsigned char *fbuf, int flen)
 {
     unsigned char kiss_buff[2 * AX25_MAX_PACKET_LEN + 2];
     int kiss_len;
@@ -167,7 +175,7 @@ void kisspt_send_rec_packet(int kiss_cmd, unsigned char *fbuf, int flen)
             flen = (int)(sizeof(stemp)) - 1;
         }
 
-        stemp[0] = kiss_cmd & 0x0F;
+        stemp[0] = ((port & 0x0F) << 4) | (kiss_cmd & 0x0F);
         memcpy(stemp + 1, fbuf, flen);
 
         kiss_len = kiss_encapsulate(stemp, flen + 1, kiss_buff);
@@ -184,6 +192,10 @@ void kisspt_send_rec_packet(int kiss_cmd, unsigned char *fbuf, int flen)
         fprintf(stderr, "Warning: KISS pseudo terminal write error: fd=%d, len=%d, write returned %d, errno = %d\n",
                 pt_master_fd, kiss_len, err, errno);
     }
+    else if (kiss_cmd == KISS_CMD_DATA_FRAME)
+    {
+        metrics_add(METRIC_KISS_FRAMES, 1);
+    }
 }
 
 static int kisspt_get()
@@ -229,6 +241,8 @@ static void *kisspt_listen_thread(void *arg)
 {
     unsigned char chr;
 
+    rt_thread_start(RT_THREAD_KISS, -1);
+
     while (1)
     {
         chr = kisspt_get();  // calls select() so waits for data
@@ -0,0 +1,686 @@
+/*
+ * loopback.c
+ *
+ * IP Node Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Two complete nodes on one host, connected back to back
+ * through the simulated channel:
+ *
+ *    client -> ax25_link -> tq -> tx -> channel -> rx -> dlq -> ax25_link -> client
+ *
+ * Each node is a child process with its own copy of the stack,
+ * using the pipe audio backend.  This process is the radio channel
+ * between them, in real time, so the link layer timers behave as
+ * they do on the air.  A half duplex radio hears nothing while it
+ * is transmitting.
+ *
+ * Node A connects to node B and sends a fixed amount of data in
+ * PACLEN sized I frames, keeping up to 2 * MAXFRAME outstanding.
+ * The result is one line with the goodput, the latency from
+ * handing a frame to the link until it is delivered, and the
+ * link retransmission counts.
+ *
+ * make loopback
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <complex.h>
+#include <sys/wait.h>
+#include <bsd/bsd.h>
+
+#include "ipnode.h"
+#include "audio.h"
+#include "ax25_pad.h"
+#include "ax25_link.h"
+#include "channel.h"
+#include "config.h"
+#include "constellation.h"
+#include "costas_loop.h"
+#include "dlq.h"
+#include "il2p.h"
+#include "port.h"
+#include "rrc_fir.h"
+#include "rx.h"
+#include "tx.h"
+
+#define TICK_MS 10
+#define TICK_SAMPLES (int)(FS * TICK_MS / 1000)
+#define POLL_MS 100      // sender asks its link how much is outstanding
+#define HEADER_LEN 12    // sequence number and time queued in each I frame
+
+bool node_shutdown;
+
+/*
+ * What a node sends back to us when it is done
+ */
+struct report_s
+{
+    bool failed;
+
+    /* Receiver */
+    int frames;
+    long bytes;
+    double seconds;
+    float latency[4]; // 50, 90, 99 percent and maximum
+
+    /* Sender */
+    struct dl_link_stats_s stats;
+};
+
+struct node_s
+{
+    char call[AX25_MAX_ADDR_LEN];
+    pid_t pid;
+    int to_node;   // node audio input
+    int from_node; // node audio output
+    int report;
+
+    /* Samples it has sent that are not on the air yet */
+    unsigned char *air;
+    int air_len;
+    int air_size;
+
+    struct channel_s ch; // the path into this node
+    bool reported;
+};
+
+static struct node_s nodes[2];
+
+static struct audio_s audio_config;
+static struct port_s *port;
+static struct misc_config_s misc_config;
+
+static long total_bytes = 8192;
+static int total_frames;
+
+/*
+ * State of the client in the node process
+ */
+static char link_addrs[AX25_ADDRS][AX25_MAX_ADDR_LEN];
+static bool is_sender;
+static int report_fd;
+static int next_seq;
+static bool done;
+
+static float *latencies;
+static int received;
+static long received_bytes;
+static double first_queued;
+static double last_delivered;
+
+void app_process_rec_packet(struct port_s *P, packet_t pp)
+{
+}
+
+static int frame_len(int seq)
+{
+    long left = total_bytes - (long)seq * misc_config.paclen;
+
+    return (left < misc_config.paclen) ? (int)left : misc_config.paclen;
+}
+
+static void send_report(struct report_s *r)
+{
+    if (done == false)
+    {
+        done = true;
+
+        if (write(report_fd, r, sizeof(struct report_s)) != sizeof(struct report_s))
+        {
+            fprintf(stderr, "Loopback: Could not send report: %s\n", strerror(errno));
+        }
+    }
+}
+
+static void client_link_established(int client, char *peer)
+{
+    if (is_sender == true)
+    {
+        dlq_link_stats_request(port, link_addrs, 0);
+    }
+}
+
+static void client_link_terminated(int client, char *peer)
+{
+    struct report_s r;
+
+    memset(&r, 0, sizeof(r));
+    r.failed = true;
+
+    send_report(&r);
+}
+
+static int compare_float(const void *a, const void *b)
+{
+    float x = *(const float *)a;
+    float y = *(const float *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Node B, the data is delivered in order exactly once
+ */
+static void client_rec_conn_data(int client, char *peer, int pid, char *data, int len)
+{
+    unsigned int seq;
+    double queued;
+
+    if (len < HEADER_LEN)
+    {
+        return;
+    }
+
+    seq = ((unsigned char)data[0] << 24) | ((unsigned char)data[1] << 16) |
+          ((unsigned char)data[2] << 8) | (unsigned char)data[3];
+    memcpy(&queued, data + 4, sizeof(double));
+
+    if (seq >= (unsigned int)total_frames)
+    {
+        fprintf(stderr, "Loopback: Bad sequence number %u\n", seq);
+        return;
+    }
+
+    last_delivered = dtime_now();
+
+    if (seq == 0)
+    {
+        first_queued = queued;
+    }
+
+    latencies[received++] = (float)(last_delivered - queued);
+    received_bytes += len;
+
+    if (received == total_frames)
+    {
+        struct report_s r;
+
+        memset(&r, 0, sizeof(r));
+
+        qsort(latencies, received, sizeof(float), compare_float);
+
+        r.frames = received;
+        r.bytes = received_bytes;
+        r.seconds = last_delivered - first_queued;
+        r.latency[0] = latencies[(int)(received * 0.50)];
+        r.latency[1] = latencies[(int)(received * 0.90)];
+        r.latency[2] = latencies[(int)(received * 0.99)];
+        r.latency[3] = latencies[received - 1];
+
+        send_report(&r);
+    }
+}
+
+/*
+ * Node A, keep the link busy until all the data is acknowledged
+ */
+static void client_link_stats(int client, char *peer, struct dl_link_stats_s *stats)
+{
+    char data[AX25_N1_PACLEN_MAX];
+
+    if (is_sender == false || stats->connected == false || done == true)
+    {
+        return;
+    }
+
+    if (next_seq == total_frames && stats->outstanding == 0)
+    {
+        struct report_s r;
+
+        memset(&r, 0, sizeof(r));
+        r.stats = *stats;
+
+        send_report(&r);
+        dlq_disconnect_request(port, link_addrs, 0);
+        return;
+    }
+
+    for (int n = stats->outstanding; n < 2 * misc_config.maxframe && next_seq < total_frames; n++)
+    {
+        int len = frame_len(next_seq);
+        double now = dtime_now();
+
+        data[0] = (next_seq >> 24) & 0xff;
+        data[1] = (next_seq >> 16) & 0xff;
+        data[2] = (next_seq >> 8) & 0xff;
+        data[3] = next_seq & 0xff;
+        memcpy(data + 4, &now, sizeof(double));
+
+        for (int i = HEADER_LEN; i < len; i++)
+        {
+            data[i] = (next_seq + i) & 0xff;
+        }
+
+        dlq_xmit_data_request(port, link_addrs, 0, AX25_PID_NO_LAYER_3, data, len);
+        next_seq++;
+    }
+}
+
+static const dl_client_t client = {
+    client_link_established,
+    client_link_terminated,
+    client_rec_conn_data,
+    client_link_stats};
+
+static void *poll_thread(void *arg)
+{
+    while (1)
+    {
+        SLEEP_MS(POLL_MS);
+        dlq_link_stats_request(port, link_addrs, 0);
+    }
+
+    return NULL;
+}
+
+/*
+ * The node process.  Audio is on stdin and stdout.
+ */
+static void run_node(struct node_s *self, struct node_s *peer, bool sender)
+{
+    strlcpy(audio_config.adevice_in, "-", sizeof(audio_config.adevice_in));
+    strlcpy(audio_config.adevice_out, "-", sizeof(audio_config.adevice_out));
+    strlcpy(audio_config.mycall, self->call, sizeof(audio_config.mycall));
+
+    port = port_new(0, &audio_config);
+
+    if (audio_open(port) < 0)
+    {
+        fprintf(stderr, "Loopback: Could not open pipe audio for %s\n", self->call);
+        exit(1);
+    }
+
+    createQPSKConstellation();
+    rrc_make(FS, RS, .35f);
+
+    node_shutdown = false;
+
+    dlq_init();
+    ax25_link_init(&misc_config);
+    ax25_link_set_client(&client);
+    il2p_init();
+    il2p_aggregate_init();
+    il2p_adapt_init();
+    tx_init(port);
+    rx_init(port);
+
+    memset(link_addrs, 0, sizeof(link_addrs));
+    strlcpy(link_addrs[AX25_SOURCE], self->call, AX25_MAX_ADDR_LEN);
+    strlcpy(link_addrs[AX25_DESTINATION], peer->call, AX25_MAX_ADDR_LEN);
+
+    is_sender = sender;
+
+    if (sender == true)
+    {
+        pthread_t tid;
+
+        dlq_connect_request(port, link_addrs, 0);
+
+        if (pthread_create(&tid, NULL, poll_thread, NULL) != 0)
+        {
+            fprintf(stderr, "Loopback: Could not create poll thread\n");
+            exit(1);
+        }
+    }
+    else
+    {
+        latencies = (float *)calloc(total_frames, sizeof(float));
+        dlq_register_callsign(self->call, 0);
+    }
+
+    rx_process();
+}
+
+static void start_node(struct node_s *self, struct node_s *peer, bool sender)
+{
+    int in[2], out[2], rep[2];
+
+    if (pipe(in) < 0 || pipe(out) < 0 || pipe(rep) < 0)
+    {
+        fprintf(stderr, "Loopback: pipe: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    self->pid = fork();
+
+    if (self->pid < 0)
+    {
+        fprintf(stderr, "Loopback: fork: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    if (self->pid == 0)
+    {
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        close(in[0]);
+        close(in[1]);
+        close(out[0]);
+        close(out[1]);
+        close(rep[0]);
+
+        if (peer->pid > 0)
+        {
+            close(peer->to_node);
+            close(peer->from_node);
+            close(peer->report);
+        }
+
+        report_fd = rep[1];
+        run_node(self, peer, sender);
+        exit(0);
+    }
+
+    close(in[0]);
+    close(out[1]);
+    close(rep[1]);
+
+    self->to_node = in[1];
+    self->from_node = out[0];
+    self->report = rep[0];
+
+    fcntl(self->from_node, F_SETFL, fcntl(self->from_node, F_GETFL) | O_NONBLOCK);
+    fcntl(self->report, F_SETFL, fcntl(self->report, F_GETFL) | O_NONBLOCK);
+}
+
+/*
+ * Take everything the node has transmitted so far
+ */
+static void read_node(struct node_s *n)
+{
+    while (1)
+    {
+        if (n->air_size - n->air_len < 65536)
+        {
+            n->air_size += 262144;
+            n->air = (unsigned char *)realloc(n->air, n->air_size);
+        }
+
+        int k = read(n->from_node, n->air + n->air_len, n->air_size - n->air_len);
+
+        if (k <= 0)
+        {
+            break;
+        }
+
+        n->air_len += k;
+    }
+}
+
+/*
+ * Put one tick of the peer's signal through the channel into the node
+ */
+static void write_node(struct node_s *n, complex float *signal, bool deaf)
+{
+    complex float out[TICK_SAMPLES * 2];
+    unsigned char pcm[TICK_SAMPLES * 2 * 4];
+    int count;
+
+    if (deaf == true)
+    {
+        count = TICK_SAMPLES;
+        memset(out, 0, sizeof(complex float) * count);
+    }
+    else
+    {
+        count = channel_process(&n->ch, signal, TICK_SAMPLES, out);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        float re = fmaxf(-1.0f, fminf(crealf(out[i]), 32767.0f / 32768.0f)) * 32768.0f;
+        float im = fmaxf(-1.0f, fminf(cimagf(out[i]), 32767.0f / 32768.0f)) * 32768.0f;
+        short pcm_I = (short)re;
+        short pcm_Q = (short)im;
+
+        pcm[i * 4] = pcm_I & 0xff;
+        pcm[i * 4 + 1] = (pcm_I >> 8) & 0xff;
+        pcm[i * 4 + 2] = pcm_Q & 0xff;
+        pcm[i * 4 + 3] = (pcm_Q >> 8) & 0xff;
+    }
+
+    if (write(n->to_node, pcm, count * 4) != count * 4)
+    {
+        fprintf(stderr, "Loopback: Node %s stopped\n", n->call);
+        exit(1);
+    }
+}
+
+/*
+ * Returns true if the node had something on the air this tick
+ */
+static bool take_tick(struct node_s *n, complex float *signal)
+{
+    int k = (n->air_len / 4 < TICK_SAMPLES) ? n->air_len / 4 : TICK_SAMPLES;
+
+    for (int i = 0; i < TICK_SAMPLES; i++)
+    {
+        if (i < k)
+        {
+            short pcm_I = n->air[i * 4] | (n->air[i * 4 + 1] << 8);
+            short pcm_Q = n->air[i * 4 + 2] | (n->air[i * 4 + 3] << 8);
+
+            signal[i] = CMPLXF((float)pcm_I, (float)pcm_Q) / 32768.0f;
+        }
+        else
+        {
+            signal[i] = 0.0f;
+        }
+    }
+
+    memmove(n->air, n->air + k * 4, n->air_len - k * 4);
+    n->air_len -= k * 4;
+
+    return k > 0;
+}
+
+static void usage(char *name)
+{
+    fprintf(stderr, "Usage: %s [options]\n", name);
+    fprintf(stderr, "  -n bytes      Data to send, default 8192\n");
+    fprintf(stderr, "  -l bytes      PACLEN, default %d\n", AX25_N1_PACLEN_DEFAULT);
+    fprintf(stderr, "  -k frames     MAXFRAME, default %d\n", AX25_K_MAXFRAME_DEFAULT);
+    fprintf(stderr, "  -f seconds    FRACK, default %d\n", AX25_T1V_FRACK_DEFAULT);
+    fprintf(stderr, "  -R count      RETRY, default %d\n", AX25_N2_RETRY_DEFAULT);
+    fprintf(stderr, "  -t ms         TXDELAY preamble, default 100\n");
+    fprintf(stderr, "  -A            Aggregate short frames\n");
+    fprintf(stderr, "  -e dB         Eb/N0, default none\n");
+    fprintf(stderr, "  -o Hz         Carrier offset\n");
+    fprintf(stderr, "  -P degrees    Carrier phase\n");
+    fprintf(stderr, "  -p ppm        Receiver sample clock error\n");
+    fprintf(stderr, "  -d ms         Second path delay, max %d\n", CHANNEL_MAX_DELAY_MS);
+    fprintf(stderr, "  -g dB         Second path level, default 0\n");
+    fprintf(stderr, "  -D Hz         Fading Doppler spread\n");
+    fprintf(stderr, "  -i rate       Impulses per second\n");
+    fprintf(stderr, "  -I dB         Impulse level over the signal, default 20\n");
+    fprintf(stderr, "  -T seconds    Give up after, default 600\n");
+    fprintf(stderr, "  -r seed       Random seed\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    struct channel_s settings;
+    struct report_s reports[2];
+    float signal_power = 0.0f;
+    int timeout = 600;
+    unsigned int seed = 1;
+    int opt;
+
+    memset(&audio_config, 0, sizeof(audio_config));
+    audio_config.defined = true;
+    audio_config.dwait = DEFAULT_DWAIT;
+    audio_config.slottime = DEFAULT_SLOTTIME;
+    audio_config.persist = DEFAULT_PERSIST;
+    audio_config.txdelay = DEFAULT_TXDELAY;
+    audio_config.txtail = DEFAULT_TXTAIL;
+    audio_config.fulldup = DEFAULT_FULLDUP;
+    audio_config.aggregate = DEFAULT_AGGREGATE;
+    audio_config.cpu = DEFAULT_CPU;
+
+    misc_config.frack = AX25_T1V_FRACK_DEFAULT;
+    misc_config.retry = AX25_N2_RETRY_DEFAULT;
+    misc_config.paclen = AX25_N1_PACLEN_DEFAULT;
+    misc_config.maxframe = AX25_K_MAXFRAME_DEFAULT;
+
+    channel_init(&settings, seed);
+
+    while ((opt = getopt(argc, argv, "n:l:k:f:R:t:Ae:o:P:p:d:g:D:i:I:T:r:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': total_bytes = atol(optarg); break;
+        case 'l': misc_config.paclen = atoi(optarg); break;
+        case 'k': misc_config.maxframe = atoi(optarg); break;
+        case 'f': misc_config.frack = atoi(optarg); break;
+        case 'R': misc_config.retry = atoi(optarg); break;
+        case 't': audio_config.txdelay = atoi(optarg) / 10; break;
+        case 'A': audio_config.aggregate = true; break;
+        case 'e': settings.ebn0_db = atof(optarg); break;
+        case 'o': settings.offset_hz = atof(optarg); break;
+        case 'P': settings.phase_deg = atof(optarg); break;
+        case 'p': settings.ppm = atof(optarg); break;
+        case 'd': settings.delay_ms = atof(optarg); break;
+        case 'g': settings.path2_db = atof(optarg); break;
+        case 'D': settings.doppler_hz = atof(optarg); break;
+        case 'i': settings.impulse_rate = atof(optarg); break;
+        case 'I': settings.impulse_db = atof(optarg); break;
+        case 'T': timeout = atoi(optarg); break;
+        case 'r': seed = strtoul(optarg, NULL, 0); break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if (total_bytes < 1 ||
+        misc_config.paclen < HEADER_LEN || misc_config.paclen > AX25_N1_PACLEN_MAX ||
+        misc_config.maxframe < AX25_K_MAXFRAME_MIN || misc_config.maxframe > AX25_K_MAXFRAME_MAX ||
+        misc_config.frack < AX25_T1V_FRACK_MIN || misc_config.frack > AX25_T1V_FRACK_MAX ||
+        misc_config.retry < AX25_N2_RETRY_MIN || misc_config.retry > AX25_N2_RETRY_MAX)
+    {
+        usage(argv[0]);
+    }
+
+    total_frames = (total_bytes + misc_config.paclen - 1) / misc_config.paclen;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    memset(nodes, 0, sizeof(nodes));
+    strlcpy(nodes[0].call, "NODEA-1", AX25_MAX_ADDR_LEN);
+    strlcpy(nodes[1].call, "NODEB-2", AX25_MAX_ADDR_LEN);
+
+    start_node(&nodes[1], &nodes[0], false);
+    start_node(&nodes[0], &nodes[1], true);
+
+    for (int i = 0; i < 2; i++)
+    {
+        struct channel_s *ch = &nodes[i].ch;
+
+        channel_init(ch, seed + i);
+
+        ch->ebn0_db = settings.ebn0_db;
+        ch->offset_hz = settings.offset_hz;
+        ch->phase_deg = settings.phase_deg;
+        ch->ppm = settings.ppm;
+        ch->delay_ms = settings.delay_ms;
+        ch->path2_db = settings.path2_db;
+        ch->doppler_hz = settings.doppler_hz;
+        ch->impulse_rate = settings.impulse_rate;
+        ch->impulse_db = settings.impulse_db;
+        ch->signal_power = 0.0f; // no noise until we know the signal level
+    }
+
+    double start = dtime_now();
+    double next = start;
+
+    while (nodes[0].reported == false || nodes[1].reported == false)
+    {
+        complex float signal[2][TICK_SAMPLES];
+        bool on_air[2];
+
+        for (int i = 0; i < 2; i++)
+        {
+            read_node(&nodes[i]);
+            on_air[i] = take_tick(&nodes[i], signal[i]);
+        }
+
+        for (int i = 0; i < 2; i++)
+        {
+            int peer = 1 - i;
+
+            if (signal_power == 0.0f && on_air[peer] == true)
+            {
+                signal_power = channel_signal_power(signal[peer], TICK_SAMPLES);
+                nodes[0].ch.signal_power = signal_power;
+                nodes[1].ch.signal_power = signal_power;
+            }
+
+            write_node(&nodes[i], signal[peer], on_air[i]);
+
+            if (nodes[i].reported == false &&
+                read(nodes[i].report, &reports[i], sizeof(struct report_s)) == sizeof(struct report_s))
+            {
+                nodes[i].reported = true;
+
+                if (reports[i].failed == true)
+                {
+                    break;
+                }
+            }
+        }
+
+        if ((nodes[0].reported && reports[0].failed) || (nodes[1].reported && reports[1].failed))
+        {
+            break;
+        }
+
+        if (dtime_now() - start > timeout)
+        {
+            fprintf(stderr, "Loopback: Timed out after %d seconds\n", timeout);
+            break;
+        }
+
+        next += TICK_MS / 1000.0;
+
+        double wait = next - dtime_now();
+
+        if (wait > 0.0)
+        {
+            usleep((useconds_t)(wait * 1000000.0));
+        }
+    }
+
+    kill(nodes[0].pid, SIGKILL);
+    kill(nodes[1].pid, SIGKILL);
+    waitpid(nodes[0].pid, NULL, 0);
+    waitpid(nodes[1].pid, NULL, 0);
+
+    printf("# paclen maxframe frack ebn0_db bytes seconds goodput_bps lat_p50 lat_p90 lat_p99 lat_max i_sent i_resent t1_expiries\n");
+
+    if (nodes[0].reported == false || nodes[1].reported == false || reports[0].failed || reports[1].failed)
+    {
+        printf("%d %d %d %.2f 0 %.1f 0.0 - - - - - - -\n", misc_config.paclen, misc_config.maxframe,
+               misc_config.frack, settings.ebn0_db, dtime_now() - start);
+        exit(1);
+    }
+
+    struct report_s *rx = &reports[1];
+    struct dl_link_stats_s *st = &reports[0].stats;
+
+    printf("%d %d %d %.2f %ld %.1f %.1f %.2f %.2f %.2f %.2f %d %d %d\n",
+           misc_config.paclen, misc_config.maxframe, misc_config.frack, settings.ebn0_db,
+           rx->bytes, rx->seconds, (rx->bytes * 8) / rx->seconds,
+           rx->latency[0], rx->latency[1], rx->latency[2], rx->latency[3],
+           st->i_frames_sent, st->i_frames_resent, st->t1_expiries);
+
+    exit(0);
+}
@@ -0,0 +1,776 @@
+/*
+ * metrics.c
+ *
+ * IP Node Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Runtime counters, read through a Unix domain socket.
+ *
+ * Each thread that counts something gets its own block of
+ * counters the first time it does, so adding to one is a plain
+ * load and store with nobody else writing the cache line.  The
+ * reader sums the blocks.  Threads past METRICS_MAX_THREADS share
+ * one last block with atomic adds.
+ *
+ * Frames carry the time they pass each trace point.  The time
+ * between points goes into HDR style histograms, read back as
+ * quantiles.
+ *
+ * A client connects, sends one line, and gets the counters back
+ * before the node closes the connection.  The line is "json" for
+ * JSON, anything else for Prometheus text.  HTTP GET also works,
+ * with json anywhere in the request line for JSON:
+ *
+ *    curl --unix-socket /tmp/ipnode.sock http://localhost/metrics
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <bsd/bsd.h>
+
+#include "ipnode.h"
+#include "ax25_pad.h"
+#include "ax25_link.h"
+#include "tq.h"
+#include "metrics.h"
+#include "port.h"
+#include "demod.h"
+#include "rt.h"
+
+#define REQUEST_MAX 1024
+
+extern bool node_shutdown;
+
+struct metrics_block_s
+{
+    _Alignas(64) _Atomic long count[METRIC_COUNT];
+};
+
+struct link_metrics_s
+{
+    char own[AX25_MAX_ADDR_LEN];
+    char peer[AX25_MAX_ADDR_LEN];
+    _Atomic long count[LINK_METRIC_COUNT];
+};
+
+static struct metrics_block_s blocks[METRICS_MAX_THREADS + 1]; // the last is shared
+static atomic_int blocks_claimed;
+static __thread struct metrics_block_s *my_block;
+
+static struct link_metrics_s links[METRICS_MAX_LINKS];
+static atomic_int links_used;
+
+static double start_time;
+
+static const struct
+{
+    const char *name;  // Prometheus family
+    const char *label; // NULL for none
+    const char *key;   // JSON
+    const char *help;
+    double scale;
+} info[METRIC_COUNT] = {
+    [METRIC_AUDIO_OVERRUNS] = {"ipnode_audio_overruns_total", NULL, "audio_overruns", "Audio capture overruns.", 1.0},
+    [METRIC_AUDIO_UNDERRUNS] = {"ipnode_audio_underruns_total", NULL, "audio_underruns", "Audio playback underruns.", 1.0},
+    [METRIC_CAPTURE_DROPPED] = {"ipnode_capture_dropped_bytes_total", NULL, "capture_dropped_bytes", "Audio bytes dropped with the capture ring full.", 1.0},
+    [METRIC_SYNC_WORDS] = {"ipnode_il2p_sync_words_total", NULL, "sync_words", "IL2P sync words found.", 1.0},
+    [METRIC_SYNC_TURNED] = {"ipnode_il2p_sync_words_turned_total", NULL, "sync_words_turned", "IL2P sync words found with the carrier a quarter turn or more off.", 1.0},
+    [METRIC_HEADER_PASS] = {"ipnode_il2p_headers_total", "result=\"pass\"", "headers_pass", "IL2P headers by RS decode result.", 1.0},
+    [METRIC_HEADER_FAIL] = {"ipnode_il2p_headers_total", "result=\"fail\"", "headers_fail", NULL, 1.0},
+    [METRIC_PAYLOAD_FAIL] = {"ipnode_il2p_payload_blocks_total", "corrected=\"fail\"", "payload_blocks_failed", "IL2P payload RS blocks by symbols corrected.", 1.0},
+    [METRIC_PAYLOAD_CORRECTED + 0] = {"ipnode_il2p_payload_blocks_total", "corrected=\"0\"", "payload_blocks_corrected_0", NULL, 1.0},
+    [METRIC_PAYLOAD_CORRECTED + 1] = {"ipnode_il2p_payload_blocks_total", "corrected=\"1\"", "payload_blocks_corrected_1", NULL, 1.0},
+    [METRIC_PAYLOAD_CORRECTED + 2] = {"ipnode_il2p_payload_blocks_total", "corrected=\"2\"", "payload_blocks_corrected_2", NULL, 1.0},
+    [METRIC_PAYLOAD_CORRECTED + 3] = {"ipnode_il2p_payload_blocks_total", "corrected=\"3\"", "payload_blocks_corrected_3", NULL, 1.0},
+    [METRIC_PAYLOAD_CORRECTED + 4] = {"ipnode_il2p_payload_blocks_total", "corrected=\"4\"", "payload_blocks_corrected_4", NULL, 1.0},
+    [METRIC_PAYLOAD_CORRECTED + 5] = {"ipnode_il2p_payload_blocks_total", "corrected=\"5\"", "payload_blocks_corrected_5", NULL, 1.0},
+    [METRIC_PAYLOAD_CORRECTED + 6] = {"ipnode_il2p_payload_blocks_total", "corrected=\"6\"", "payload_blocks_corrected_6", NULL, 1.0},
+    [METRIC_PAYLOAD_CORRECTED + 7] = {"ipnode_il2p_payload_blocks_total", "corrected=\"7\"", "payload_blocks_corrected_7", NULL, 1.0},
+    [METRIC_PAYLOAD_CORRECTED + 8] = {"ipnode_il2p_payload_blocks_total", "corrected=\"8\"", "payload_blocks_corrected_8", NULL, 1.0},
+    [METRIC_KISS_FRAMES] = {"ipnode_kiss_frames_total", NULL, "kiss_frames", "Frames delivered to the KISS client.", 1.0},
+    [METRIC_PTT_MICROSECONDS] = {"ipnode_ptt_seconds_total", NULL, "ptt_seconds", "Time with PTT on.", 1.0e-6},
+    [METRIC_T1_EXPIRIES] = {"ipnode_t1_expiries_total", NULL, "t1_expiries", "T1 expiries on all links.", 1.0},
+    [METRIC_I_FRAMES_SENT] = {"ipnode_i_frames_sent_total", NULL, "i_frames_sent", "I frames sent on all links.", 1.0},
+    [METRIC_I_FRAMES_RESENT] = {"ipnode_i_frames_resent_total", NULL, "i_frames_resent", "I frames sent again on all links.", 1.0},
+};
+
+static const struct
+{
+    const char *name;
+    const char *key;
+    const char *help;
+} gauge_info[GAUGE_COUNT] = {
+    [GAUGE_CAPTURE_FILL] = {"ipnode_capture_ring_bytes", "capture_ring_bytes", "Audio bytes waiting for the demodulator."},
+    [GAUGE_CAPTURE_HIGH_WATER] = {"ipnode_capture_ring_high_water_bytes", "capture_ring_high_water_bytes", "Most audio bytes ever waiting for the demodulator."},
+    [GAUGE_CAPTURE_PERIOD] = {"ipnode_capture_period_frames", "capture_period_frames", "Sound card input period."},
+    [GAUGE_PLAYBACK_PERIOD] = {"ipnode_playback_period_frames", "playback_period_frames", "Sound card output period."},
+};
+
+static _Atomic long gauges[MAX_PORTS][GAUGE_COUNT];
+
+static const struct
+{
+    const char *name;
+    const char *key;
+    enum metric_e total;
+} link_info[LINK_METRIC_COUNT] = {
+    [LINK_METRIC_T1_EXPIRIES] = {"ipnode_link_t1_expiries_total", "t1_expiries", METRIC_T1_EXPIRIES},
+    [LINK_METRIC_I_FRAMES_SENT] = {"ipnode_link_i_frames_sent_total", "i_frames_sent", METRIC_I_FRAMES_SENT},
+    [LINK_METRIC_I_FRAMES_RESENT] = {"ipnode_link_i_frames_resent_total", "i_frames_resent", METRIC_I_FRAMES_RESENT},
+};
+
+/*
+ * HDR style histogram of microseconds: exact below 2 * HIST_SUB,
+ * then HIST_SUB buckets for each power of two, so every value is
+ * within 1/HIST_SUB of the bucket it lands in.
+ */
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 27 // 134 seconds
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct histogram_s
+{
+    _Atomic long bucket[HIST_BUCKETS];
+    _Atomic long count;
+    _Atomic long sum;
+    _Atomic long max;
+};
+
+/*
+ * A frame that joins a burst already on the air was queued after
+ * PTT on, so it has no queue to PTT span; queue to symbol covers it.
+ */
+static const struct
+{
+    const char *name;
+    enum trace_e from;
+    enum trace_e to;
+} spans[] = {
+    {"rx_sync_to_header", TRACE_RX_SYNC, TRACE_RX_HEADER},
+    {"rx_header_to_payload", TRACE_RX_HEADER, TRACE_RX_PAYLOAD},
+    {"rx_payload_to_dlq", TRACE_RX_PAYLOAD, TRACE_RX_DLQ},
+    {"rx_dlq_to_kiss", TRACE_RX_DLQ, TRACE_RX_KISS},
+    {"rx_dlq_to_link", TRACE_RX_DLQ, TRACE_RX_LINK},
+    {"rx_sync_to_kiss", TRACE_RX_SYNC, TRACE_RX_KISS},
+    {"tx_kiss_to_queue", TRACE_TX_KISS, TRACE_TX_QUEUE},
+    {"tx_queue_to_ptt", TRACE_TX_QUEUE, TRACE_TX_PTT},
+    {"tx_queue_to_symbol", TRACE_TX_QUEUE, TRACE_TX_SYMBOL},
+    {"tx_ptt_to_symbol", TRACE_TX_PTT, TRACE_TX_SYMBOL},
+    {"tx_symbol_to_drained", TRACE_TX_SYMBOL, TRACE_TX_DRAINED},
+    {"tx_drained_to_ptt_off", TRACE_TX_DRAINED, TRACE_TX_PTT_OFF},
+    {"tx_kiss_to_ptt_off", TRACE_TX_KISS, TRACE_TX_PTT_OFF},
+};
+
+#define SPAN_COUNT (int)(sizeof(spans) / sizeof(spans[0]))
+
+static struct histogram_s histograms[SPAN_COUNT];
+
+static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+#define QUANTILE_COUNT (int)(sizeof(quantiles) / sizeof(quantiles[0]))
+
+static int bucket_of(long us)
+{
+    if (us < 2 * HIST_SUB)
+    {
+        return (int)us;
+    }
+
+    if (us >= (1L << HIST_MAX_BITS))
+    {
+        us = (1L << HIST_MAX_BITS) - 1;
+    }
+
+    int shift = (63 - __builtin_clzl(us)) - HIST_SUB_BITS;
+
+    return (shift + 1) * HIST_SUB + (int)(us >> shift) - HIST_SUB;
+}
+
+/*
+ * Middle of the bucket
+ */
+static long bucket_value(int b)
+{
+    if (b < 2 * HIST_SUB)
+    {
+        return b;
+    }
+
+    int shift = b / HIST_SUB - 1;
+
+    return ((long)(HIST_SUB + b % HIST_SUB) << shift) + (1L << shift) / 2;
+}
+
+static void histogram_record(struct histogram_s *h, long us)
+{
+    atomic_fetch_add_explicit(&h->bucket[bucket_of(us)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, us, memory_order_relaxed);
+
+    long max = atomic_load_explicit(&h->max, memory_order_relaxed);
+
+    while (us > max && !atomic_compare_exchange_weak_explicit(&h->max, &max, us, memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+/*
+ * Microseconds, 0 when empty.  No more than the
+ * largest value seen, which the bucket middle can be.
+ */
+static long histogram_quantile(struct histogram_s *h, double q)
+{
+    long counts[HIST_BUCKETS];
+    long total = 0;
+
+    for (int b = 0; b < HIST_BUCKETS; b++)
+    {
+        counts[b] = atomic_load_explicit(&h->bucket[b], memory_order_relaxed);
+        total += counts[b];
+    }
+
+    long want = (long)ceil(q * total);
+    long seen = 0;
+
+    for (int b = 0; b < HIST_BUCKETS; b++)
+    {
+        seen += counts[b];
+
+        if (seen >= want && seen > 0)
+        {
+            long max = atomic_load_explicit(&h->max, memory_order_relaxed);
+            long value = bucket_value(b);
+
+            return (value < max) ? value : max;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Called with the trace of a frame when it is done with: on receive
+ * after the link layer has it, and on transmit after PTT off.
+ */
+void metrics_trace(double *trace)
+{
+    for (int s = 0; s < SPAN_COUNT; s++)
+    {
+        double from = trace[spans[s].from];
+        double to = trace[spans[s].to];
+
+        if (from > 0.0 && to >= from)
+        {
+            histogram_record(&histograms[s], (long)((to - from) * 1.0e6));
+        }
+    }
+}
+
+/*
+ * Called from any thread
+ */
+void metrics_add(enum metric_e m, long n)
+{
+    struct metrics_block_s *b = my_block;
+
+    if (b == NULL)
+    {
+        int i = atomic_fetch_add(&blocks_claimed, 1);
+
+        b = my_block = &blocks[(i < METRICS_MAX_THREADS) ? i : METRICS_MAX_THREADS];
+    }
+
+    if (b == &blocks[METRICS_MAX_THREADS])
+    {
+        atomic_fetch_add_explicit(&b->count[m], n, memory_order_relaxed);
+    }
+    else
+    {
+        long v = atomic_load_explicit(&b->count[m], memory_order_relaxed);
+
+        atomic_store_explicit(&b->count[m], v + n, memory_order_relaxed);
+    }
+}
+
+/*
+ * Called from any thread, the last value set for the port is reported
+ */
+void metrics_gauge(int port, enum gauge_e g, long value)
+{
+    if (port >= 0 && port < MAX_PORTS)
+    {
+        atomic_store_explicit(&gauges[port][g], value, memory_order_relaxed);
+    }
+}
+
+/*
+ * Called from the link state machine when it creates a link,
+ * so there is only one writer.  NULL when the table is full.
+ */
+struct link_metrics_s *metrics_link(char *own, char *peer)
+{
+    int used = atomic_load_explicit(&links_used, memory_order_relaxed);
+
+    for (int i = 0; i < used; i++)
+    {
+        if (strcmp(links[i].own, own) == 0 && strcmp(links[i].peer, peer) == 0)
+        {
+            return &links[i];
+        }
+    }
+
+    if (used == METRICS_MAX_LINKS)
+    {
+        return NULL;
+    }
+
+    strlcpy(links[used].own, own, sizeof(links[used].own));
+    strlcpy(links[used].peer, peer, sizeof(links[used].peer));
+
+    // the names are visible before the slot is
+    atomic_store_explicit(&links_used, used + 1, memory_order_release);
+
+    return &links[used];
+}
+
+/*
+ * Counts for the link and for the total of all links
+ */
+void metrics_link_add(struct link_metrics_s *lm, enum link_metric_e m, long n)
+{
+    if (lm != NULL)
+    {
+        long v = atomic_load_explicit(&lm->count[m], memory_order_relaxed);
+
+        atomic_store_explicit(&lm->count[m], v + n, memory_order_relaxed);
+    }
+
+    metrics_add(link_info[m].total, n);
+}
+
+static long metric_sum(enum metric_e m)
+{
+    int claimed = atomic_load_explicit(&blocks_claimed, memory_order_relaxed);
+    long sum = atomic_load_explicit(&blocks[METRICS_MAX_THREADS].count[m], memory_order_relaxed);
+
+    for (int i = 0; i < claimed && i < METRICS_MAX_THREADS; i++)
+    {
+        sum += atomic_load_explicit(&blocks[i].count[m], memory_order_relaxed);
+    }
+
+    return sum;
+}
+
+/*
+ * Frames or bytes waiting on every port
+ */
+static int tq_total(int prio, int bytes)
+{
+    int n = 0;
+
+    for (int i = 0; i < port_count(); i++)
+    {
+        if (port_get(i) != NULL)
+        {
+            n += tq_count(port_get(i), prio, NULL, NULL, bytes);
+        }
+    }
+
+    return n;
+}
+
+static void write_prometheus(FILE *fp)
+{
+    double uptime = dtime_now() - start_time;
+
+    for (int m = 0; m < METRIC_COUNT; m++)
+    {
+        if (info[m].help != NULL)
+        {
+            fprintf(fp, "# HELP %s %s\n", info[m].name, info[m].help);
+            fprintf(fp, "# TYPE %s counter\n", info[m].name);
+        }
+
+        if (info[m].label != NULL)
+        {
+            fprintf(fp, "%s{%s} %.12g\n", info[m].name, info[m].label, metric_sum(m) * info[m].scale);
+        }
+        else
+        {
+            fprintf(fp, "%s %.12g\n", info[m].name, metric_sum(m) * info[m].scale);
+        }
+    }
+
+    fprintf(fp, "# HELP ipnode_uptime_seconds Time since the node started.\n");
+    fprintf(fp, "# TYPE ipnode_uptime_seconds gauge\n");
+    fprintf(fp, "ipnode_uptime_seconds %.3f\n", uptime);
+
+    fprintf(fp, "# HELP ipnode_ptt_duty_cycle Fraction of the uptime with PTT on.\n");
+    fprintf(fp, "# TYPE ipnode_ptt_duty_cycle gauge\n");
+    fprintf(fp, "ipnode_ptt_duty_cycle %.6f\n", metric_sum(METRIC_PTT_MICROSECONDS) * 1.0e-6 / uptime);
+
+    for (int g = 0; g < GAUGE_COUNT; g++)
+    {
+        fprintf(fp, "# HELP %s %s\n", gauge_info[g].name, gauge_info[g].help);
+        fprintf(fp, "# TYPE %s gauge\n", gauge_info[g].name);
+
+        for (int i = 0; i < port_count(); i++)
+        {
+            if (port_get(i) != NULL)
+            {
+                fprintf(fp, "%s{port=\"%d\"} %ld\n", gauge_info[g].name, i, atomic_load_explicit(&gauges[i][g], memory_order_relaxed));
+            }
+        }
+    }
+
+    fprintf(fp, "# HELP ipnode_tq_frames Frames waiting in the transmit queue.\n");
+    fprintf(fp, "# TYPE ipnode_tq_frames gauge\n");
+
+    for (int p = 0; p < TQ_NUM_PRIO; p++)
+    {
+        fprintf(fp, "ipnode_tq_frames{prio=\"%d\"} %d\n", p, tq_total(p, 0));
+    }
+
+    fprintf(fp, "# HELP ipnode_tq_bytes Bytes waiting in the transmit queue.\n");
+    fprintf(fp, "# TYPE ipnode_tq_bytes gauge\n");
+
+    for (int p = 0; p < TQ_NUM_PRIO; p++)
+    {
+        fprintf(fp, "ipnode_tq_bytes{prio=\"%d\"} %d\n", p, tq_total(p, 1));
+    }
+
+    fprintf(fp, "# HELP ipnode_carrier_locked Costas loop locked, which is also the carrier detect.\n");
+    fprintf(fp, "# TYPE ipnode_carrier_locked gauge\n");
+
+    for (int i = 0; i < port_count(); i++)
+    {
+        if (port_get(i) != NULL)
+        {
+            fprintf(fp, "ipnode_carrier_locked{port=\"%d\"} %d\n", i, get_carrier_locked(port_get(i)));
+        }
+    }
+
+    fprintf(fp, "# HELP ipnode_carrier_lock_metric Mean square phase detector error, 0.36 with no lock.\n");
+    fprintf(fp, "# TYPE ipnode_carrier_lock_metric gauge\n");
+
+    for (int i = 0; i < port_count(); i++)
+    {
+        if (port_get(i) != NULL)
+        {
+            fprintf(fp, "ipnode_carrier_lock_metric{port=\"%d\"} %.4f\n", i, get_carrier_lock_metric(port_get(i)));
+        }
+    }
+
+    fprintf(fp, "# HELP ipnode_carrier_offset_hz Carrier frequency error the Costas loop has removed.\n");
+    fprintf(fp, "# TYPE ipnode_carrier_offset_hz gauge\n");
+
+    for (int i = 0; i < port_count(); i++)
+    {
+        if (port_get(i) != NULL)
+        {
+            fprintf(fp, "ipnode_carrier_offset_hz{port=\"%d\"} %.1f\n", i, get_offset_freq(port_get(i)));
+        }
+    }
+
+    fprintf(fp, "# HELP ipnode_latency_seconds Time a frame takes from one trace point to the next.\n");
+    fprintf(fp, "# TYPE ipnode_latency_seconds summary\n");
+
+    for (int s = 0; s < SPAN_COUNT; s++)
+    {
+        struct histogram_s *h = &histograms[s];
+
+        for (int q = 0; q < QUANTILE_COUNT; q++)
+        {
+            fprintf(fp, "ipnode_latency_seconds{span=\"%s\",quantile=\"%g\"} %.6f\n",
+                    spans[s].name, quantiles[q], histogram_quantile(h, quantiles[q]) * 1.0e-6);
+        }
+
+        fprintf(fp, "ipnode_latency_seconds_sum{span=\"%s\"} %.6f\n", spans[s].name,
+                atomic_load_explicit(&h->sum, memory_order_relaxed) * 1.0e-6);
+        fprintf(fp, "ipnode_latency_seconds_count{span=\"%s\"} %ld\n", spans[s].name,
+                atomic_load_explicit(&h->count, memory_order_relaxed));
+    }
+
+    fprintf(fp, "# HELP ipnode_latency_max_seconds Longest time seen between the trace points.\n");
+    fprintf(fp, "# TYPE ipnode_latency_max_seconds gauge\n");
+
+    for (int s = 0; s < SPAN_COUNT; s++)
+    {
+        fprintf(fp, "ipnode_latency_max_seconds{span=\"%s\"} %.6f\n", spans[s].name,
+                atomic_load_explicit(&histograms[s].max, memory_order_relaxed) * 1.0e-6);
+    }
+
+    int used = atomic_load_explicit(&links_used, memory_order_acquire);
+
+    for (int m = 0; m < LINK_METRIC_COUNT; m++)
+    {
+        fprintf(fp, "# TYPE %s counter\n", link_info[m].name);
+
+        for (int i = 0; i < used; i++)
+        {
+            fprintf(fp, "%s{own=\"%s\",peer=\"%s\"} %ld\n", link_info[m].name, links[i].own, links[i].peer,
+                    atomic_load_explicit(&links[i].count[m], memory_order_relaxed));
+        }
+    }
+}
+
+static void write_json(FILE *fp)
+{
+    double uptime = dtime_now() - start_time;
+
+    fprintf(fp, "{\"uptime_seconds\":%.3f", uptime);
+
+    for (int m = 0; m < METRIC_COUNT; m++)
+    {
+        fprintf(fp, ",\"%s\":%.12g", info[m].key, metric_sum(m) * info[m].scale);
+    }
+
+    fprintf(fp, ",\"ptt_duty_cycle\":%.6f", metric_sum(METRIC_PTT_MICROSECONDS) * 1.0e-6 / uptime);
+
+    fprintf(fp, ",\"audio\":[");
+
+    for (int i = 0, n = 0; i < port_count(); i++)
+    {
+        if (port_get(i) != NULL)
+        {
+            fprintf(fp, "%s{\"port\":%d", (n++ > 0) ? "," : "", i);
+
+            for (int g = 0; g < GAUGE_COUNT; g++)
+            {
+                fprintf(fp, ",\"%s\":%ld", gauge_info[g].key, atomic_load_explicit(&gauges[i][g], memory_order_relaxed));
+            }
+
+            fprintf(fp, "}");
+        }
+    }
+
+    fprintf(fp, "]");
+    fprintf(fp, ",\"tq_frames\":[%d,%d]", tq_total(TQ_PRIO_0_HI, 0), tq_total(TQ_PRIO_1_LO, 0));
+    fprintf(fp, ",\"tq_bytes\":[%d,%d]", tq_total(TQ_PRIO_0_HI, 1), tq_total(TQ_PRIO_1_LO, 1));
+    fprintf(fp, ",\"carrier\":[");
+
+    for (int i = 0, n = 0; i < port_count(); i++)
+    {
+        struct port_s *P = port_get(i);
+
+        if (P != NULL)
+        {
+            fprintf(fp, "%s{\"port\":%d,\"locked\":%d,\"lock_metric\":%.4f,\"offset_hz\":%.1f}", (n++ > 0) ? "," : "",
+                    i, get_carrier_locked(P), get_carrier_lock_metric(P), get_offset_freq(P));
+        }
+    }
+
+    fprintf(fp, "]");
+    fprintf(fp, ",\"latency_ms\":{");
+
+    for (int s = 0; s < SPAN_COUNT; s++)
+    {
+        struct histogram_s *h = &histograms[s];
+        long count = atomic_load_explicit(&h->count, memory_order_relaxed);
+        long sum = atomic_load_explicit(&h->sum, memory_order_relaxed);
+
+        fprintf(fp, "%s\"%s\":{\"count\":%ld,\"mean\":%.3f", (s > 0) ? "," : "", spans[s].name,
+                count, (count > 0) ? sum * 1.0e-3 / count : 0.0);
+
+        for (int q = 0; q < QUANTILE_COUNT; q++)
+        {
+            fprintf(fp, ",\"p%g\":%.3f", quantiles[q] * 100.0, histogram_quantile(h, quantiles[q]) * 1.0e-3);
+        }
+
+        fprintf(fp, ",\"max\":%.3f}", atomic_load_explicit(&h->max, memory_order_relaxed) * 1.0e-3);
+    }
+
+    fprintf(fp, "}");
+    fprintf(fp, ",\"links\":[");
+
+    int used = atomic_load_explicit(&links_used, memory_order_acquire);
+
+    for (int i = 0; i < used; i++)
+    {
+        fprintf(fp, "%s{\"own\":\"%s\",\"peer\":\"%s\"", (i > 0) ? "," : "", links[i].own, links[i].peer);
+
+        for (int m = 0; m < LINK_METRIC_COUNT; m++)
+        {
+            fprintf(fp, ",\"%s\":%ld", link_info[m].key, atomic_load_explicit(&links[i].count[m], memory_order_relaxed));
+        }
+
+        fprintf(fp, "}");
+    }
+
+    fprintf(fp, "]}\n");
+}
+
+/*
+ * Read the request: one line, or for HTTP everything up to the
+ * blank line, so nothing is left unread when the socket closes.
+ */
+static int read_request(int fd, char *request, int size)
+{
+    int len = 0;
+
+    while (len < size - 1)
+    {
+        int n = read(fd, request + len, size - 1 - len);
+
+        if (n <= 0)
+        {
+            break;
+        }
+
+        len += n;
+        request[len] = '\0';
+
+        if (strncmp(request, "GET ", 4) == 0)
+        {
+            if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL)
+            {
+                break;
+            }
+        }
+        else if (strchr(request, '\n') != NULL)
+        {
+            break;
+        }
+    }
+
+    request[len] = '\0';
+
+    return len;
+}
+
+static void *metrics_thread(void *arg)
+{
+    int listen_fd = (int)(intptr_t)arg;
+    char request[REQUEST_MAX];
+
+    while (node_shutdown == false)
+    {
+        int fd = accept(listen_fd, NULL, NULL);
+
+        if (fd < 0)
+        {
+            if (errno != EINTR)
+            {
+                fprintf(stderr, "Metrics socket accept error: %s\n", strerror(errno));
+                SLEEP_SEC(1);
+            }
+
+            continue;
+        }
+
+        // a client that never sends gets a second
+        struct timeval tv = {1, 0};
+
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        read_request(fd, request, sizeof(request));
+
+        char *eol = strchr(request, '\n');
+
+        if (eol != NULL)
+        {
+            *eol = '\0';
+        }
+
+        bool http = (strncmp(request, "GET ", 4) == 0);
+        bool json = (strstr(request, "json") != NULL);
+
+        FILE *fp = fdopen(fd, "w");
+
+        if (fp == NULL)
+        {
+            close(fd);
+            continue;
+        }
+
+        if (http == true)
+        {
+            fprintf(fp, "HTTP/1.0 200 OK\r\nContent-Type: %s\r\nConnection: close\r\n\r\n",
+                    json ? "application/json" : "text/plain; version=0.0.4");
+        }
+
+        if (json == true)
+        {
+            write_json(fp);
+        }
+        else
+        {
+            write_prometheus(fp);
+        }
+
+        fclose(fp);
+    }
+
+    return NULL;
+}
+
+/*
+ * The counters work without the socket.  path is empty
+ * when no METRICS line is in the config file.
+ */
+void metrics_init(char *path)
+{
+    struct sockaddr_un addr;
+    pthread_t metrics_tid;
+
+    start_time = dtime_now();
+
+    if (*path == '\0')
+    {
+        return;
+    }
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Metrics socket name %s is too long\n", path);
+        return;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0)
+    {
+        fprintf(stderr, "Could not create metrics socket: %s\n", strerror(errno));
+        return;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strlcpy(addr.sun_path, path, sizeof(addr.sun_path));
+
+    // left over from a previous run
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0)
+    {
+        fprintf(stderr, "Could not open metrics socket %s: %s\n", path, strerror(errno));
+        close(fd);
+        return;
+    }
+
+    pthread_attr_t attr;
+
+    rt_thread_attr(&attr);
+
+    int e = pthread_create(&metrics_tid, &attr, metrics_thread, (void *)(intptr_t)fd);
+
+    if (e != 0)
+    {
+        fprintf(stderr, "Could not create metrics thread\n");
+        close(fd);
+        return;
+    }
+
+    pthread_detach(metrics_tid);
+}
@@ -0,0 +1,91 @@
+/*
+ * metrics.h
+ *
+ * IP Node Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Most symbols one RS block can correct, 16 parity
+ */
+#define METRICS_MAX_CORRECTED 8
+
+#define METRICS_MAX_THREADS 16
+#define METRICS_MAX_LINKS 32
+
+    enum metric_e
+    {
+        METRIC_AUDIO_OVERRUNS,
+        METRIC_AUDIO_UNDERRUNS,
+        METRIC_CAPTURE_DROPPED,
+        METRIC_SYNC_WORDS,
+        METRIC_SYNC_TURNED,
+        METRIC_HEADER_PASS,
+        METRIC_HEADER_FAIL,
+        METRIC_PAYLOAD_FAIL,
+        METRIC_PAYLOAD_CORRECTED, // + symbols corrected in the block, up to METRICS_MAX_CORRECTED
+        METRIC_KISS_FRAMES = METRIC_PAYLOAD_CORRECTED + METRICS_MAX_CORRECTED + 1,
+        METRIC_PTT_MICROSECONDS,
+        METRIC_T1_EXPIRIES,
+        METRIC_I_FRAMES_SENT,
+        METRIC_I_FRAMES_RESENT,
+        METRIC_COUNT
+    };
+
+    enum link_metric_e
+    {
+        LINK_METRIC_T1_EXPIRIES,
+        LINK_METRIC_I_FRAMES_SENT,
+        LINK_METRIC_I_FRAMES_RESENT,
+        LINK_METRIC_COUNT
+    };
+
+    /*
+     * Points a frame passes on the way through, see metrics_trace()
+     */
+    enum trace_e
+    {
+        TRACE_RX_SYNC,     // sync word found
+        TRACE_RX_HEADER,   // header RS decoded
+        TRACE_RX_PAYLOAD,  // payload RS decoded
+        TRACE_RX_DLQ,      // queued for the link layer
+        TRACE_RX_KISS,     // written to the KISS client
+        TRACE_RX_LINK,     // lm_data_indication
+        TRACE_TX_KISS,     // read from the KISS client
+        TRACE_TX_QUEUE,    // transmit queue
+        TRACE_TX_PTT,      // PTT on for its burst
+        TRACE_TX_SYMBOL,   // first symbol modulated
+        TRACE_TX_DRAINED,  // audio output drained
+        TRACE_TX_PTT_OFF,  // PTT off
+        TRACE_COUNT
+    };
+
+    enum gauge_e
+    {
+        GAUGE_CAPTURE_FILL,       // bytes in the capture ring
+        GAUGE_CAPTURE_HIGH_WATER, // most it has held
+        GAUGE_CAPTURE_PERIOD,     // sound card frames per period
+        GAUGE_PLAYBACK_PERIOD,
+        GAUGE_COUNT
+    };
+
+    struct link_metrics_s;
+
+    void metrics_init(char *);
+    void metrics_add(enum metric_e, long);
+    void metrics_gauge(int, enum gauge_e, long);
+    struct link_metrics_s *metrics_link(char *, char *);
+    void metrics_link_add(struct link_metrics_s *, enum link_metric_e, long);
+    void metrics_trace(double *);
+
+#ifdef __cplusplus
+}
+#endif
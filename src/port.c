@@ -0,0 +1,71 @@
+/*
+ * port.c
+ *
+ * IP Node Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * The radio ports, numbered as the KISS client sees them.
+ * Each one carries all of its own receive and transmit state,
+ * so any number can run side by side in one process.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "port.h"
+
+static struct port_s *ports[MAX_PORTS];
+static int num_ports;
+
+/*
+ * Nothing is running on it until the caller starts it
+ */
+struct port_s *port_new(int number, struct audio_s *pa)
+{
+    if (number < 0 || number >= MAX_PORTS || ports[number] != NULL)
+    {
+        fprintf(stderr, "Fatal: Port %d is not 0 to %d, or is in use\n", number, MAX_PORTS - 1);
+        exit(1);
+    }
+
+    struct port_s *P = (struct port_s *)calloc(1, sizeof(struct port_s));
+
+    if (P == NULL)
+    {
+        fprintf(stderr, "Fatal: Could not allocate port\n");
+        exit(1);
+    }
+
+    P->number = number;
+    P->audio = pa;
+
+    ports[number] = P;
+
+    if (number >= num_ports)
+    {
+        num_ports = number + 1;
+    }
+
+    return P;
+}
+
+/*
+ * NULL if there is no such port, as there
+ * can be gaps in the numbers
+ */
+struct port_s *port_get(int n)
+{
+    if (n < 0 || n >= num_ports)
+        return NULL;
+
+    return ports[n];
+}
+
+/*
+ * One more than the highest port number
+ */
+int port_count()
+{
+    return num_ports;
+}
@@ -0,0 +1,46 @@
+/*
+ * port.h
+ *
+ * IP Node Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <pthread.h>
+
+#include "audio.h"
+#include "demod.h"
+#include "il2p.h"
+#include "tq.h"
+#include "tx.h"
+
+    /*
+     * Everything for one radio, from its sound card to its
+     * transmit queue.  The link layer is shared by all ports.
+     */
+    struct port_s
+    {
+        int number;            // KISS port
+        struct audio_s *audio; // its configuration
+        struct adev_s *adev;   // sound card or file, see audio.c
+        struct demod_s demod;
+        struct il2p_context_s il2p;
+        struct tq_s tq;
+        struct tx_s tx;
+        pthread_t rx_tid;
+    };
+
+    struct port_s *port_new(int, struct audio_s *);
+    struct port_s *port_get(int);
+    int port_count(void);
+
+#ifdef __cplusplus
+}
+#endif
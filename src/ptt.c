@@ -29,12 +29,12 @@
 #include "audio.h"
 #include "ptt.h"
 #include "dlq.h"
+#include "port.h"
 
 #define INVALID_HANDLE_VALUE (-1)
 
 #define MAX_GROUPS 50
 
-static struct audio_s *save_audio_config_p; /* Save config information for later use. */
 
 static void get_access_to_gpio(const char *path)
 {
@@ -157,7 +157,7 @@ static void get_access_to_gpio(const char *path)
     }
 }
 
-void export_gpio(int ot, int invert, int direction)
+void export_gpio(struct audio_s *pa, int ot, int invert, int direction)
 {
     const char gpio_export_path[] = "/sys/class/gpio/export";
     char gpio_direction_path[80];
@@ -168,13 +168,13 @@ void export_gpio(int ot, int invert, int direction)
 
     if (direction)
     {
-        gpio_num = save_audio_config_p->octrl[ot].out_gpio_num;
-        gpio_name = save_audio_config_p->octrl[ot].out_gpio_name;
+        gpio_num = pa->octrl[ot].out_gpio_num;
+        gpio_name = pa->octrl[ot].out_gpio_name;
     }
     else
     {
-        gpio_num = save_audio_config_p->ictrl[ot].in_gpio_num;
-        gpio_name = save_audio_config_p->ictrl[ot].in_gpio_name;
+        gpio_num = pa->ictrl[ot].in_gpio_num;
+        gpio_name = pa->ictrl[ot].in_gpio_name;
     }
 
     get_access_to_gpio(gpio_export_path);
@@ -312,9 +312,13 @@ void export_gpio(int ot, int invert, int direction)
 static int ptt_fd[NUM_OCTYPES];
 static char otnames[NUM_OCTYPES][8];
 
-void ptt_init(struct audio_s *audio_config_p)
+/*
+ * Each port has its own PTT, DCD, CON and SYN lines,
+ * taken from its section of the config file
+ */
+void ptt_init(struct port_s *P)
 {
-    save_audio_config_p = audio_config_p;
+    struct audio_s *audio_config_p = P->audio;
 
     strlcpy(otnames[OCTYPE_PTT], "PTT", sizeof(otnames[OCTYPE_PTT]));
     strlcpy(otnames[OCTYPE_DCD], "DCD", sizeof(otnames[OCTYPE_DCD]));
@@ -345,21 +349,22 @@ void ptt_init(struct audio_s *audio_config_p)
 
     for (int ot = 0; ot < NUM_OCTYPES; ot++)
     { // output control type, PTT, DCD, CON, SYN ...
-        export_gpio(ot, audio_config_p->octrl[ot].ptt_invert, 1);
+        export_gpio(audio_config_p, ot, audio_config_p->octrl[ot].ptt_invert, 1);
     }
 
     for (int it = 0; it < NUM_ICTYPES; it++)
     { // input control type
-        export_gpio(it, audio_config_p->ictrl[it].inh_invert, 0);
+        export_gpio(audio_config_p, it, audio_config_p->ictrl[it].inh_invert, 0);
     }
 }
 
-void ptt_set(int ot, int ptt_signal)
+void ptt_set(struct port_s *P, int ot, int ptt_signal)
 {
 #ifdef DEBUG_TX
+    struct audio_s *save_audio_config_p = P->audio;
     int ptt = ptt_signal;
 
-    dlq_channel_busy(ot, ptt_signal);
+    dlq_channel_busy(P, ot, ptt_signal);
 
     if (save_audio_config_p->octrl[ot].ptt_invert)
     {
@@ -395,8 +400,9 @@ void ptt_set(int ot, int ptt_signal)
 #endif
 }
 
-int get_input(int it)
+int get_input(struct port_s *P, int it)
 {
+    struct audio_s *save_audio_config_p = P->audio;
     char gpio_value_path[80];
 
     snprintf(gpio_value_path, sizeof(gpio_value_path), "/sys/class/gpio/%s/value", save_audio_config_p->ictrl[it].in_gpio_name);
@@ -440,12 +446,12 @@ int get_input(int it)
     return -1;
 }
 
-void ptt_term()
+void ptt_term(struct port_s *P)
 {
 #ifdef DEBUG_TX
     for (int ot = 0; ot < NUM_OCTYPES; ot++)
     {
-        ptt_set(ot, 0);
+        ptt_set(P, ot, 0);
     }
 
     for (int ot = 0; ot < NUM_OCTYPES; ot++)
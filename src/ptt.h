@@ -18,10 +18,12 @@ extern "C"
 
 #include "audio.h"
 
-    void ptt_init(struct audio_s *);
-    void ptt_set(int, int);
-    void ptt_term(void);
-    int get_input(int);
+    struct port_s;
+
+    void ptt_init(struct port_s *);
+    void ptt_set(struct port_s *, int, int);
+    void ptt_term(struct port_s *);
+    int get_input(struct port_s *, int);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,151 @@
+/*
+ * ring.c
+ *
+ * IP Node Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Lock free ring between one producer and one consumer thread.
+ *
+ * Each side owns one index and only reads the other's.  The
+ * release store of an index makes the bytes before it visible
+ * to the acquire load on the other side.  The semaphore is
+ * posted on every write, once per sound card period, and only
+ * waited on when the ring is empty.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "ring.h"
+
+/*
+ * size is rounded up to a power of two
+ */
+int ring_init(struct ring_s *r, int size)
+{
+    int n = 1;
+
+    while (n < size)
+    {
+        n <<= 1;
+    }
+
+    memset(r, 0, sizeof(struct ring_s));
+
+    r->buffer = (unsigned char *)malloc(n);
+
+    if (r->buffer == NULL)
+    {
+        fprintf(stderr, "ring_init: out of memory\n");
+        return -1;
+    }
+
+    r->mask = n - 1;
+
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->high_water, 0);
+    atomic_init(&r->closed, false);
+
+    sem_init(&r->data, 0, 0);
+
+    return 0;
+}
+
+void ring_free(struct ring_s *r)
+{
+    sem_destroy(&r->data);
+    free(r->buffer);
+    r->buffer = NULL;
+}
+
+/*
+ * Bytes waiting, from either side
+ */
+int ring_fill(struct ring_s *r)
+{
+    unsigned long tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    unsigned long head = atomic_load_explicit(&r->head, memory_order_acquire);
+
+    return (int)(head - tail);
+}
+
+/*
+ * Producer.  What doesn't fit is dropped, returns
+ * the number of bytes written.
+ */
+int ring_write(struct ring_s *r, unsigned char *data, int len)
+{
+    unsigned long head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    unsigned long tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    unsigned long size = r->mask + 1;
+    unsigned long space = size - (head - tail);
+    int n = (len < (long)space) ? len : (int)space;
+
+    int at = (int)(head & r->mask);
+    int first = ((unsigned long)(at + n) <= size) ? n : (int)(size - at);
+
+    memcpy(r->buffer + at, data, first);
+    memcpy(r->buffer, data + first, n - first);
+
+    atomic_store_explicit(&r->head, head + n, memory_order_release);
+
+    int fill = (int)(head + n - tail);
+
+    if (fill > atomic_load_explicit(&r->high_water, memory_order_relaxed))
+    {
+        atomic_store_explicit(&r->high_water, fill, memory_order_relaxed);
+    }
+
+    sem_post(&r->data);
+
+    return n;
+}
+
+/*
+ * Consumer.  Waits for at least one byte, returns
+ * 0 once the ring is closed and empty.
+ */
+int ring_read(struct ring_s *r, unsigned char *data, int len)
+{
+    unsigned long tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    unsigned long head;
+
+    while ((head = atomic_load_explicit(&r->head, memory_order_acquire)) == tail)
+    {
+        if (atomic_load_explicit(&r->closed, memory_order_acquire) == true)
+        {
+            return 0;
+        }
+
+        while (sem_wait(&r->data) != 0 && errno == EINTR)
+            ;
+    }
+
+    unsigned long size = r->mask + 1;
+    int avail = (int)(head - tail);
+    int n = (len < avail) ? len : avail;
+
+    int at = (int)(tail & r->mask);
+    int first = ((unsigned long)(at + n) <= size) ? n : (int)(size - at);
+
+    memcpy(data, r->buffer + at, first);
+    memcpy(data + first, r->buffer, n - first);
+
+    atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+
+    return n;
+}
+
+/*
+ * Producer is done, the consumer gets what is
+ * left and then end of input
+ */
+void ring_close(struct ring_s *r)
+{
+    atomic_store_explicit(&r->closed, true, memory_order_release);
+    sem_post(&r->data);
+}
@@ -0,0 +1,46 @@
+/*
+ * ring.h
+ *
+ * IP Node Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+
+    /*
+     * Single producer, single consumer byte ring
+     */
+    struct ring_s
+    {
+        unsigned char *buffer;
+        unsigned long mask; // size - 1, size a power of two
+
+        _Alignas(64) _Atomic unsigned long head; // producer only
+        _Atomic int high_water;
+
+        _Alignas(64) _Atomic unsigned long tail; // consumer only
+
+        _Atomic bool closed;
+        sem_t data;
+    };
+
+    int ring_init(struct ring_s *, int);
+    void ring_free(struct ring_s *);
+    int ring_write(struct ring_s *, unsigned char *, int);
+    int ring_read(struct ring_s *, unsigned char *, int);
+    int ring_fill(struct ring_s *);
+    void ring_close(struct ring_s *);
+
+#ifdef __cplusplus
+}
+#endif
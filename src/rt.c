@@ -0,0 +1,180 @@
+/*
+ * rt.c
+ *
+ * IP Node Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Real time scheduling, CPU pinning and memory locking for
+ * the threads that have to keep up with the sound card.
+ *
+ * The node does not run as root, so the user needs the limits
+ * for it, in /etc/security/limits.conf for example:
+ *
+ *    user  -  rtprio   95
+ *    user  -  memlock  unlimited
+ *
+ * Each setting that can't be had is reported and the node
+ * carries on without it.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "ipnode.h"
+#include "rt.h"
+
+static const char *thread_names[RT_THREAD_COUNT] = {
+    [RT_THREAD_CAPTURE] = "capture",
+    [RT_THREAD_RX] = "rx",
+    [RT_THREAD_TX] = "tx",
+    [RT_THREAD_KISS] = "kiss",
+    [RT_THREAD_LINK] = "link",
+};
+
+static struct rt_config_s *save_rt_config_p;
+
+void rt_defaults(struct rt_config_s *rt)
+{
+    rt->mlock = false;
+
+    for (int t = 0; t < RT_THREAD_COUNT; t++)
+    {
+        rt->thread[t].policy = SCHED_OTHER;
+        rt->thread[t].priority = 0;
+        rt->thread[t].cpu = -1;
+    }
+}
+
+/*
+ * Thread for a config file name, -1 if none
+ */
+int rt_thread_lookup(char *name)
+{
+    for (int t = 0; t < RT_THREAD_COUNT; t++)
+    {
+        if (strcasecmp(name, thread_names[t]) == 0)
+        {
+            return t;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Called before any of the threads are made
+ */
+void rt_init(struct rt_config_s *rt)
+{
+    save_rt_config_p = rt;
+
+    if (rt->mlock == false)
+    {
+        return;
+    }
+
+    /*
+     * Keep freed memory, so a later malloc doesn't have
+     * to fault new pages in, and use one arena, or each
+     * thread locks down 64 MB of its own
+     */
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    mallopt(M_ARENA_MAX, 1);
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        fprintf(stderr, "Could not lock memory: %s (check ulimit -l)\n", strerror(errno));
+    }
+}
+
+/*
+ * For pthread_create().  A small stack when memory is
+ * locked, or every thread pins down the default 8 MB.
+ */
+void rt_thread_attr(pthread_attr_t *attr)
+{
+    pthread_attr_init(attr);
+
+    if (save_rt_config_p != NULL && save_rt_config_p->mlock == true)
+    {
+        pthread_attr_setstacksize(attr, RT_STACK_KB * 1024);
+    }
+}
+
+static void __attribute__((noinline)) prefault_stack()
+{
+    volatile unsigned char stack[RT_PREFAULT_KB * 1024];
+    long page = sysconf(_SC_PAGESIZE);
+
+    for (long i = 0; i < (long)sizeof(stack); i += page)
+    {
+        stack[i] = 0;
+    }
+}
+
+/*
+ * Called by each thread as it starts.  A port's threads
+ * give its CPU, which wins over the one for the thread.
+ */
+void rt_thread_start(enum rt_thread_e t, int port_cpu)
+{
+    struct rt_config_s *rt = save_rt_config_p;
+
+    if (rt == NULL)
+    {
+        return;
+    }
+
+    struct rt_thread_s *th = &rt->thread[t];
+
+    if (rt->mlock == true)
+    {
+        prefault_stack();
+    }
+
+    int cpu = (port_cpu >= 0) ? port_cpu : th->cpu;
+
+    if (cpu >= 0)
+    {
+        cpu_set_t cpus;
+
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+
+        int e = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+        if (e != 0)
+        {
+            fprintf(stderr, "Could not pin %s thread to CPU %d: %s\n", thread_names[t], cpu, strerror(e));
+        }
+    }
+
+    if (th->policy != SCHED_OTHER)
+    {
+        struct sched_param param;
+
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = th->priority;
+
+        int e = pthread_setschedparam(pthread_self(), th->policy, &param);
+
+        if (e != 0)
+        {
+            fprintf(stderr, "Could not set %s thread to %s priority %d: %s (check ulimit -r)\n", thread_names[t],
+                    (th->policy == SCHED_FIFO) ? "FIFO" : "RR", th->priority, strerror(e));
+        }
+    }
+}
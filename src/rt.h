@@ -0,0 +1,53 @@
+/*
+ * rt.h
+ *
+ * IP Node Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#define RT_STACK_KB 256    // thread stacks
+#define RT_PREFAULT_KB 192 // of it touched at thread start
+
+    enum rt_thread_e
+    {
+        RT_THREAD_CAPTURE, // sound card to the capture ring
+        RT_THREAD_RX,      // demodulator
+        RT_THREAD_TX,      // modulator
+        RT_THREAD_KISS,    // KISS pseudo terminal
+        RT_THREAD_LINK,    // link layer, the main thread
+        RT_THREAD_COUNT
+    };
+
+    struct rt_thread_s
+    {
+        int policy;   // SCHED_OTHER, SCHED_FIFO or SCHED_RR
+        int priority; // 1 to 99 for FIFO and RR
+        int cpu;      // -1 for any
+    };
+
+    struct rt_config_s
+    {
+        bool mlock;
+        struct rt_thread_s thread[RT_THREAD_COUNT];
+    };
+
+    void rt_defaults(struct rt_config_s *);
+    int rt_thread_lookup(char *);
+    void rt_init(struct rt_config_s *);
+    void rt_thread_attr(pthread_attr_t *);
+    void rt_thread_start(enum rt_thread_e, int);
+
+#ifdef __cplusplus
+}
+#endif
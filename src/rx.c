@@ -24,30 +24,34 @@
 #include "rx.h"
 #include "ax25_link.h"
 #include "timing_error_detector.h"
+#include "metrics.h"
+#include "rt.h"
+#include "port.h"
 
 extern bool node_shutdown;
 
-static pthread_t xmit_tid;
-
 static void *rx_adev_thread(void *arg);
-static struct audio_s *save_pa; /* Keep pointer to audio configuration */
 
-void rx_init(struct audio_s *pa)
+/*
+ * The demodulator is ready before its thread starts
+ */
+void rx_init(struct port_s *P)
 {
-    save_pa = pa;
-
-    if (pa->defined == true)
+    if (P->audio->defined == true)
     {
-        int e = pthread_create(&xmit_tid, NULL, rx_adev_thread, 0);
+        demod_init(P);
+
+        pthread_attr_t attr;
+
+        rt_thread_attr(&attr);
+
+        int e = pthread_create(&P->rx_tid, &attr, rx_adev_thread, (void *)P);
 
         if (e != 0)
         {
-            fprintf(stderr, "Fatal: Could not create audio receive thread\n");
+            fprintf(stderr, "Fatal: Could not create audio receive thread for port %d\n", P->number);
             exit(1);
         }
-
-        create_timing_error_detector();
-        demod_init(pa);
     }
     else
     {
@@ -58,17 +62,32 @@ void rx_init(struct audio_s *pa)
 
 static void *rx_adev_thread(void *arg)
 {
+    struct port_s *P = (struct port_s *)arg;
     complex float csamples[CYCLES];
+    long symbols = 0;
+
+    rt_thread_start(RT_THREAD_RX, P->audio->cpu);
+
+    double start = dtime_now();
 
     while (node_shutdown == false)
     {
-        if (dcd_detect() == true)
+        if (demod_get_samples(P, csamples) == false)
         {
-            if (demod_get_samples(csamples) == true)
-            {
-                processSymbols(csamples);
-            }
+            break;
         }
+
+        processSymbols(P, csamples);
+        symbols++;
+    }
+
+    if (P->audio->fast == true)
+    {
+        double elapsed = dtime_now() - start;
+
+        fprintf(stderr, "\n%ld symbols in %.3f seconds, %.0f symbols/s, %.1f times real time\n",
+                symbols, elapsed, symbols / elapsed, (symbols / elapsed) / RS);
+        exit(0);
     }
 
     fprintf(stderr, "\nShutdown: Terminating after audio input closed.\n");
@@ -79,6 +98,8 @@ void rx_process()
 {
     struct dlq_item_s *pitem;
 
+    rt_thread_start(RT_THREAD_LINK, -1);
+
     while (1)
     {
         double timeout_value = ax25_link_get_next_timer_expiry();
@@ -98,8 +119,13 @@ void rx_process()
                 switch (pitem->type)
                 {
                 case DLQ_REC_FRAME:
-                    app_process_rec_packet(pitem->pp);
+                    app_process_rec_packet(pitem->port, pitem->pp);
                     lm_data_indication(pitem);
+
+                    if (pitem->pp != NULL)
+                    {
+                        metrics_trace(pitem->pp->trace);
+                    }
                     break;
 
                 case DLQ_CHANNEL_BUSY:
@@ -109,6 +135,30 @@ void rx_process()
                 case DLQ_SEIZE_CONFIRM:
                     lm_seize_confirm(pitem);
                     break;
+
+                case DLQ_TX_AIRTIME:
+                    lm_tx_airtime(pitem);
+                    break;
+
+                case DLQ_REGISTER_CALLSIGN:
+                    dl_register_callsign(pitem);
+                    break;
+
+                case DLQ_CONNECT_REQUEST:
+                    dl_connect_request(pitem);
+                    break;
+
+                case DLQ_DISCONNECT_REQUEST:
+                    dl_disconnect_request(pitem);
+                    break;
+
+                case DLQ_XMIT_DATA_REQUEST:
+                    dl_data_request(pitem);
+                    break;
+
+                case DLQ_LINK_STATS_REQUEST:
+                    dl_link_stats_request(pitem);
+                    break;
                 }
 
                 dlq_delete(pitem);
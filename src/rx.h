@@ -18,7 +18,9 @@ extern "C"
 
 #include "audio.h"
 
-    void rx_init(struct audio_s *);
+    struct port_s;
+
+    void rx_init(struct port_s *);
     float rx_dc_average(void);
     void rx_process(void);
 
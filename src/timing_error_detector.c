@@ -16,20 +16,11 @@
 #include "deque.h"
 #include "timing_error_detector.h"
 
-// BSS Storage
-
-static float d_error;
-static float d_prev_error;
-
-static int d_inputs_per_symbol;
-static int d_input_clock;
-
-static deque *d_input;
-
 // Prototypes
 
-static float compute_error(void);
-static void advance_input_clock(void);
+static float compute_error(struct ted_s *);
+static void advance_input_clock(struct ted_s *);
+static void push_samples(struct ted_s *);
 static float enormalize(float, float);
 
 // Functions
@@ -37,88 +28,175 @@ static float enormalize(float, float);
 /*
  * Revert the TED input clock one step
  */
-void revert_input_clock()
+void revert_input_clock(struct ted_s *T)
 {
-    if (d_input_clock == 0)
-        d_input_clock = d_inputs_per_symbol - 1;
+    if (T->d_input_clock == 0)
+        T->d_input_clock = T->d_inputs_per_symbol - 1;
     else
-        d_input_clock--;
+        T->d_input_clock--;
 }
 
 /*
  * Reset the TED input clock, so the next input clock advance
  * corresponds to a symbol sampling instant.
  */
-void sync_reset_input_clock()
+void sync_reset_input_clock(struct ted_s *T)
 {
-    d_input_clock = d_inputs_per_symbol - 1;
+    T->d_input_clock = T->d_inputs_per_symbol - 1;
 }
 
 /*
  * Advance the TED input clock, so the input() function will
  * compute the TED error term at the proper symbol sampling instant.
  */
-static void advance_input_clock()
+static void advance_input_clock(struct ted_s *T)
 {
-    d_input_clock = (d_input_clock + 1) % d_inputs_per_symbol;
+    T->d_input_clock = (T->d_input_clock + 1) % T->d_inputs_per_symbol;
+}
+
+/*
+ * The deque only holds pointers.  They point at d_samples, which
+ * is used in turn, so the samples outlive the caller's buffer.
+ */
+static void push_samples(struct ted_s *T)
+{
+    for (int i = 0; i < TED_SAMPLES; i++)
+    {
+        T->d_samples[i] = CMPLXF(0.0f, 0.0f);
+        push_front(T->d_input, &T->d_samples[i]);  // push 3 values (previous, current, middle)
+    }
+
+    T->d_next = 0; // the oldest
 }
 
 /*
  * Reset the timing error detector
  */
-void sync_reset()
+void sync_reset(struct ted_s *T)
 {
-    complex float data[1] = { CMPLXF(0.0f, 0.0f) };
+    T->d_error = 0.0f;
+    T->d_prev_error = 0.0f;
+    T->d_loop = 0.0f;
 
-    d_error = 0.0f;
-    d_prev_error = 0.0f;
+    /*
+     * Not empty_deque(), which would free() the samples
+     */
+    while (is_empty(T->d_input) == false)
+        pop_front(T->d_input);
 
-    empty_deque(d_input);
-    push_front(d_input, data);
-    push_front(d_input, data);
-    push_front(d_input, data);  // push 3 values (previous, current, middle)
+    push_samples(T);
 
-    sync_reset_input_clock();
+    sync_reset_input_clock(T);
 }
 
-void create_timing_error_detector()
+void create_timing_error_detector(struct ted_s *T)
 {
-    complex float data[1] = { CMPLXF(0.0f, 0.0f) };
+    T->d_error = 0.0f;
+    T->d_prev_error = 0.0f;
+    T->d_inputs_per_symbol = 2; // The input samples per symbol required
+
+    T->d_input = create_deque();
+    push_samples(T);
 
-    d_error = 0.0f;
-    d_prev_error = 0.0f;
-    d_inputs_per_symbol = 2; // The input samples per symbol required
+    sync_reset_input_clock(T);
 
-    d_input = create_deque();
-    push_front(d_input, data);
-    push_front(d_input, data);
-    push_front(d_input, data);  // push 3 values (previous, current, middle)
-    
-    sync_reset_input_clock();
+    T->d_power = 0.0f;
+    T->d_loop = 0.0f;
+    T->d_locked = false;
+
+    set_ted_gains(T, TED_ACQUIRE_GAIN, TED_TRACK_GAIN);
 }
 
-void destroy_timing_error_detector()
+void destroy_timing_error_detector(struct ted_s *T)
 {
-    free(d_input);
+    free(T->d_input);
 }
 
 /*
  * Provide a complex input sample to the TED algorithm
  *
  * @param x is pointer to the input sample
+ *
+ * Returns true at a symbol sample, when a new error is ready
+ */
+bool ted_input(struct ted_s *T, complex float *x)
+{
+    complex float *sample = &T->d_samples[T->d_next];
+
+    T->d_next = (T->d_next + 1) % TED_SAMPLES;
+    *sample = *x; // the oldest, thrown away below
+
+    push_front(T->d_input, sample);
+    pop_back(T->d_input); // throw away
+
+    advance_input_clock(T);
+
+    if (T->d_input_clock == 0)
+    {
+        float power = crealf(*x * conjf(*x));
+
+        T->d_power += TED_POWER_AVERAGE * (power - T->d_power);
+        T->d_prev_error = T->d_error;
+        T->d_error = compute_error(T);
+
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * Timing loop
+ *
+ * The error, in units of the symbol power so it does not
+ * depend on the audio level, is summed until it is worth
+ * one sample at the 9600 rate.  Returns the samples to add
+ * to the time of the next input, -1, 0 or +1.
  */
-void ted_input(complex float *x)
+int ted_loop(struct ted_s *T)
 {
-    push_front(d_input, x);
-    pop_back(d_input); // throw away
+    if (T->d_power <= TED_MIN_POWER)
+        return 0; // no signal
+
+    float error = T->d_error / T->d_power;
+
+    if (error > 1.0f)
+        error = 1.0f;
+    else if (error < -1.0f)
+        error = -1.0f;
 
-    advance_input_clock();
+    T->d_loop += T->d_gain * error;
 
-    if (d_input_clock == 0)
+    if (T->d_loop >= 1.0f)
     {
-        d_prev_error = d_error;
-        d_error = compute_error();
+        T->d_loop -= 1.0f;
+        return 1;
     }
+    else if (T->d_loop <= -1.0f)
+    {
+        T->d_loop += 1.0f;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Like the Costas loop, a high gain to pull in and
+ * a low one to track, chosen by the carrier lock
+ */
+void set_ted_gear(struct ted_s *T, bool locked)
+{
+    T->d_locked = locked;
+    T->d_gain = (locked == true) ? T->d_track_gain : T->d_acquire_gain;
+}
+
+void set_ted_gains(struct ted_s *T, float acquire_gain, float track_gain)
+{
+    T->d_acquire_gain = acquire_gain;
+    T->d_track_gain = track_gain;
+
+    set_ted_gear(T, T->d_locked);
 }
 
 /*
@@ -126,15 +204,15 @@ void ted_input(complex float *x)
  *
  * @param preserve_error If true, don't revert the error estimate.
  */
-void revert(bool preserve_error)
+void revert(struct ted_s *T, bool preserve_error)
 {
-    if (d_input_clock == 0 && preserve_error != true)
-        d_error = d_prev_error;
+    if (T->d_input_clock == 0 && preserve_error != true)
+        T->d_error = T->d_prev_error;
 
-    revert_input_clock();
+    revert_input_clock(T);
 
-    push_back(d_input, back(d_input));
-    pop_front(d_input);  // throw away
+    push_back(T->d_input, back(T->d_input));
+    pop_front(T->d_input);  // throw away
 }
 
 /*
@@ -166,11 +244,11 @@ static float enormalize(float error, float maximum)
  * The error value indicates if the symbol was sampled early (-)
  * or late (+) relative to the reference symbol
  */
-static float compute_error()
+static float compute_error(struct ted_s *T)
 {
-    complex float current =   *((complex float *)get(d_input, 0));
-    complex float middle =    *((complex float *)get(d_input, 1));
-    complex float previous =  *((complex float *)get(d_input, 2));
+    complex float current =   *((complex float *)get(T->d_input, 0));
+    complex float middle =    *((complex float *)get(T->d_input, 1));
+    complex float previous =  *((complex float *)get(T->d_input, 2));
 
     float errorInphase = (crealf(previous) - crealf(current)) * crealf(middle);
     float errorQuadrature = (cimagf(previous) - cimagf(current)) * cimagf(middle);
@@ -178,25 +256,35 @@ static float compute_error()
     return enormalize(errorInphase + errorQuadrature, 0.3f);
 }
 
-complex float getMiddleSample()
+complex float getMiddleSample(struct ted_s *T)
 {
-    return *((complex float *)get(d_input, 1));
+    return *((complex float *)get(T->d_input, 1));
 }
 
 /*
  * Return the current symbol timing error estimate
  */
-float get_error()
+float get_error(struct ted_s *T)
 {
-    return d_error;
+    return T->d_error;
 }
 
 /*
  * Return the number of input samples per symbol this timing
  * error detector algorithm requires.
  */
-int get_inputs_per_symbol()
+int get_inputs_per_symbol(struct ted_s *T)
+{
+    return T->d_inputs_per_symbol;
+}
+
+float get_ted_gain(struct ted_s *T)
+{
+    return T->d_gain;
+}
+
+bool get_ted_locked(struct ted_s *T)
 {
-    return d_inputs_per_symbol;
+    return T->d_locked;
 }
 
@@ -16,16 +16,55 @@ extern "C"
 #include <complex.h>
 #include <stdbool.h>
 
-void revert_input_clock(void);
-void sync_reset_input_clock(void);
-void sync_reset(void);
-void create_timing_error_detector(void);
-void destroy_timing_error_detector(void);
-void ted_input(complex float *);
-void revert(bool);
-complex float getMiddleSample(void);
-float get_error(void);
-int get_inputs_per_symbol(void);
+#include "deque.h"
+
+/*
+ * Timing loop gains, the filtered error in symbol power
+ * units that moves the sampling instant by one sample
+ */
+#define TED_ACQUIRE_GAIN 0.25f
+#define TED_TRACK_GAIN 0.05f
+#define TED_POWER_AVERAGE 0.01f
+#define TED_MIN_POWER 1.0e-6f
+
+#define TED_SAMPLES 3 // previous, middle, current
+
+/*
+ * One detector per receiver
+ */
+struct ted_s
+{
+    float d_error;
+    float d_prev_error;
+    int d_inputs_per_symbol;
+    int d_input_clock;
+    deque *d_input;
+    complex float d_samples[TED_SAMPLES]; // what d_input points to
+    int d_next;
+
+    float d_power;
+    float d_loop;
+    float d_gain;
+    float d_acquire_gain;
+    float d_track_gain;
+    bool d_locked;
+};
+
+void revert_input_clock(struct ted_s *);
+void sync_reset_input_clock(struct ted_s *);
+void sync_reset(struct ted_s *);
+void create_timing_error_detector(struct ted_s *);
+void destroy_timing_error_detector(struct ted_s *);
+bool ted_input(struct ted_s *, complex float *);
+int ted_loop(struct ted_s *);
+void set_ted_gear(struct ted_s *, bool);
+void set_ted_gains(struct ted_s *, float, float);
+void revert(struct ted_s *, bool);
+complex float getMiddleSample(struct ted_s *);
+float get_error(struct ted_s *);
+int get_inputs_per_symbol(struct ted_s *);
+float get_ted_gain(struct ted_s *);
+bool get_ted_locked(struct ted_s *);
 
 #ifdef __cplusplus
 }
@@ -19,44 +19,37 @@
 #include "ax25_pad.h"
 #include "audio.h"
 #include "tq.h"
+#include "ax25_link.h"
+#include "port.h"
 
-static packet_t queue_head[TQ_NUM_PRIO]; /* Head of linked list for each queue. */
-
-static pthread_mutex_t tq_mutex;
-static pthread_mutex_t wake_up_mutex; /* Required by cond_wait. */
-static pthread_cond_t wake_up_cond;   /* Notify transmit thread when queue not empty. */
-
-static bool xmit_thread_is_waiting;
-static struct audio_s *save_audio_config_p;
-
-static bool tq_is_empty()
+static bool tq_is_empty(struct tq_s *Q)
 {
     for (int p = 0; p < TQ_NUM_PRIO; p++)
     {
-        if (queue_head[p] != NULL)
+        if (Q->queue_head[p] != NULL)
             return false;
     }
 
     return true;
 }
 
-void tq_init(struct audio_s *audio_config_p)
+void tq_init(struct port_s *P)
 {
-    save_audio_config_p = audio_config_p;
+    struct tq_s *Q = &P->tq;
 
     for (int p = 0; p < TQ_NUM_PRIO; p++)
     {
-        queue_head[p] = NULL;
+        Q->queue_head[p] = NULL;
     }
 
     /*
      * Mutex to coordinate access to the queue.
      */
-    pthread_mutex_init(&tq_mutex, NULL);
+    pthread_mutex_init(&Q->tq_mutex, NULL);
 
-    xmit_thread_is_waiting = false;
+    Q->xmit_thread_is_waiting = false;
 
-    int err = pthread_cond_init(&wake_up_cond, NULL);
+    int err = pthread_cond_init(&Q->wake_up_cond, NULL);
 
     if (err != 0)
     {
@@ -64,14 +57,15 @@ void tq_init(struct audio_s *audio_config_p)
         exit(1);
     }
 
-    pthread_mutex_init(&wake_up_mutex, NULL);
+    pthread_mutex_init(&Q->wake_up_mutex, NULL);
 }
 
 /*
  * Called from kiss_frame
  */
-void tq_append(int prio, packet_t pp)
+void tq_append(struct port_s *P, int prio, packet_t pp)
 {
+    struct tq_s *Q = &P->tq;
     packet_t pnext;
 
     if (pp == NULL)
@@ -80,15 +74,17 @@ void tq_append(int prio, packet_t pp)
         return;
     }
 
-    il2p_mutex_lock(&tq_mutex);
+    pp->trace[TRACE_TX_QUEUE] = dtime_now();
+
+    il2p_mutex_lock(&Q->tq_mutex);
 
-    if (queue_head[prio] == NULL)
+    if (Q->queue_head[prio] == NULL)
     {
-        queue_head[prio] = pp;
+        Q->queue_head[prio] = pp;
     }
     else
     {
-        packet_t plast = queue_head[prio];
+        packet_t plast = Q->queue_head[prio];
 
         while ((pnext = ax25_get_nextp(plast)) != NULL)
         {
@@ -98,13 +94,13 @@ void tq_append(int prio, packet_t pp)
         ax25_set_nextp(plast, pp);
     }
 
-    il2p_mutex_unlock(&tq_mutex);
+    il2p_mutex_unlock(&Q->tq_mutex);
 
-    if (xmit_thread_is_waiting == true)
+    if (Q->xmit_thread_is_waiting == true)
     {
-        il2p_mutex_lock(&wake_up_mutex);
+        il2p_mutex_lock(&Q->wake_up_mutex);
 
-        int err = pthread_cond_signal(&wake_up_cond);
+        int err = pthread_cond_signal(&Q->wake_up_cond);
 
         if (err != 0)
         {
@@ -112,15 +108,16 @@ void tq_append(int prio, packet_t pp)
             exit(1);
         }
 
-        il2p_mutex_unlock(&wake_up_mutex);
+        il2p_mutex_unlock(&Q->wake_up_mutex);
     }
 }
 
 /*
  * Called from ax25_link
  */
-void lm_data_request(int prio, packet_t pp)
+void lm_data_request(struct port_s *P, int prio, packet_t pp)
 {
+    struct tq_s *Q = &P->tq;
     packet_t pnext;
 
     if (pp == NULL)
@@ -131,21 +128,23 @@ void lm_data_request(int prio, packet_t pp)
     /*
      * Is transmit queue out of control?
      */
-    if (tq_count(prio, "", "", 0) > 250)
+    if (tq_count(P, prio, "", "", 0) > 250)
     {
         fprintf(stderr, "Warning: Transmit packet queue for channel is extremely long.\n");
         fprintf(stderr, "Perhaps the channel is so busy there is no opportunity to send.\n");
     }
 
-    il2p_mutex_lock(&tq_mutex);
+    pp->trace[TRACE_TX_QUEUE] = dtime_now();
 
-    if (queue_head[prio] == NULL)
+    il2p_mutex_lock(&Q->tq_mutex);
+
+    if (Q->queue_head[prio] == NULL)
     {
-        queue_head[prio] = pp;
+        Q->queue_head[prio] = pp;
     }
     else
     {
-        packet_t plast = queue_head[prio];
+        packet_t plast = Q->queue_head[prio];
 
         while ((pnext = ax25_get_nextp(plast)) != NULL)
         {
@@ -155,13 +154,13 @@ void lm_data_request(int prio, packet_t pp)
         ax25_set_nextp(plast, pp);
     }
 
-    il2p_mutex_unlock(&tq_mutex);
+    il2p_mutex_unlock(&Q->tq_mutex);
 
-    if (xmit_thread_is_waiting == true)
+    if (Q->xmit_thread_is_waiting == true)
     {
-        il2p_mutex_lock(&wake_up_mutex);
+        il2p_mutex_lock(&Q->wake_up_mutex);
 
-        int err = pthread_cond_signal(&(wake_up_cond));
+        int err = pthread_cond_signal(&Q->wake_up_cond);
 
         if (err != 0)
         {
@@ -169,29 +168,30 @@ void lm_data_request(int prio, packet_t pp)
             exit(1);
         }
 
-        il2p_mutex_unlock(&wake_up_mutex);
+        il2p_mutex_unlock(&Q->wake_up_mutex);
     }
 }
 
 /*
  * Called from ax25_link
  */
-void lm_seize_request()
+void lm_seize_request(struct port_s *P)
 {
+    struct tq_s *Q = &P->tq;
     int prio = TQ_PRIO_1_LO;
 
     packet_t pnext;
     packet_t pp = ax25_new();
 
-    il2p_mutex_lock(&tq_mutex);
+    il2p_mutex_lock(&Q->tq_mutex);
 
-    if (queue_head[prio] == NULL)
+    if (Q->queue_head[prio] == NULL)
     {
-        queue_head[prio] = pp;
+        Q->queue_head[prio] = pp;
     }
     else
     {
-        packet_t plast = queue_head[prio];
+        packet_t plast = Q->queue_head[prio];
 
         while ((pnext = ax25_get_nextp(plast)) != NULL)
         {
@@ -201,15 +201,15 @@ void lm_seize_request()
         ax25_set_nextp(plast, pp);
     }
 
-    il2p_mutex_unlock(&tq_mutex);
+    il2p_mutex_unlock(&Q->tq_mutex);
 
-    if (xmit_thread_is_waiting == true)
+    if (Q->xmit_thread_is_waiting == true)
     {
         int err;
 
-        il2p_mutex_lock(&wake_up_mutex);
+        il2p_mutex_lock(&Q->wake_up_mutex);
 
-        err = pthread_cond_signal(&(wake_up_cond));
+        err = pthread_cond_signal(&Q->wake_up_cond);
 
         if (err != 0)
         {
@@ -217,30 +217,32 @@ void lm_seize_request()
             exit(1);
         }
 
-        il2p_mutex_unlock(&(wake_up_mutex));
+        il2p_mutex_unlock(&Q->wake_up_mutex);
     }
 }
 
 /*
  * Called from tx
  */
-void tq_wait_while_empty()
+void tq_wait_while_empty(struct port_s *P)
 {
-    il2p_mutex_lock(&tq_mutex);
+    struct tq_s *Q = &P->tq;
+
+    il2p_mutex_lock(&Q->tq_mutex);
 
-    bool is_empty = tq_is_empty();
+    bool is_empty = tq_is_empty(Q);
 
-    il2p_mutex_unlock(&tq_mutex);
+    il2p_mutex_unlock(&Q->tq_mutex);
 
     if (is_empty == true)
     {
-        il2p_mutex_lock(&wake_up_mutex);
+        il2p_mutex_lock(&Q->wake_up_mutex);
 
-        xmit_thread_is_waiting = true;
+        Q->xmit_thread_is_waiting = true;
 
-        int err = pthread_cond_wait(&wake_up_cond, &wake_up_mutex);
+        int err = pthread_cond_wait(&Q->wake_up_cond, &Q->wake_up_mutex);
 
-        xmit_thread_is_waiting = false;
+        Q->xmit_thread_is_waiting = false;
 
         if (err != 0)
         {
@@ -248,31 +250,32 @@ void tq_wait_while_empty()
             exit(1);
         }
 
-        il2p_mutex_unlock(&wake_up_mutex);
+        il2p_mutex_unlock(&Q->wake_up_mutex);
     }
 }
 
 /*
  * Called from tx
  */
-packet_t tq_remove(int prio)
+packet_t tq_remove(struct port_s *P, int prio)
 {
+    struct tq_s *Q = &P->tq;
     packet_t result_p;
 
-    il2p_mutex_lock(&tq_mutex);
+    il2p_mutex_lock(&Q->tq_mutex);
 
-    if (queue_head[prio] == NULL)
+    if (Q->queue_head[prio] == NULL)
     {
         result_p = NULL;
     }
     else
     {
-        result_p = queue_head[prio];
-        queue_head[prio] = ax25_get_nextp(result_p);
+        result_p = Q->queue_head[prio];
+        Q->queue_head[prio] = ax25_get_nextp(result_p);
         ax25_set_nextp(result_p, NULL);
     }
 
-    il2p_mutex_unlock(&tq_mutex);
+    il2p_mutex_unlock(&Q->tq_mutex);
 
     return result_p;
 }
@@ -280,19 +283,21 @@ packet_t tq_remove(int prio)
 /*
  * Called from tx
  */
-packet_t tq_peek(int prio)
+packet_t tq_peek(struct port_s *P, int prio)
 {
-    return queue_head[prio];
+    return P->tq.queue_head[prio];
 }
 
 /*
  * Called from local and kiss_frame
  */
-int tq_count(int prio, char *source, char *dest, int bytes)
+int tq_count(struct port_s *P, int prio, char *source, char *dest, int bytes)
 {
+    struct tq_s *Q = &P->tq;
+
     if (prio == -1) // kiss pseudo terminal
     {
-        return (tq_count(TQ_PRIO_0_HI, source, dest, bytes) + tq_count(TQ_PRIO_1_LO, source, dest, bytes));
+        return (tq_count(P, TQ_PRIO_0_HI, source, dest, bytes) + tq_count(P, TQ_PRIO_1_LO, source, dest, bytes));
     }
 
     // Array bounds check.  FIXME: TODO:  should have internal error instead of dying.
@@ -303,16 +308,16 @@ int tq_count(int prio, char *source, char *dest, int bytes)
         return 0;
     }
 
-    if (queue_head[prio] == 0)
+    if (Q->queue_head[prio] == 0)
     {
         return 0;
     }
 
     // Don't want lists being rearranged while we are traversing them.
 
-    il2p_mutex_lock(&tq_mutex);
+    il2p_mutex_lock(&Q->tq_mutex);
 
-    packet_t pp = queue_head[prio];
+    packet_t pp = Q->queue_head[prio];
 
     int n = 0; // Result.  Number of bytes or packets.
 
@@ -354,7 +359,7 @@ int tq_count(int prio, char *source, char *dest, int bytes)
         pp = ax25_get_nextp(pp);
     }
 
-    il2p_mutex_unlock(&tq_mutex);
+    il2p_mutex_unlock(&Q->tq_mutex);
 
     return n;
 }
@@ -16,6 +16,9 @@ extern "C"
 {
 #endif
 
+#include <stdbool.h>
+#include <pthread.h>
+
 #include "ax25_pad.h"
 #include "audio.h"
 
@@ -54,14 +57,30 @@ extern "C"
     }                                                                                                           \
   }
 
-  void tq_init(struct audio_s *);
-  void tq_append(int, packet_t);
-  void lm_data_request(int, packet_t);
-  void lm_seize_request(void);
-  void tq_wait_while_empty(void);
-  packet_t tq_remove(int);
-  packet_t tq_peek(int);
-  int tq_count(int, char *, char *, int);
+  /*
+   * One transmit queue per port
+   */
+  struct tq_s
+  {
+    packet_t queue_head[TQ_NUM_PRIO]; /* Head of linked list for each queue. */
+
+    pthread_mutex_t tq_mutex;
+    pthread_mutex_t wake_up_mutex; /* Required by cond_wait. */
+    pthread_cond_t wake_up_cond;   /* Notify transmit thread when queue not empty. */
+
+    bool xmit_thread_is_waiting;
+  };
+
+  struct port_s;
+
+  void tq_init(struct port_s *);
+  void tq_append(struct port_s *, int, packet_t);
+  void lm_data_request(struct port_s *, int, packet_t);
+  void lm_seize_request(struct port_s *);
+  void tq_wait_while_empty(struct port_s *);
+  packet_t tq_remove(struct port_s *, int);
+  packet_t tq_peek(struct port_s *, int);
+  int tq_count(struct port_s *, int, char *, char *, int);
 
 #ifdef __cplusplus
 }
@@ -31,81 +31,229 @@
 #include "dlq.h"
 #include "rrc_fir.h"
 #include "constellation.h"
+#include "metrics.h"
+#include "rt.h"
+#include "port.h"
 
 extern bool node_shutdown;
 
 #define WAIT_TIMEOUT_MS (60 * 1000)
 #define WAIT_CHECK_EVERY_MS 10
 
-static int tx_bits_per_sec;
-static int tx_slottime;
-static int tx_persist;
-static int tx_txdelay;
-static int tx_txtail;
-static bool tx_fulldup;
-
-#define BITS_TO_MS(b) (((b)*1000) / tx_bits_per_sec)
-#define MS_TO_BITS(ms) (((ms)*tx_bits_per_sec) / 1000) // 100 ms == 240 bits
+#define BITS_TO_MS(X, b) (((b)*1000) / (X)->bits_per_sec)
+#define MS_TO_BITS(X, ms) (((ms)*(X)->bits_per_sec) / 1000) // 100 ms == 240 bits
 
 static void *tx_thread(void *);
-static bool wait_for_clear_channel(int, int, bool);
-static void tx_frames(int, packet_t);
-static int send_one_frame(packet_t);
+static bool wait_for_clear_channel(struct port_s *);
+static void tx_frames(struct port_s *, int, packet_t);
+static int send_one_frame(struct port_s *, packet_t);
+static void tx_make_idle_cache(struct tx_s *);
+
+static complex float *m_qpsk;
 
-static pthread_t tx_tid;
-static pthread_mutex_t audio_out_dev_mutex;
-static struct audio_s *save_audio_config_p;
+/*
+ * Symbols for every octet value, MSB first,
+ * read only and shared by all ports
+ */
+#define TX_CHUNK_OCTETS 32
 
-static complex float tx_filter[NTAPS];
+static complex float qpsk_table[256][4];
+static complex float bpsk_table[256][8];
 
-static complex float m_txPhase;
-static complex float m_txRect;
-static complex float *m_qpsk;
+/*
+ * The training preamble and idle flags are the same waveform on
+ * every key-up, so they are filtered once and stored rotated by
+ * the mixer from phase zero.  Playout only multiplies by the NCO.
+ *
+ * After IDLE_FLUSH_FLAGS the filter holds nothing but idle,
+ * and every further flag of the txtail is the same steady
+ * state flag.
+ */
+#define IDLE_FLUSH_FLAGS 2
+
+static void tx_make_tables()
+{
+    for (int x = 0; x < 256; x++)
+    {
+        for (int k = 0; k < 4; k++)
+        {
+            qpsk_table[x][k] = getQPSKQuadrant((x >> (6 - (k * 2))) & 0x3);
+        }
+
+        for (int k = 0; k < 8; k++)
+        {
+            bpsk_table[x][k] = getQPSKQuadrant(((x >> (7 - k)) & 0x1) ? 3 : 0);
+        }
+    }
+}
 
-void tx_init(struct audio_s *p_modem)
+void tx_init(struct port_s *P)
 {
-    save_audio_config_p = p_modem;
+    struct audio_s *p_modem = P->audio;
+    struct tx_s *X = &P->tx;
 
-    tx_slottime = p_modem->slottime;
-    tx_persist = p_modem->persist;
-    tx_txdelay = p_modem->txdelay;
-    tx_txtail = p_modem->txtail;
-    tx_fulldup = p_modem->fulldup;
-    tx_bits_per_sec = 2400;
+    X->slottime = p_modem->slottime;
+    X->persist = p_modem->persist;
+    X->txdelay = p_modem->txdelay;
+    X->txtail = p_modem->txtail;
+    X->fulldup = p_modem->fulldup;
+    X->bits_per_sec = 2400;
 
-    tq_init(p_modem);
+    // Passband Center Frequency is 1000 Hz
+
+    X->m_txRect = cmplx((TAU * CENTER) / FS);
+    X->m_txPhase = cmplx(0.0f);
+    X->last_symbol = cmplx(0.0f);
 
-    il2p_mutex_init(&audio_out_dev_mutex);
+    X->agg_count = 0;
+    X->agg_len = 1; // flags byte
+
+    m_qpsk = getQPSKConstellation();
 
-    int e = pthread_create(&tx_tid, NULL, tx_thread, (void *)NULL);
+    tx_make_tables();
+    tx_make_idle_cache(X);
+
+    tq_init(P);
+
+    il2p_mutex_init(&X->audio_out_dev_mutex);
+
+    pthread_attr_t attr;
+
+    rt_thread_attr(&attr);
+
+    int e = pthread_create(&X->tid, &attr, tx_thread, (void *)P);
 
     if (e != 0)
     {
-        fprintf(stderr, "Fatal: Could not create transmitter thread for modem\n");
+        fprintf(stderr, "Fatal: Could not create transmitter thread for port %d\n", P->number);
         exit(1);
     }
+}
 
-    // Passband Center Frequency is 1000 Hz
+/*
+ * Symbols in the training preamble, the txdelay (10 ms units)
+ * rounded up to whole periods of TRAIN_WORD
+ */
+int tx_preamble_symbols(int txdelay)
+{
+    int symbols = (txdelay * 10 * (int)RS) / 1000;
+    int periods = (symbols + TRAIN_SYMBOLS - 1) / TRAIN_SYMBOLS;
+
+    if (periods < TRAIN_MIN_PERIODS)
+    {
+        periods = TRAIN_MIN_PERIODS;
+    }
 
-    m_txRect = cmplx((TAU * CENTER) / FS);
-    m_txPhase = cmplx(0.0f);
+    return periods * TRAIN_SYMBOLS;
+}
 
-    m_qpsk = getQPSKConstellation();
+/*
+ * Upsample the training sequence into wave, length is in samples
+ */
+static void train_upsample(complex float wave[], int length)
+{
+    for (int i = 0; i < length; i++)
+    {
+        if ((i % CYCLES) == 0)
+        {
+            int n = (i / CYCLES) % TRAIN_SYMBOLS;
+            int octet = (TRAIN_WORD >> (24 - ((n / 4) * 8))) & 0xff;
+
+            wave[i] = qpsk_table[octet][n % 4];
+        }
+        else
+        {
+            wave[i] = CMPLXF(0.0f, 0.0f);
+        }
+    }
+}
+
+/*
+ * Upsample idle flags into wave, length is in samples
+ */
+static void idle_upsample(complex float wave[], int length)
+{
+    for (int i = 0; i < length; i++)
+    {
+        if ((i % CYCLES) == 0)
+        {
+            wave[i] = bpsk_table[FLAG][(i / CYCLES) % 8];
+        }
+        else
+        {
+            wave[i] = CMPLXF(0.0f, 0.0f);
+        }
+    }
+}
+
+/*
+ * Apply the mixer rotation, starting at phase zero,
+ * and the PCM amplitude
+ */
+static void idle_rotate(struct tx_s *X, complex float wave[], int length)
+{
+    complex float phase = cmplx(0.0f);
+
+    for (int i = 0; i < length; i++)
+    {
+        phase *= X->m_txRect;
+        wave[i] *= (phase * 16384.0f);
+    }
+}
+
+static void tx_make_idle_cache(struct tx_s *X)
+{
+    complex float memory[NTAPS];
+
+    memset(memory, 0, sizeof(memory));
+
+    X->idle_preamble_len = tx_preamble_symbols(X->txdelay) * CYCLES;
+    X->idle_preamble = (complex float *)calloc(X->idle_preamble_len + 1, sizeof(complex float));
+
+    X->idle_flag_len = 8 * CYCLES;
+    X->idle_flag = (complex float *)calloc(X->idle_flag_len, sizeof(complex float));
+
+    if (X->idle_preamble == NULL || X->idle_flag == NULL)
+    {
+        fprintf(stderr, "Fatal: Could not allocate idle waveform cache\n");
+        exit(1);
+    }
+
+    /*
+     * The preamble starts from a cleared filter
+     */
+    train_upsample(X->idle_preamble, X->idle_preamble_len);
+    rrc_fir(memory, X->idle_preamble, X->idle_preamble_len);
+    memcpy(X->idle_preamble_memory, memory, sizeof(memory));
+
+    idle_rotate(X, X->idle_preamble, X->idle_preamble_len);
+
+    for (int i = 0; i <= IDLE_FLUSH_FLAGS; i++)
+    {
+        idle_upsample(X->idle_flag, X->idle_flag_len);
+        rrc_fir(memory, X->idle_flag, X->idle_flag_len);
+    }
+
+    idle_rotate(X, X->idle_flag, X->idle_flag_len);
 }
 
 static void *tx_thread(void *arg)
 {
+    struct port_s *P = (struct port_s *)arg;
+
+    rt_thread_start(RT_THREAD_TX, P->audio->cpu);
+
     while (node_shutdown == false)
     {
 
-        tq_wait_while_empty();
+        tq_wait_while_empty(P);
 
-        while (tq_peek(TQ_PRIO_0_HI) != NULL || tq_peek(TQ_PRIO_1_LO) != NULL)
+        while (tq_peek(P, TQ_PRIO_0_HI) != NULL || tq_peek(P, TQ_PRIO_1_LO) != NULL)
         {
-            bool ok = wait_for_clear_channel(tx_slottime, tx_persist, tx_fulldup);
+            bool ok = wait_for_clear_channel(P);
 
             int prio = TQ_PRIO_1_LO;
-            packet_t pp = tq_remove(TQ_PRIO_0_HI);
+            packet_t pp = tq_remove(P, TQ_PRIO_0_HI);
 
             if (pp != NULL)
             {
@@ -113,15 +261,15 @@ static void *tx_thread(void *arg)
             }
             else
             {
-                pp = tq_remove(TQ_PRIO_1_LO);
+                pp = tq_remove(P, TQ_PRIO_1_LO);
             }
 
             if (pp != NULL)
             {
                 if (ok == true)
                 {
-                    tx_frames(prio, pp);
-                    il2p_mutex_unlock(&audio_out_dev_mutex);
+                    tx_frames(P, prio, pp);
+                    il2p_mutex_unlock(&P->tx.audio_out_dev_mutex);
                 }
                 else
                 {
@@ -134,12 +282,31 @@ static void *tx_thread(void *arg)
     return 0;
 }
 
+static void put_pcm(struct port_s *P, complex float signal[], int length)
+{
+    /*
+     * Store PCM I and Q in audio output buffer
+     */
+    for (int i = 0; i < length; i++)
+    {
+        short pcm = (short)(crealf(signal[i])); // I
+        audio_put(P, pcm & 0xff);               // little-endian
+        audio_put(P, (pcm >> 8) & 0xff);
+
+        pcm = (short)(cimagf(signal[i])); // Q
+        audio_put(P, pcm & 0xff);
+        audio_put(P, (pcm >> 8) & 0xff);
+    }
+}
+
 /*
  * Modulate and upsample symbols
  * Sending them to the soundcard
  */
-static void put_symbols(complex float symbols[], int symbolsCount)
+static void put_symbols(struct port_s *P, complex float symbols[], int symbolsCount)
 {
+    struct tx_s *X = &P->tx;
+
     int outputSize = CYCLES * symbolsCount; // upsample 1200 to 9600
 
     complex float signal[outputSize]; // transmit signal
@@ -167,88 +334,170 @@ static void put_symbols(complex float symbols[], int symbolsCount)
     /*
      * Root Cosine Filter baseband
      */
-    rrc_fir(tx_filter, signal, outputSize);
+    rrc_fir(X->filter, signal, outputSize);
 
     /*
      * Shift Baseband to Passband
      */
     for (int i = 0; i < outputSize; i++)
     {
-        m_txPhase *= m_txRect;
-        signal[i] *= (m_txPhase * 16384.0f); // Factor PCM amplitude
+        X->m_txPhase *= X->m_txRect;
+        signal[i] *= (X->m_txPhase * 16384.0f); // Factor PCM amplitude
     }
 
-    /*
-     * Store PCM I and Q in audio output buffer
-     */
-    for (int i = 0; i < outputSize; i++)
+    put_pcm(P, signal, outputSize);
+}
+
+/*
+ * Play out a cached waveform that was rotated from phase
+ * zero, and move the NCO on by its length
+ */
+static void put_waveform(struct port_s *P, complex float wave[], int length)
+{
+    struct tx_s *X = &P->tx;
+    complex float signal[CYCLES * TX_CHUNK_OCTETS * 4];
+    int chunk = (int)(sizeof(signal) / sizeof(signal[0]));
+
+    for (int n = 0; n < length; n += chunk)
     {
-        short pcm = (short)(crealf(signal[i])); // I
-        audio_put(pcm & 0xff);                  // little-endian
-        audio_put((pcm >> 8) & 0xff);
+        int count = ((length - n) < chunk) ? (length - n) : chunk;
 
-        pcm = (short)(cimagf(signal[i])); // Q
-        audio_put(pcm & 0xff);
-        audio_put((pcm >> 8) & 0xff);
+        for (int i = 0; i < count; i++)
+        {
+            signal[i] = wave[n + i] * X->m_txPhase;
+        }
+
+        put_pcm(P, signal, count);
     }
+
+    X->m_txPhase *= cmplx(fmod((TAU * CENTER * length) / FS, TAU));
+    X->m_txPhase /= cabsf(X->m_txPhase);
 }
 
 /*
- * Transmit octets
+ * Transmit octets, MSB first
+ *
+ * Each octet is mapped straight to its symbols through
+ * the tables, a chunk at a time to keep the stack small.
+ *
+ * DQPSK sends each QPSK point as the phase change from the
+ * symbol before, whatever mode that was in.  The points are
+ * all unit, so the products stay on the constellation.
+ *
+ * 8PSK takes three octets at a time for eight symbols, so the
+ * chunks are a multiple of three.  The last symbol is filled
+ * out with zero bits, which the receiver does not wait for.
  */
-void tx_frame_bits(int mode, unsigned char tx_bits[], int num_bits)
+void tx_frame_octets(struct port_s *P, int mode, unsigned char octets[], int num_octets)
 {
-    int symbol_count = 0;
-    int bit_count = 0;
-    int save_bit;
+    struct tx_s *X = &P->tx;
+    complex float tx_symbols[TX_CHUNK_OCTETS * 8];
+    int chunk = (mode == Mode_8PSK) ? ((TX_CHUNK_OCTETS / 3) * 3) : TX_CHUNK_OCTETS;
 
-    if (mode == Mode_QPSK)
+    while (num_octets > 0)
     {
-        complex float tx_symbols[num_bits / 2]; // 2-Bits per symbol
+        int n = (num_octets < chunk) ? num_octets : chunk;
+        int symbol_count;
 
-        for (int i = 0; i < num_bits; i++)
+        if (mode == Mode_QPSK || mode == Mode_DQPSK) // 4 symbols per octet
         {
-            if (bit_count == 0) // wait for 2 bits
+            for (int i = 0; i < n; i++)
             {
-                save_bit = tx_bits[i];
-                bit_count++;
+                memcpy(&tx_symbols[i * 4], qpsk_table[octets[i]], sizeof(qpsk_table[0]));
+            }
+
+            symbol_count = n * 4;
 
-                continue;
+            if (mode == Mode_DQPSK)
+            {
+                for (int i = 0; i < symbol_count; i++)
+                {
+                    X->last_symbol *= tx_symbols[i];
+                    tx_symbols[i] = X->last_symbol;
+                }
             }
+        }
+        else if (mode == Mode_8PSK) // 8 symbols per 3 octets
+        {
+            for (int i = 0; i < n; i += 3)
+            {
+                unsigned int bits = octets[i] << 16;
 
-            unsigned char dibit = ((save_bit << 1) | tx_bits[i]) & 0x3;
+                if (i + 1 < n)
+                    bits |= octets[i + 1] << 8;
 
-            tx_symbols[symbol_count++] = getQPSKQuadrant(dibit);
+                if (i + 2 < n)
+                    bits |= octets[i + 2];
+
+                for (int k = 0; k < 8; k++)
+                {
+                    tx_symbols[((i / 3) * 8) + k] = get8PSKPoint((bits >> (21 - (k * 3))) & 0x7);
+                }
+            }
+
+            symbol_count = ((n * 8) + 2) / 3;
+        }
+        else // Mode_BPSK 8 symbols per octet
+        {
+            for (int i = 0; i < n; i++)
+            {
+                memcpy(&tx_symbols[i * 8], bpsk_table[octets[i]], sizeof(bpsk_table[0]));
+            }
 
-            save_bit = 0; // reset for next bits
-            bit_count = 0;
+            symbol_count = n * 8;
         }
 
-        put_symbols(tx_symbols, symbol_count);
+        put_symbols(P, tx_symbols, symbol_count);
+
+        X->last_symbol = tx_symbols[symbol_count - 1];
+        octets += n;
+        num_octets -= n;
     }
-    else // Mode_BPSK
-    {
-        complex float tx_symbols[num_bits]; // 1-Bit per symbol
+}
 
-        for(int i = 0; i < num_bits; i++)
-        {
-            tx_symbols[symbol_count++] = getQPSKQuadrant((tx_bits[i] == 0) ? 0 : 3);
-        }
+/*
+ * The mode IL2P frames go out in on this port
+ */
+int tx_data_mode(struct port_s *P)
+{
+    return (P->audio->dqpsk == true) ? Mode_DQPSK : Mode_QPSK;
+}
+
+/*
+ * Estimate the time on the air, in seconds, of a burst
+ * carrying a single frame with the given information length.
+ *
+ * Includes the training preamble and txtail idle flags.
+ */
+double tx_airtime(struct port_s *P, int info_len)
+{
+    struct tx_s *X = &P->tx;
+    il2p_payload_properties_t plprop;
+
+    int octets = IL2P_SYNC_WORD_SIZE + IL2P_HEADER_SIZE + IL2P_HEADER_PARITY;
+    int elen = il2p_payload_compute(&plprop, info_len, 0);
 
-        put_symbols(tx_symbols, symbol_count);
+    if (elen > 0)
+    {
+        octets += elen;
     }
+
+    int ms = BITS_TO_MS(X, (octets * 8) + (X->idle_preamble_len / CYCLES) * 2) + (X->txtail * 10);
+
+    return (double)ms / 1000.0;
 }
 
-static bool wait_for_clear_channel(int slottime, int persist, bool fulldup)
+static bool wait_for_clear_channel(struct port_s *P)
 {
+    struct tx_s *X = &P->tx;
     int n = 0;
 
-    if (fulldup == false)
+    if (X->fulldup == false)
     {
 
     start_over_again:
 
-        while (dcd_detect() == true)
+        while (dcd_detect(P) == true)
         {
             SLEEP_MS(WAIT_CHECK_EVERY_MS);
 
@@ -260,35 +509,35 @@ static bool wait_for_clear_channel(int slottime, int persist, bool fulldup)
             }
         }
 
-        if (save_audio_config_p->dwait > 0)
+        if (P->audio->dwait > 0)
         {
-            SLEEP_MS(save_audio_config_p->dwait * 10);
+            SLEEP_MS(P->audio->dwait * 10);
         }
 
-        if (dcd_detect() == true)
+        if (dcd_detect(P) == true)
         {
             goto start_over_again;
         }
 
-        while (tq_peek(TQ_PRIO_0_HI) == NULL)
+        while (tq_peek(P, TQ_PRIO_0_HI) == NULL)
         {
-            SLEEP_MS(slottime * 10);
+            SLEEP_MS(X->slottime * 10);
 
-            if (dcd_detect() == true)
+            if (dcd_detect(P) == true)
             {
                 goto start_over_again;
             }
 
             int r = rand() & 0xff;
 
-            if (r <= persist)
+            if (r <= X->persist)
             {
                 break;
             }
         }
     }
 
-    while (!il2p_mutex_try_lock(&audio_out_dev_mutex))
+    while (!il2p_mutex_try_lock(&X->audio_out_dev_mutex))
     {
         SLEEP_MS(WAIT_CHECK_EVERY_MS);
 
@@ -303,39 +552,142 @@ static bool wait_for_clear_channel(int slottime, int persist, bool fulldup)
     return true;
 }
 
-static int send_one_frame(packet_t pp)
+/*
+ * Called as the frame starts going to the modulator
+ */
+static void trace_frame(struct tx_s *X, packet_t pp)
+{
+    if (X->burst_count < MAX_BURST_FRAMES)
+    {
+        memcpy(X->burst_trace[X->burst_count], pp->trace, sizeof(pp->trace));
+
+        X->burst_trace[X->burst_count][TRACE_TX_PTT] = X->burst_ptt;
+        X->burst_trace[X->burst_count][TRACE_TX_SYMBOL] = dtime_now();
+        X->burst_count++;
+    }
+}
+
+/*
+ * Send the frames held for an aggregate burst.
+ * One on its own goes out as a normal frame.
+ */
+static int flush_aggregate(struct port_s *P)
 {
+    struct tx_s *X = &P->tx;
+    int nb = 0;
+
+    if (X->agg_count == 1)
+    {
+        nb = il2p_aggregate_advertise(P, X->agg_frames[0]);
+
+        trace_frame(X, X->agg_frames[0]);
+
+        int e = il2p_send_frame(P, X->agg_frames[0]);
+
+        if (e > 0)
+        {
+            nb += e;
+        }
+    }
+    else if (X->agg_count > 1)
+    {
+        for (int i = 0; i < X->agg_count; i++)
+        {
+            trace_frame(X, X->agg_frames[i]);
+        }
+
+        nb = il2p_send_aggregate(P, X->agg_frames, X->agg_count);
+    }
+
+    for (int i = 0; i < X->agg_count; i++)
+    {
+        ax25_delete(X->agg_frames[i]);
+    }
+
+    X->agg_count = 0;
+    X->agg_len = 1; // flags byte
+
+    return (nb > 0) ? nb : 0;
+}
+
+/*
+ * Takes the packet and deletes it when sent.
+ * Returns the number of bits sent, which is zero
+ * when it is held for an aggregate burst.
+ */
+static int send_one_frame(struct port_s *P, packet_t pp)
+{
+    struct tx_s *X = &P->tx;
+    int nb;
+
     if (ax25_is_null_frame(pp))
     {
-        dlq_seize_confirm();
+        nb = flush_aggregate(P);
+
+        dlq_seize_confirm(P);
 
         SLEEP_MS(10);
 
-        return 0;
+        ax25_delete(pp);
+
+        return nb;
+    }
+
+    if (il2p_aggregate_ok(P, pp))
+    {
+        int flen = ax25_get_frame_len(pp) + 2; // length in front
+
+        nb = 0;
+
+        if (X->agg_count == IL2P_AGG_MAX_FRAMES || (X->agg_len + flen) > IL2P_MAX_PAYLOAD_SIZE)
+        {
+            nb = flush_aggregate(P);
+        }
+
+        X->agg_frames[X->agg_count++] = pp;
+        X->agg_len += flen;
+
+        return nb;
     }
 
-    return il2p_send_frame(pp);
+    nb = flush_aggregate(P);
+    nb += il2p_aggregate_advertise(P, pp);
+
+    trace_frame(X, pp);
+
+    int e = il2p_send_frame(P, pp);
+
+    if (e > 0)
+    {
+        nb += e;
+    }
+
+    ax25_delete(pp);
+
+    return nb;
 }
 
-static void tx_frames(int prio, packet_t pp)
+static void tx_frames(struct port_s *P, int prio, packet_t pp)
 {
+    struct tx_s *X = &P->tx;
     int numframe = 0;
     int num_bits = 0;
-    int nb;
     bool done;
 
     double time_ptt = dtime_now();
 
-    ptt_set(OCTYPE_PTT, 1);
+    ptt_set(P, OCTYPE_PTT, 1);
 
-    dlq_seize_confirm();
+    X->burst_ptt = time_ptt;
+    X->burst_count = 0;
 
-    // Find out how many bits we need at 9600
-    int flags = MS_TO_BITS(tx_txdelay * 10);
+    dlq_seize_confirm(P);
 
-    // divide bits to find octets
-    il2p_send_idle(flags / 8); // each flag is one octet
-    num_bits += flags;
+    // The training preamble comes from the cache, QPSK is 2 bits a symbol
+    put_waveform(P, X->idle_preamble, X->idle_preamble_len);
+    memcpy(X->filter, X->idle_preamble_memory, sizeof(X->filter));
+    X->last_symbol = getQPSKQuadrant(TRAIN_WORD & 0x3);
+    num_bits += (X->idle_preamble_len / CYCLES) * 2;
 
     /*
      * Give other threads some time
@@ -345,15 +697,8 @@ static void tx_frames(int prio, packet_t pp)
     /*
      * Send the frame
      */
-    nb = send_one_frame(pp);
-
-    if (nb > 0)
-    {
-        num_bits += nb;
-        numframe++;
-    }
-
-    ax25_delete(pp);
+    num_bits += send_one_frame(P, pp);
+    numframe++;
 
     /*
      * Now while we are here, send any other
@@ -364,7 +709,7 @@ static void tx_frames(int prio, packet_t pp)
     while (numframe < 256 && (done == false))
     {
         prio = TQ_PRIO_1_LO;
-        pp = tq_peek(TQ_PRIO_0_HI);
+        pp = tq_peek(P, TQ_PRIO_0_HI);
 
         if (pp != NULL)
         {
@@ -372,22 +717,15 @@ static void tx_frames(int prio, packet_t pp)
         }
         else
         {
-            pp = tq_peek(TQ_PRIO_1_LO);
+            pp = tq_peek(P, TQ_PRIO_1_LO);
         }
 
         if (pp != NULL)
         {
-            pp = tq_remove(prio);
+            pp = tq_remove(P, prio);
 
-            nb = send_one_frame(pp);
-
-            if (nb > 0)
-            {
-                num_bits += nb;
-                numframe++;
-            }
-
-            ax25_delete(pp);
+            num_bits += send_one_frame(P, pp);
+            numframe++;
         }
         else
         {
@@ -395,21 +733,38 @@ static void tx_frames(int prio, packet_t pp)
         }
     }
 
+    num_bits += flush_aggregate(P);
+
     /*
      * Now send the tx_tail
      */
-    flags = MS_TO_BITS(tx_txtail * 10);
+    int flags = MS_TO_BITS(X, X->txtail * 10);
+
+    /*
+     * Only the first flags need the filter to
+     * clear out the data, the rest are cached
+     */
+    int octets = flags / 8;
+    int live = (octets < IDLE_FLUSH_FLAGS) ? octets : IDLE_FLUSH_FLAGS;
+
+    il2p_send_idle(P, live);
+
+    for (int i = live; i < octets; i++)
+    {
+        put_waveform(P, X->idle_flag, X->idle_flag_len);
+    }
 
-    il2p_send_idle(flags / 8);
     num_bits += flags;
 
     /*
      * Get the souncard pushing
      */
-    audio_flush();
-    audio_wait();
+    audio_flush(P);
+    audio_wait(P);
+
+    double time_drained = dtime_now();
 
-    int duration = BITS_TO_MS(num_bits);
+    int duration = BITS_TO_MS(X, num_bits);
 
     double time_now = dtime_now();
 
@@ -421,5 +776,25 @@ static void tx_frames(int prio, packet_t pp)
         SLEEP_MS(wait_more);
     }
 
-    ptt_set(OCTYPE_PTT, 0);
+    ptt_set(P, OCTYPE_PTT, 0);
+
+    double time_ptt_off = dtime_now();
+
+    for (int i = 0; i < X->burst_count; i++)
+    {
+        X->burst_trace[i][TRACE_TX_DRAINED] = time_drained;
+        X->burst_trace[i][TRACE_TX_PTT_OFF] = time_ptt_off;
+
+        metrics_trace(X->burst_trace[i]);
+    }
+
+    /*
+     * Let the link layer take our own air time
+     * off the T1 clock
+     */
+    double airtime = time_ptt_off - time_ptt;
+
+    metrics_add(METRIC_PTT_MICROSECONDS, (long)(airtime * 1.0e6));
+
+    dlq_tx_airtime(P, airtime);
 }
@@ -16,12 +16,70 @@ extern "C"
 {
 #endif
 
+#include <stdbool.h>
 #include <complex.h>
+#include <pthread.h>
 
 #include "audio.h"
+#include "ax25_pad.h"
+#include "il2p.h"
+#include "rrc_fir.h"
+#include "metrics.h"
 
-    void tx_init(struct audio_s *);
-    void tx_frame_bits(int, unsigned char *tx_bits, int);
+/*
+ * Traces of the frames in the burst, finished at PTT off
+ */
+#define MAX_BURST_FRAMES 256
+
+    /*
+     * Modulator of one port
+     */
+    struct tx_s
+    {
+        int bits_per_sec;
+        int slottime;
+        int persist;
+        int txdelay;
+        int txtail;
+        bool fulldup;
+
+        pthread_t tid;
+        pthread_mutex_t audio_out_dev_mutex;
+
+        complex float filter[NTAPS];
+        complex float m_txPhase;
+        complex float m_txRect;
+        complex float last_symbol; // sent, the DQPSK reference
+
+        /*
+         * Training preamble and idle flag waveforms,
+         * see tx_make_idle_cache()
+         */
+        complex float *idle_preamble;
+        int idle_preamble_len;
+        complex float idle_preamble_memory[NTAPS];
+        complex float *idle_flag;
+        int idle_flag_len;
+
+        /*
+         * Frames held back to share an aggregate burst
+         */
+        packet_t agg_frames[IL2P_AGG_MAX_FRAMES];
+        int agg_count;
+        int agg_len;
+
+        double burst_trace[MAX_BURST_FRAMES][TRACE_COUNT];
+        int burst_count;
+        double burst_ptt;
+    };
+
+    struct port_s;
+
+    void tx_init(struct port_s *);
+    void tx_frame_octets(struct port_s *, int, unsigned char *, int);
+    int tx_data_mode(struct port_s *);
+    double tx_airtime(struct port_s *, int);
+    int tx_preamble_symbols(int);
 
 #ifdef __cplusplus
 }